@@ -0,0 +1,118 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include "bench.h"
+
+// number of linear sub-buckets in each power of two
+static const int SUB_BUCKET_BITS = 4;
+static const int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+
+// number of empty spins before a spinning thread yields
+static const uint32_t SPINS_BEFORE_YIELD = 1000;
+
+
+//
+// local functions
+//
+
+//------------------------------------------------------------------------------
+static int highest_bit(uint64_t value) {
+  int bit = 0;
+  while (value >>= 1) {
+    ++bit;
+  }
+  return bit;
+}
+
+//------------------------------------------------------------------------------
+static size_t bucket_index(uint64_t value) {
+  // small values get a bucket each
+  if (value < (uint64_t)SUB_BUCKET_COUNT) {
+    return (size_t)value;
+  }
+
+  // the top bits below the leading one pick the sub-bucket
+  int shift = highest_bit(value) - SUB_BUCKET_BITS;
+  size_t sub_bucket = (size_t)(value >> shift) - SUB_BUCKET_COUNT;
+  return ((shift + 1) * SUB_BUCKET_COUNT) + sub_bucket;
+}
+
+//------------------------------------------------------------------------------
+static uint64_t bucket_value(size_t index) {
+  if (index < (size_t)SUB_BUCKET_COUNT) {
+    return index;
+  }
+
+  // report the top of the bucket so percentiles never read low
+  int shift = (int)(index / SUB_BUCKET_COUNT) - 1;
+  uint64_t sub_bucket = index % SUB_BUCKET_COUNT;
+  return ((SUB_BUCKET_COUNT + sub_bucket + 1) << shift) - 1;
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+void bench_histogram_reset(BenchHistogram* __restrict histogram) {
+  memset(histogram, 0, sizeof(BenchHistogram));
+}
+
+//------------------------------------------------------------------------------
+void bench_histogram_record(BenchHistogram* __restrict histogram, uint64_t value) {
+  ++histogram->counts[bucket_index(value)];
+  ++histogram->total;
+  if (value > histogram->max) {
+    histogram->max = value;
+  }
+}
+
+//------------------------------------------------------------------------------
+uint64_t bench_histogram_percentile(const BenchHistogram* __restrict histogram, double percentile) {
+  uint64_t target = (uint64_t)((double)histogram->total * percentile / 100.0);
+  if (target >= histogram->total) {
+    return histogram->max;
+  }
+
+  uint64_t seen = 0;
+  for (size_t index = 0; index < sizeof(histogram->counts) / sizeof(histogram->counts[0]); ++index) {
+    seen += histogram->counts[index];
+    if (seen > target) {
+      uint64_t value = bucket_value(index);
+      return value < histogram->max ? value : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+//------------------------------------------------------------------------------
+void bench_spin(uint32_t* __restrict spins) {
+  if (++*spins == SPINS_BEFORE_YIELD) {
+    bl_thread_yield();
+    *spins = 0;
+  }
+}
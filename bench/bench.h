@@ -0,0 +1,91 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+#ifndef BL_BENCH_H
+#define BL_BENCH_H
+
+#include <blink/base.h>
+
+//
+// options
+//
+
+// Where to run the two sides of a benchmark. A cpu of -1 leaves the thread
+// wherever the scheduler puts it. Which cpu numbers are the same core, SMT
+// siblings or on different sockets depends on the machine, so placements are
+// given on the command line as name=producer_cpu,consumer_cpu.
+struct BenchPlacement {
+  char  name[32];
+  int   producer_cpu;
+  int   consumer_cpu;
+};
+
+struct BenchOptions {
+  const BenchPlacement* placements;
+  size_t                placement_count;
+  bool                  quick;            // run a fraction of the iterations
+};
+
+//
+// latency histogram
+//
+
+// Values are bucketed by their power of two and then into 16 linear
+// sub-buckets, so a percentile is always within about 6% of the real value
+// while the whole 64 bit range fits in a fixed table.
+struct BenchHistogram {
+  uint64_t  counts[64 * 16];
+  uint64_t  total;
+  uint64_t  max;
+};
+
+void bench_histogram_reset(BenchHistogram* __restrict histogram);
+void bench_histogram_record(BenchHistogram* __restrict histogram, uint64_t value);
+
+// Returns the value at the given percentile (0 to 100).
+uint64_t bench_histogram_percentile(const BenchHistogram* __restrict histogram, double percentile);
+
+// Call in the body of a spin loop with a counter that starts at zero. Yields
+// now and then so a spinning thread can't starve the thread it waits for when
+// both share a cpu.
+void bench_spin(uint32_t* __restrict spins);
+
+//
+// benchmarks
+//
+
+// Runs the priority queue benchmarks.
+void bench_queue_priority(const BenchOptions* options);
+
+// Runs the throughput and latency benchmarks for the other queues.
+void bench_queue(const BenchOptions* options);
+
+// Runs the random read benchmarks for the io thread pool and the async path.
+// The file is small enough to stay in the page cache, so this measures the
+// per-read overhead rather than the device.
+void bench_io(const BenchOptions* options);
+
+#endif
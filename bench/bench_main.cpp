@@ -0,0 +1,116 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+struct Bench {
+  const char* name;
+  void (*func)(const BenchOptions* options);
+};
+
+static const Bench s_benches[] = {
+  { "queue_priority", &bench_queue_priority },
+  { "queue",          &bench_queue },
+  { "io",             &bench_io },
+};
+
+// most placements that can be given on the command line
+static const size_t MAX_PLACEMENTS = 16;
+
+
+//
+// local functions
+//
+
+//------------------------------------------------------------------------------
+static void print_usage(const char* exe) {
+  printf("usage: %s [options] [filter]\n", exe);
+  printf("  filter                        only run benchmarks whose names contain filter\n");
+  printf("  --quick                       run a fraction of the iterations\n");
+  printf("  --placement name=prod,cons    pin producers and consumers to these cpus\n");
+  printf("                                (e.g. same=0,0 smt=0,1 socket=0,8)\n");
+}
+
+//------------------------------------------------------------------------------
+static bool parse_placement(const char* arg, BenchPlacement* __restrict placement) {
+  const char* equals = strchr(arg, '=');
+  if (!equals || (size_t)(equals - arg) >= sizeof(placement->name)) {
+    return false;
+  }
+  memset(placement->name, 0, sizeof(placement->name));
+  memcpy(placement->name, arg, equals - arg);
+  return sscanf(equals + 1, "%d,%d", &placement->producer_cpu, &placement->consumer_cpu) == 2;
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+int main(int argc, char** argv) {
+  BenchPlacement placements[MAX_PLACEMENTS];
+  BenchOptions options;
+  options.placements      = placements;
+  options.placement_count = 0;
+  options.quick           = false;
+
+  const char* filter = NULL;
+  for (int arg = 1; arg < argc; ++arg) {
+    if (!strcmp(argv[arg], "--quick")) {
+      options.quick = true;
+    }
+    else if (!strcmp(argv[arg], "--placement") && (arg + 1 < argc) && (options.placement_count < MAX_PLACEMENTS)) {
+      if (!parse_placement(argv[++arg], placements + options.placement_count++)) {
+        print_usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (argv[arg][0] != '-') {
+      filter = argv[arg];
+    }
+    else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // without any placements, let the scheduler decide
+  if (options.placement_count == 0) {
+    parse_placement("unpinned=-1,-1", placements);
+    options.placement_count = 1;
+  }
+
+  for (size_t index = 0; index < sizeof(s_benches) / sizeof(s_benches[0]); ++index) {
+    const Bench& bench = s_benches[index];
+    if (!filter || strstr(bench.name, filter)) {
+      bench.func(&options);
+    }
+  }
+  return 0;
+}
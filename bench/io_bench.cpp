@@ -0,0 +1,207 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <unistd.h>
+#include <blink/io.h>
+#include <blink/job.h>
+#include "bench.h"
+
+// size of the file read from
+static const uint64_t FILE_SIZE = 16 * 1024 * 1024;
+
+// size of each read
+static const uint64_t READ_SIZE = 4096;
+
+// reads issued in a run (a tenth with --quick)
+static const int READ_COUNT = 200000;
+
+// most reads the benchmark keeps outstanding
+static const int WINDOW = 64;
+
+struct IoConfig {
+  const char*   name;
+  unsigned int  thread_count;
+  unsigned int  async_queue_depth;
+  unsigned int  cache_block_count;
+  bool          compressed;           // read the compressed copy of the file
+  bool          decompress_on_jobs;
+};
+
+static const IoConfig s_configs[] = {
+  { "io pread threads=1",       1,  0,    0,    false,  false },
+  { "io pread threads=4",       4,  0,    0,    false,  false },
+  { "io pread threads=16",      16, 0,    0,    false,  false },
+  { "io async depth=32",        1,  32,   0,    false,  false },
+  { "io async depth=128",       1,  128,  0,    false,  false },
+  { "io cache 16MB threads=4",  4,  0,    1024, false,  false },
+  { "io cache 16MB depth=32",   1,  32,   1024, false,  false },
+  { "io compressed threads=4",  4,  0,    0,    true,   false },
+  { "io compressed jobs=4",     4,  0,    0,    true,   true  },
+};
+
+// size of the blocks of the compressed copy
+static const uint32_t COMPRESS_BLOCK_SIZE = 16 * 1024;
+
+// job workers started for the configs that decompress on them
+static const unsigned int JOB_WORKER_COUNT = 4;
+
+
+//
+// local functions
+//
+
+//------------------------------------------------------------------------------
+static uint32_t next_random(uint32_t* seed) {
+  uint32_t x = *seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return x;
+}
+
+//------------------------------------------------------------------------------
+static bool write_file(const char* path) {
+  FILE* fp = fopen(path, "wb");
+  if (!fp) {
+    return false;
+  }
+  uint8_t block[4096];
+  for (size_t index = 0; index < sizeof(block); ++index) {
+    block[index] = (uint8_t)index;
+  }
+  for (uint64_t offset = 0; offset < FILE_SIZE; offset += sizeof(block)) {
+    fwrite(block, 1, sizeof(block), fp);
+  }
+  fclose(fp);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+static void run(const IoConfig* config, const char* path, int read_count) {
+  BLIoLibInitParams params;
+  params.thread_count       = config->thread_count;
+  params.async_queue_depth  = config->async_queue_depth;
+  params.cache_block_count  = config->cache_block_count;
+  params.decompress_on_jobs = config->decompress_on_jobs;
+  if (config->decompress_on_jobs) {
+    BLJobLibInitParams job_params;
+    job_params.worker_thread_count = JOB_WORKER_COUNT;
+    bl_job_lib_initialize(&job_params);
+  }
+  bl_io_lib_initialize(&params);
+
+  BLIoFile* file;
+  BLIoStatus status = config->compressed ? bl_io_file_open_compressed_sync(path, NULL, &file) : bl_io_file_open_sync(path, NULL, &file);
+  if (status != BL_IO_STATUS_OK) {
+    printf("%-28s failed to open %s\n", config->name, path);
+    bl_io_lib_finalize();
+    if (config->decompress_on_jobs) {
+      bl_job_lib_finalize();
+    }
+    return;
+  }
+
+  uint8_t* buffers = (uint8_t*)bl_alloc(READ_SIZE * WINDOW, 4096);
+  BLIoOp* ops[WINDOW] = { NULL };
+  BenchHistogram* histogram = (BenchHistogram*)bl_alloc(sizeof(BenchHistogram), 8);
+  bench_histogram_reset(histogram);
+  uint64_t issued_at[WINDOW];
+  uint32_t seed = 1;
+
+  // keep the window full of random page aligned reads, replacing the oldest
+  // read as it completes
+  uint64_t start = bl_time_ns();
+  for (int index = 0; index < read_count + WINDOW; ++index) {
+    int slot = index % WINDOW;
+    if (ops[slot]) {
+      bl_io_op_wait(ops[slot]);
+      bench_histogram_record(histogram, bl_time_ns() - issued_at[slot]);
+      bl_io_op_delete(ops[slot]);
+      ops[slot] = NULL;
+    }
+    if (index < read_count) {
+      uint64_t block = next_random(&seed) % (FILE_SIZE / READ_SIZE);
+      bl_io_file_seek_sync(file, block * READ_SIZE);
+      issued_at[slot] = bl_time_ns();
+      ops[slot] = bl_io_file_read(file, NULL, buffers + slot * READ_SIZE, READ_SIZE);
+    }
+  }
+  uint64_t elapsed = bl_time_ns() - start;
+
+  printf("%-28s %8.0f reads/s  p50=%6.1fus p99=%7.1fus\n",
+    config->name,
+    (double)read_count * 1000000000.0 / (double)elapsed,
+    (double)bench_histogram_percentile(histogram, 50.0) / 1000.0,
+    (double)bench_histogram_percentile(histogram, 99.0) / 1000.0);
+  if (config->cache_block_count) {
+    BLIoCacheStats stats;
+    bl_io_cache_get_stats(&stats);
+    printf("%-28s %8.1f%% hits\n", "", 100.0 * (double)stats.hits / (double)(stats.hits + stats.misses));
+  }
+
+  bl_free(histogram);
+  bl_free(buffers);
+  bl_io_file_close_sync(file, NULL);
+  bl_io_lib_finalize();
+  if (config->decompress_on_jobs) {
+    bl_job_lib_finalize();
+  }
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+void bench_io(const BenchOptions* options) {
+  char path[64];
+  char compressed_path[80];
+  snprintf(path, sizeof(path), "/tmp/blink_io_bench_%d", (int)getpid());
+  snprintf(compressed_path, sizeof(compressed_path), "%s.z", path);
+  if (!write_file(path)) {
+    printf("io: failed to write %s\n", path);
+    return;
+  }
+  bl_io_lib_initialize();
+  BLIoStatus status = bl_io_compress_file(path, compressed_path, COMPRESS_BLOCK_SIZE);
+  bl_io_lib_finalize();
+  if (status != BL_IO_STATUS_OK) {
+    printf("io: failed to write %s\n", compressed_path);
+    unlink(path);
+    return;
+  }
+
+  int read_count = options->quick ? READ_COUNT / 10 : READ_COUNT;
+  for (size_t index = 0; index < sizeof(s_configs) / sizeof(s_configs[0]); ++index) {
+    const IoConfig* config = s_configs + index;
+    run(config, config->compressed ? compressed_path : path, read_count);
+  }
+
+  unlink(compressed_path);
+  unlink(path);
+}
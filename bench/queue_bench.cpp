@@ -0,0 +1,629 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <string.h>
+#include <blink/queue.h>
+#include "bench.h"
+
+// number of elements each queue can hold
+static const uint32_t QUEUE_CAPACITY = 1024;
+
+// elements written by each producer in a throughput run (a hundredth with
+// --quick)
+static const uint64_t ELEMENTS_PER_PRODUCER = 1000000;
+
+// round trips timed in a latency run (a hundredth with --quick), after some
+// untimed ones to warm up the caches
+static const int ROUND_TRIPS = 100000;
+static const int WARMUP_ROUND_TRIPS = 1000;
+
+// element sizes and producer counts to run
+static const size_t ELEMENT_SIZES[] = { 8, 64, 256 };
+static const int PRODUCER_COUNTS[] = { 1, 2, 4 };
+static const size_t MAX_ELEMENT_SIZE = 256;
+static const int MAX_PRODUCERS = 4;
+
+// Every queue is driven through the same table of functions so one set of
+// runners covers them all. The indirect calls cost the same for every queue.
+struct QueueType {
+  const char* name;
+  size_t      fixed_element_size;   // 0 if the queue takes any element size
+  bool        multi_producer;       // true if writers may run concurrently
+  void*       (*create)(size_t element_size);
+  void        (*destroy)(void* queue);
+  void*       (*write_prepare)(void* queue);
+  void        (*write_commit)(void* queue, void* element);
+  void*       (*read_fetch)(void* queue);
+  void        (*read_consume)(void* queue);
+};
+
+struct ThroughputThread {
+  const QueueType*          type;
+  void*                     queue;
+  size_t                    element_size;
+  uint64_t                  count;        // elements to write or read
+  int                       cpu;
+  const volatile int32_t*   start;
+  BLThread                  thread;
+};
+
+struct PingPongThread {
+  const QueueType*          type;
+  void*                     to_pong;
+  void*                     to_ping;
+  size_t                    element_size;
+  int                       count;        // round trips including the warmup
+  int                       cpu;
+  const volatile int32_t*   start;
+  BenchHistogram*           histogram;    // (ping) round trip times
+  BLThread                  thread;
+};
+
+template<size_t S>
+struct Element {
+  uint8_t bytes[S];
+};
+
+struct SwsrQueue {
+  BLQueueSWSR queue;
+  void*       buf;
+};
+
+struct BlockingQueue {
+  BLQueueSWSRBlocking queue;
+  void*               buf;
+};
+
+struct MpscRingQueue {
+  BLQueueMPSCRing queue;
+  void*           buf;
+};
+
+struct BroadcastQueue {
+  BLQueueBroadcast        queue;
+  BLQueueBroadcastCursor  cursor;
+  void*                   buf;
+};
+
+struct MsgQueue {
+  BLQueueMsgSWSR  queue;
+  size_t          element_size;
+  void*           buf;
+};
+
+// keeps the consumer's copies from being optimized away
+static volatile uint8_t s_sink;
+
+
+//
+// queue adapters
+//
+
+//------------------------------------------------------------------------------
+static void* swsr_create(size_t element_size) {
+  SwsrQueue* q = (SwsrQueue*)bl_alloc(sizeof(SwsrQueue), 128);
+  q->buf = bl_alloc(QUEUE_CAPACITY * element_size, 128);
+  bl_queue_init(&q->queue, q->buf, QUEUE_CAPACITY, element_size);
+  return q;
+}
+
+//------------------------------------------------------------------------------
+static void swsr_destroy(void* queue) {
+  SwsrQueue* q = (SwsrQueue*)queue;
+  bl_free(q->buf);
+  bl_free(q);
+}
+
+//------------------------------------------------------------------------------
+static void* swsr_write_prepare(void* queue) {
+  bool empty;
+  return bl_queue_write_prepare(&((SwsrQueue*)queue)->queue, &empty);
+}
+
+//------------------------------------------------------------------------------
+static void swsr_write_commit(void* queue, void*) {
+  bl_queue_write_commit(&((SwsrQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void* swsr_read_fetch(void* queue) {
+  return bl_queue_read_fetch(&((SwsrQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void swsr_read_consume(void* queue) {
+  bl_queue_read_consume(&((SwsrQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void* blocking_create(size_t element_size) {
+  BlockingQueue* q = (BlockingQueue*)bl_alloc(sizeof(BlockingQueue), 128);
+  q->buf = bl_alloc(QUEUE_CAPACITY * element_size, 128);
+  bl_queue_blocking_init(&q->queue, q->buf, QUEUE_CAPACITY, element_size);
+  return q;
+}
+
+//------------------------------------------------------------------------------
+static void blocking_destroy(void* queue) {
+  BlockingQueue* q = (BlockingQueue*)queue;
+  bl_queue_blocking_destroy(&q->queue);
+  bl_free(q->buf);
+  bl_free(q);
+}
+
+//------------------------------------------------------------------------------
+static void* blocking_write_prepare(void* queue) {
+  return bl_queue_blocking_write_prepare(&((BlockingQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void blocking_write_commit(void* queue, void*) {
+  bl_queue_blocking_write_commit(&((BlockingQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void* blocking_read_fetch(void* queue) {
+  return bl_queue_blocking_read_fetch(&((BlockingQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void blocking_read_consume(void* queue) {
+  bl_queue_blocking_read_consume(&((BlockingQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+template<size_t S>
+static void* typed_create(size_t) {
+  BLQueue<Element<S>, QUEUE_CAPACITY>* q = (BLQueue<Element<S>, QUEUE_CAPACITY>*)bl_alloc(sizeof(BLQueue<Element<S>, QUEUE_CAPACITY>), 128);
+  bl_queue_init(q);
+  return q;
+}
+
+//------------------------------------------------------------------------------
+static void typed_destroy(void* queue) {
+  bl_free(queue);
+}
+
+//------------------------------------------------------------------------------
+template<size_t S>
+static void* typed_write_prepare(void* queue) {
+  return bl_queue_write_prepare((BLQueue<Element<S>, QUEUE_CAPACITY>*)queue);
+}
+
+//------------------------------------------------------------------------------
+template<size_t S>
+static void typed_write_commit(void* queue, void*) {
+  bl_queue_write_commit((BLQueue<Element<S>, QUEUE_CAPACITY>*)queue);
+}
+
+//------------------------------------------------------------------------------
+template<size_t S>
+static void* typed_read_fetch(void* queue) {
+  return bl_queue_read_fetch((BLQueue<Element<S>, QUEUE_CAPACITY>*)queue);
+}
+
+//------------------------------------------------------------------------------
+template<size_t S>
+static void typed_read_consume(void* queue) {
+  bl_queue_read_consume((BLQueue<Element<S>, QUEUE_CAPACITY>*)queue);
+}
+
+//------------------------------------------------------------------------------
+static void* mpsc_ring_create(size_t element_size) {
+  MpscRingQueue* q = (MpscRingQueue*)bl_alloc(sizeof(MpscRingQueue), 128);
+  q->buf = bl_alloc(bl_queue_mpsc_ring_buffer_size(QUEUE_CAPACITY, element_size), 128);
+  bl_queue_mpsc_ring_init(&q->queue, q->buf, QUEUE_CAPACITY, element_size);
+  return q;
+}
+
+//------------------------------------------------------------------------------
+static void mpsc_ring_destroy(void* queue) {
+  MpscRingQueue* q = (MpscRingQueue*)queue;
+  bl_queue_mpsc_ring_destroy(&q->queue);
+  bl_free(q->buf);
+  bl_free(q);
+}
+
+//------------------------------------------------------------------------------
+static void* mpsc_ring_write_prepare(void* queue) {
+  return bl_queue_mpsc_ring_write_prepare(&((MpscRingQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void mpsc_ring_write_commit(void* queue, void* element) {
+  bl_queue_mpsc_ring_write_commit(&((MpscRingQueue*)queue)->queue, element);
+}
+
+//------------------------------------------------------------------------------
+static void* mpsc_ring_read_fetch(void* queue) {
+  return bl_queue_mpsc_ring_read_fetch(&((MpscRingQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void mpsc_ring_read_consume(void* queue) {
+  bl_queue_mpsc_ring_read_consume(&((MpscRingQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void* broadcast_create(size_t element_size) {
+  BroadcastQueue* q = (BroadcastQueue*)bl_alloc(sizeof(BroadcastQueue), 128);
+  q->buf = bl_alloc(QUEUE_CAPACITY * element_size, 128);
+  bl_queue_broadcast_init(&q->queue, q->buf, QUEUE_CAPACITY, element_size, &q->cursor, 1);
+  return q;
+}
+
+//------------------------------------------------------------------------------
+static void broadcast_destroy(void* queue) {
+  BroadcastQueue* q = (BroadcastQueue*)queue;
+  bl_free(q->buf);
+  bl_free(q);
+}
+
+//------------------------------------------------------------------------------
+static void* broadcast_write_prepare(void* queue) {
+  return bl_queue_broadcast_write_prepare(&((BroadcastQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void broadcast_write_commit(void* queue, void*) {
+  bl_queue_broadcast_write_commit(&((BroadcastQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void* broadcast_read_fetch(void* queue) {
+  return bl_queue_broadcast_read_fetch(&((BroadcastQueue*)queue)->queue, 0);
+}
+
+//------------------------------------------------------------------------------
+static void broadcast_read_consume(void* queue) {
+  bl_queue_broadcast_read_consume(&((BroadcastQueue*)queue)->queue, 0);
+}
+
+//------------------------------------------------------------------------------
+static void* msg_create(size_t element_size) {
+  // room for QUEUE_CAPACITY messages, rounded up to a power of two
+  size_t size = 1;
+  while (size < QUEUE_CAPACITY * (element_size + 2 * BL_QUEUE_MSG_ALIGNMENT)) {
+    size <<= 1;
+  }
+
+  MsgQueue* q = (MsgQueue*)bl_alloc(sizeof(MsgQueue), 128);
+  q->element_size = element_size;
+  q->buf = bl_alloc(size, 128);
+  bl_queue_msg_init(&q->queue, q->buf, size);
+  return q;
+}
+
+//------------------------------------------------------------------------------
+static void msg_destroy(void* queue) {
+  MsgQueue* q = (MsgQueue*)queue;
+  bl_free(q->buf);
+  bl_free(q);
+}
+
+//------------------------------------------------------------------------------
+static void* msg_write_prepare(void* queue) {
+  MsgQueue* q = (MsgQueue*)queue;
+  return bl_queue_msg_write_prepare(&q->queue, q->element_size);
+}
+
+//------------------------------------------------------------------------------
+static void msg_write_commit(void* queue, void*) {
+  bl_queue_msg_write_commit(&((MsgQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void* msg_read_fetch(void* queue) {
+  size_t size;
+  return bl_queue_msg_read_fetch(&((MsgQueue*)queue)->queue, &size);
+}
+
+//------------------------------------------------------------------------------
+static void msg_read_consume(void* queue) {
+  bl_queue_msg_read_consume(&((MsgQueue*)queue)->queue);
+}
+
+//------------------------------------------------------------------------------
+static void* shm_swsr_create(size_t element_size) {
+  void* region = bl_alloc(bl_queue_shm_swsr_size(QUEUE_CAPACITY, element_size), 128);
+  return bl_queue_shm_swsr_init(region, QUEUE_CAPACITY, element_size);
+}
+
+//------------------------------------------------------------------------------
+static void shm_destroy(void* queue) {
+  bl_free(queue);
+}
+
+//------------------------------------------------------------------------------
+static void* shm_swsr_write_prepare(void* queue) {
+  return bl_queue_shm_swsr_write_prepare((BLQueueShmSWSR*)queue);
+}
+
+//------------------------------------------------------------------------------
+static void shm_swsr_write_commit(void* queue, void*) {
+  bl_queue_shm_swsr_write_commit((BLQueueShmSWSR*)queue);
+}
+
+//------------------------------------------------------------------------------
+static void* shm_swsr_read_fetch(void* queue) {
+  return bl_queue_shm_swsr_read_fetch((BLQueueShmSWSR*)queue);
+}
+
+//------------------------------------------------------------------------------
+static void shm_swsr_read_consume(void* queue) {
+  bl_queue_shm_swsr_read_consume((BLQueueShmSWSR*)queue);
+}
+
+//------------------------------------------------------------------------------
+static void* shm_mpsc_create(size_t element_size) {
+  void* region = bl_alloc(bl_queue_shm_mpsc_size(QUEUE_CAPACITY, element_size), 128);
+  return bl_queue_shm_mpsc_init(region, QUEUE_CAPACITY, element_size);
+}
+
+//------------------------------------------------------------------------------
+static void* shm_mpsc_write_prepare(void* queue) {
+  return bl_queue_shm_mpsc_write_prepare((BLQueueShmMPSC*)queue);
+}
+
+//------------------------------------------------------------------------------
+static void shm_mpsc_write_commit(void* queue, void* element) {
+  bl_queue_shm_mpsc_write_commit((BLQueueShmMPSC*)queue, element);
+}
+
+//------------------------------------------------------------------------------
+static void* shm_mpsc_read_fetch(void* queue) {
+  return bl_queue_shm_mpsc_read_fetch((BLQueueShmMPSC*)queue);
+}
+
+//------------------------------------------------------------------------------
+static void shm_mpsc_read_consume(void* queue) {
+  bl_queue_shm_mpsc_read_consume((BLQueueShmMPSC*)queue);
+}
+
+// The intrusive BLQueueMPSC is left out since it links caller-owned nodes
+// rather than copying elements.
+static const QueueType s_queue_types[] = {
+  { "swsr",       0,    false,  &swsr_create,       &swsr_destroy,      &swsr_write_prepare,        &swsr_write_commit,       &swsr_read_fetch,       &swsr_read_consume },
+  { "swsr_block", 0,    false,  &blocking_create,   &blocking_destroy,  &blocking_write_prepare,    &blocking_write_commit,   &blocking_read_fetch,   &blocking_read_consume },
+  { "typed",      8,    false,  &typed_create<8>,   &typed_destroy,     &typed_write_prepare<8>,    &typed_write_commit<8>,   &typed_read_fetch<8>,   &typed_read_consume<8> },
+  { "typed",      64,   false,  &typed_create<64>,  &typed_destroy,     &typed_write_prepare<64>,   &typed_write_commit<64>,  &typed_read_fetch<64>,  &typed_read_consume<64> },
+  { "typed",      256,  false,  &typed_create<256>, &typed_destroy,     &typed_write_prepare<256>,  &typed_write_commit<256>, &typed_read_fetch<256>, &typed_read_consume<256> },
+  { "broadcast",  0,    false,  &broadcast_create,  &broadcast_destroy, &broadcast_write_prepare,   &broadcast_write_commit,  &broadcast_read_fetch,  &broadcast_read_consume },
+  { "msg",        0,    false,  &msg_create,        &msg_destroy,       &msg_write_prepare,         &msg_write_commit,        &msg_read_fetch,        &msg_read_consume },
+  { "shm_swsr",   0,    false,  &shm_swsr_create,   &shm_destroy,       &shm_swsr_write_prepare,    &shm_swsr_write_commit,   &shm_swsr_read_fetch,   &shm_swsr_read_consume },
+  { "mpsc_ring",  0,    true,   &mpsc_ring_create,  &mpsc_ring_destroy, &mpsc_ring_write_prepare,   &mpsc_ring_write_commit,  &mpsc_ring_read_fetch,  &mpsc_ring_read_consume },
+  { "shm_mpsc",   0,    true,   &shm_mpsc_create,   &shm_destroy,       &shm_mpsc_write_prepare,    &shm_mpsc_write_commit,   &shm_mpsc_read_fetch,   &shm_mpsc_read_consume },
+};
+
+
+//
+// runners
+//
+
+//------------------------------------------------------------------------------
+static void wait_for_start(const volatile int32_t* start, int cpu) {
+  if (cpu >= 0) {
+    bl_thread_set_affinity((uint32_t)cpu);
+  }
+  uint32_t spins = 0;
+  while (!*start) {
+    bench_spin(&spins);
+  }
+}
+
+//------------------------------------------------------------------------------
+static void producer_proc(void* param) {
+  ThroughputThread* t = (ThroughputThread*)param;
+  const QueueType* type = t->type;
+  uint8_t src[MAX_ELEMENT_SIZE];
+  memset(src, 0xab, sizeof(src));
+
+  wait_for_start(t->start, t->cpu);
+  uint32_t spins = 0;
+  for (uint64_t index = 0; index < t->count; ++index) {
+    void* element;
+    while (!(element = type->write_prepare(t->queue))) {
+      bench_spin(&spins);
+    }
+    memcpy(element, src, t->element_size);
+    type->write_commit(t->queue, element);
+  }
+}
+
+//------------------------------------------------------------------------------
+static void consumer_proc(void* param) {
+  ThroughputThread* t = (ThroughputThread*)param;
+  const QueueType* type = t->type;
+  uint8_t dst[MAX_ELEMENT_SIZE];
+
+  wait_for_start(t->start, t->cpu);
+  uint32_t spins = 0;
+  for (uint64_t index = 0; index < t->count; ++index) {
+    void* element;
+    while (!(element = type->read_fetch(t->queue))) {
+      bench_spin(&spins);
+    }
+    memcpy(dst, element, t->element_size);
+    type->read_consume(t->queue);
+  }
+  s_sink = dst[0];
+}
+
+//------------------------------------------------------------------------------
+static void ping_proc(void* param) {
+  PingPongThread* t = (PingPongThread*)param;
+  const QueueType* type = t->type;
+  uint8_t buf[MAX_ELEMENT_SIZE];
+  memset(buf, 0xab, sizeof(buf));
+
+  wait_for_start(t->start, t->cpu);
+  uint32_t spins = 0;
+  for (int index = 0; index < t->count; ++index) {
+    uint64_t start = bl_time_ns();
+
+    void* element;
+    while (!(element = type->write_prepare(t->to_pong))) {
+      bench_spin(&spins);
+    }
+    memcpy(element, buf, t->element_size);
+    type->write_commit(t->to_pong, element);
+
+    while (!(element = type->read_fetch(t->to_ping))) {
+      bench_spin(&spins);
+    }
+    memcpy(buf, element, t->element_size);
+    type->read_consume(t->to_ping);
+
+    if (index >= WARMUP_ROUND_TRIPS) {
+      bench_histogram_record(t->histogram, bl_time_ns() - start);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+static void pong_proc(void* param) {
+  PingPongThread* t = (PingPongThread*)param;
+  const QueueType* type = t->type;
+
+  wait_for_start(t->start, t->cpu);
+  uint32_t spins = 0;
+  for (int index = 0; index < t->count; ++index) {
+    void* in;
+    while (!(in = type->read_fetch(t->to_pong))) {
+      bench_spin(&spins);
+    }
+    void* out;
+    while (!(out = type->write_prepare(t->to_ping))) {
+      bench_spin(&spins);
+    }
+    memcpy(out, in, t->element_size);
+    type->write_commit(t->to_ping, out);
+    type->read_consume(t->to_pong);
+  }
+}
+
+//------------------------------------------------------------------------------
+static void run_throughput(const QueueType* type, const BenchPlacement* placement, size_t element_size, int producer_count, uint64_t count) {
+  void* queue = type->create(element_size);
+  volatile int32_t start = 0;
+
+  // producer n runs on the cpu n past the placement's producer cpu
+  ThroughputThread threads[MAX_PRODUCERS + 1];
+  for (int index = 0; index <= producer_count; ++index) {
+    ThroughputThread* t = threads + index;
+    bool consumer = index == producer_count;
+    t->type         = type;
+    t->queue        = queue;
+    t->element_size = element_size;
+    t->count        = consumer ? count * producer_count : count;
+    t->cpu          = consumer ? placement->consumer_cpu : (placement->producer_cpu < 0 ? -1 : placement->producer_cpu + index);
+    t->start        = &start;
+    bl_thread_create(&t->thread, consumer ? &consumer_proc : &producer_proc, t);
+  }
+
+  uint64_t start_time = bl_time_ns();
+  start = 1;
+  for (int index = 0; index <= producer_count; ++index) {
+    bl_thread_join(&threads[index].thread);
+  }
+  uint64_t elapsed = bl_time_ns() - start_time;
+  type->destroy(queue);
+
+  double elements = (double)count * producer_count;
+  double seconds = (double)elapsed / 1000000000.0;
+  printf("queue %-10s %-10s size=%-3d producers=%d %8.2f Melem/s %9.1f MB/s\n", type->name, placement->name, (int)element_size, producer_count, elements / seconds / 1000000.0, elements * element_size / seconds / (1024.0 * 1024.0));
+}
+
+//------------------------------------------------------------------------------
+static void run_latency(const QueueType* type, const BenchPlacement* placement, size_t element_size, int round_trips) {
+  void* to_pong = type->create(element_size);
+  void* to_ping = type->create(element_size);
+  volatile int32_t start = 0;
+
+  static BenchHistogram histogram;
+  bench_histogram_reset(&histogram);
+
+  PingPongThread threads[2];
+  for (int index = 0; index < 2; ++index) {
+    PingPongThread* t = threads + index;
+    t->type         = type;
+    t->to_pong      = to_pong;
+    t->to_ping      = to_ping;
+    t->element_size = element_size;
+    t->count        = WARMUP_ROUND_TRIPS + round_trips;
+    t->cpu          = index == 0 ? placement->producer_cpu : placement->consumer_cpu;
+    t->start        = &start;
+    t->histogram    = &histogram;
+    bl_thread_create(&t->thread, index == 0 ? &ping_proc : &pong_proc, t);
+  }
+
+  start = 1;
+  bl_thread_join(&threads[0].thread);
+  bl_thread_join(&threads[1].thread);
+  type->destroy(to_pong);
+  type->destroy(to_ping);
+
+  printf("queue %-10s %-10s size=%-3d rtt ns p50=%-7llu p90=%-7llu p99=%-7llu p99.9=%-7llu max=%llu\n", type->name, placement->name, (int)element_size,
+    (unsigned long long)bench_histogram_percentile(&histogram, 50.0),
+    (unsigned long long)bench_histogram_percentile(&histogram, 90.0),
+    (unsigned long long)bench_histogram_percentile(&histogram, 99.0),
+    (unsigned long long)bench_histogram_percentile(&histogram, 99.9),
+    (unsigned long long)histogram.max);
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+void bench_queue(const BenchOptions* options) {
+  uint64_t count = options->quick ? ELEMENTS_PER_PRODUCER / 100 : ELEMENTS_PER_PRODUCER;
+  int round_trips = options->quick ? ROUND_TRIPS / 100 : ROUND_TRIPS;
+
+  for (size_t placement = 0; placement < options->placement_count; ++placement) {
+    for (size_t type = 0; type < sizeof(s_queue_types) / sizeof(s_queue_types[0]); ++type) {
+      const QueueType* queue_type = s_queue_types + type;
+      for (size_t size = 0; size < sizeof(ELEMENT_SIZES) / sizeof(ELEMENT_SIZES[0]); ++size) {
+        size_t element_size = ELEMENT_SIZES[size];
+        if (queue_type->fixed_element_size && (queue_type->fixed_element_size != element_size)) {
+          continue;
+        }
+
+        // only the multi-producer queues get more than one producer
+        for (size_t producers = 0; producers < sizeof(PRODUCER_COUNTS) / sizeof(PRODUCER_COUNTS[0]); ++producers) {
+          int producer_count = PRODUCER_COUNTS[producers];
+          if ((producer_count > 1) && !queue_type->multi_producer) {
+            break;
+          }
+          run_throughput(queue_type, options->placements + placement, element_size, producer_count, count);
+        }
+
+        run_latency(queue_type, options->placements + placement, element_size, round_trips);
+      }
+    }
+  }
+}
@@ -0,0 +1,204 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <algorithm>
+#include <blink/queue.h>
+#include "bench.h"
+
+// items pushed (and popped) by each thread in a run (a hundredth with --quick)
+static const int OPS_PER_THREAD = 1000000;
+
+// items in the queue before a run starts, so pops rarely find it empty
+static const int PREFILL_COUNT = 4096;
+
+// max number of items in the queue
+static const size_t QUEUE_CAPACITY = 1 << 20;
+
+// The baseline: one binary heap behind one mutex.
+struct MutexHeap {
+  BLMutex               mutex;
+  BLQueuePriorityItem*  items;
+  size_t                count;
+};
+
+struct RunParam {
+  MutexHeap*        heap;       // set for the baseline runs
+  BLQueuePriority*  queue;      // set for the multi-queue runs
+  size_t            batch_size;
+  int               op_count;
+  uint32_t          seed;
+  BLThread          thread;
+};
+
+
+//
+// local functions
+//
+
+//------------------------------------------------------------------------------
+static bool item_greater(const BLQueuePriorityItem& a, const BLQueuePriorityItem& b) {
+  return a.priority > b.priority;
+}
+
+//------------------------------------------------------------------------------
+static uint64_t next_priority(uint32_t* seed) {
+  uint32_t x = *seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return x;
+}
+
+//------------------------------------------------------------------------------
+static void mutex_heap_push(MutexHeap* heap, const BLQueuePriorityItem* items, size_t count) {
+  bl_mutex_lock(&heap->mutex);
+  for (size_t index = 0; index < count; ++index) {
+    heap->items[heap->count++] = items[index];
+    std::push_heap(heap->items, heap->items + heap->count, &item_greater);
+  }
+  bl_mutex_unlock(&heap->mutex);
+}
+
+//------------------------------------------------------------------------------
+static size_t mutex_heap_pop(MutexHeap* heap, BLQueuePriorityItem* items, size_t count) {
+  bl_mutex_lock(&heap->mutex);
+  size_t popped = 0;
+  for (; (popped < count) && (heap->count > 0); ++popped) {
+    std::pop_heap(heap->items, heap->items + heap->count, &item_greater);
+    items[popped] = heap->items[--heap->count];
+  }
+  bl_mutex_unlock(&heap->mutex);
+  return popped;
+}
+
+//------------------------------------------------------------------------------
+static void run_thread_proc(void* param) {
+  RunParam* p = (RunParam*)param;
+  BLQueuePriorityItem items[64];
+
+  // alternate pushing and popping a batch, like workers that each produce and
+  // consume prioritized work
+  for (int op = 0; op < p->op_count; op += (int)p->batch_size) {
+    for (size_t index = 0; index < p->batch_size; ++index) {
+      items[index].priority = next_priority(&p->seed);
+      items[index].data = NULL;
+    }
+    if (p->heap) {
+      mutex_heap_push(p->heap, items, p->batch_size);
+      mutex_heap_pop(p->heap, items, p->batch_size);
+    }
+    else {
+      bl_queue_priority_push_batch(p->queue, items, p->batch_size, &p->seed);
+      bl_queue_priority_pop_batch(p->queue, items, p->batch_size, &p->seed);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+static void run(const char* name, MutexHeap* heap, BLQueuePriority* queue, int thread_count, size_t batch_size, int op_count) {
+  // prefill
+  uint32_t seed = 1;
+  for (int index = 0; index < PREFILL_COUNT; ++index) {
+    BLQueuePriorityItem item;
+    item.priority = next_priority(&seed);
+    item.data = NULL;
+    if (heap) {
+      mutex_heap_push(heap, &item, 1);
+    }
+    else {
+      bl_queue_priority_push_batch(queue, &item, 1, &seed);
+    }
+  }
+
+  RunParam params[64];
+  uint64_t start = bl_time_ns();
+  for (int index = 0; index < thread_count; ++index) {
+    params[index].heap = heap;
+    params[index].queue = queue;
+    params[index].batch_size = batch_size;
+    params[index].op_count = op_count;
+    params[index].seed = index + 1;
+    bl_thread_create(&params[index].thread, &run_thread_proc, params + index);
+  }
+  for (int index = 0; index < thread_count; ++index) {
+    bl_thread_join(&params[index].thread);
+  }
+  uint64_t elapsed = bl_time_ns() - start;
+
+  // each op is one push and one pop
+  double ops = (double)op_count * thread_count;
+  printf("%-28s threads=%-2d batch=%-2d %8.1f ns/op %8.2f Mops/s\n", name, thread_count, (int)batch_size, (double)elapsed * thread_count / ops, ops * 1000.0 / (double)elapsed);
+
+  // drain
+  BLQueuePriorityItem items[64];
+  if (heap) {
+    while (mutex_heap_pop(heap, items, 64)) {
+    }
+  }
+  else {
+    while (bl_queue_priority_pop_batch(queue, items, 64, &seed)) {
+    }
+  }
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+void bench_queue_priority(const BenchOptions* options) {
+  static const int thread_counts[] = { 1, 2, 4, 8 };
+  static const size_t batch_sizes[] = { 1, 8 };
+
+  int op_count = options->quick ? OPS_PER_THREAD / 100 : OPS_PER_THREAD;
+
+  MutexHeap heap;
+  bl_mutex_create(&heap.mutex);
+  heap.items = (BLQueuePriorityItem*)bl_alloc(sizeof(BLQueuePriorityItem) * QUEUE_CAPACITY, 64);
+  heap.count = 0;
+
+  for (size_t batch = 0; batch < sizeof(batch_sizes) / sizeof(batch_sizes[0]); ++batch) {
+    for (size_t threads = 0; threads < sizeof(thread_counts) / sizeof(thread_counts[0]); ++threads) {
+      int thread_count = thread_counts[threads];
+      size_t batch_size = batch_sizes[batch];
+      run("queue_priority mutex heap", &heap, NULL, thread_count, batch_size, op_count);
+
+      // four heaps per thread
+      size_t heap_count = 4 * thread_count;
+      size_t heap_capacity = QUEUE_CAPACITY / heap_count;
+      void* buf = bl_alloc(bl_queue_priority_buffer_size(heap_count, heap_capacity), 64);
+      BLQueuePriority queue;
+      bl_queue_priority_init(&queue, buf, heap_count, heap_capacity);
+      run("queue_priority multi-queue", NULL, &queue, thread_count, batch_size, op_count);
+      bl_free(buf);
+    }
+  }
+
+  bl_free(heap.items);
+  bl_mutex_destroy(&heap.mutex);
+}
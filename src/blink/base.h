@@ -38,6 +38,7 @@ enum BL_ARCH_T {
   BL_ARCH_TYPE_X64,
 };
 enum BL_PLATFORM_T {
+  BL_PLATFORM_TYPE_LINUX,
   BL_PLATFORM_TYPE_OSX,
   BL_PLATFORM_TYPE_WINDOWS,
 };
@@ -75,6 +76,10 @@ enum BL_PLATFORM_T {
 # define BL_PLATFORM_OSX
 # define BL_PLATFORM BL_PLATFORM_TYPE_OSX
 
+#elif defined(__linux__)
+# define BL_PLATFORM_LINUX
+# define BL_PLATFORM BL_PLATFORM_TYPE_LINUX
+
 #else
 # error unsupported platform
 
@@ -114,6 +119,15 @@ void* bl_alloc(size_t size, size_t alignment);
 void bl_free(void* ptr);
 
 
+//
+// time
+//
+
+// Returns a monotonic timestamp in nanoseconds. Only the difference between two
+// timestamps means anything.
+uint64_t bl_time_ns();
+
+
 //
 // string manipulation
 //
@@ -144,6 +158,12 @@ void bl_endian_swap(uint16_t* __restrict values, size_t count);
 void bl_endian_swap(uint32_t* __restrict values, size_t count);
 void bl_endian_swap(uint64_t* __restrict values, size_t count);
 void bl_endian_swap(float* __restrict values, size_t count);
+#if defined(BL_PLATFORM_LINUX) && (BL_POINTER_SIZE == 8)
+// uint64_t is unsigned long here, so 64-bit literals need their own overloads
+unsigned long long bl_endian_swap(unsigned long long value);
+void bl_endian_swap(unsigned long long* __restrict value);
+void bl_endian_swap(unsigned long long* __restrict values, size_t count);
+#endif
 
 #ifdef BL_BIG_ENDIAN
 # define BL_FROM_BIG_ENDIAN(value)        (value)
@@ -222,7 +242,7 @@ void bl_debug_msg_raw(const char* format, ...);
 #else
 # if defined(BL_PLATFORM_WINDOWS)
 # define BL_DEBUG_BREAK()     __debug_break()
-# elif defined(BL_PLATFORM_OSX)
+# elif defined(BL_PLATFORM_OSX) || defined(BL_PLATFORM_LINUX)
 #   if defined(__ppc__) || defined(__ppc64__)
 #     define BL_DEBUG_BREAK() asm { trap }
 #   elif defined(__i386) || defined(__x86_64__)
@@ -356,6 +376,8 @@ typedef void (*BLThreadEntryFunc)(void* param);
 struct BLThread {
 #ifdef BL_PLATFORM_OSX
   char pad[24];
+#elif defined(BL_PLATFORM_LINUX)
+  char pad[24];
 #else
 # error unsupported platform
 #endif
@@ -363,6 +385,8 @@ struct BLThread {
 struct BLMutex {
 #ifdef BL_PLATFORM_OSX
   char pad[64];
+#elif defined(BL_PLATFORM_LINUX)
+  char pad[40];
 #else
 # error unsupported platform
 #endif
@@ -370,6 +394,8 @@ struct BLMutex {
 struct BLCond {
 #ifdef BL_PLATFORM_OSX
   char pad[48];
+#elif defined(BL_PLATFORM_LINUX)
+  char pad[48];
 #else
 # error unsupported platform
 #endif
@@ -377,6 +403,8 @@ struct BLCond {
 struct BLSemaphore {
 #ifdef BL_PLATFORM_OSX
   char pad[4];
+#elif defined(BL_PLATFORM_LINUX)
+  char pad[32];
 #else
 # error unsupported platform
 #endif
@@ -384,6 +412,17 @@ struct BLSemaphore {
 struct BLThreadSpecificPtr {
 #ifdef BL_PLATFORM_OSX
   char pad[8];
+#elif defined(BL_PLATFORM_LINUX)
+  char pad[4];
+#else
+# error unsupported platform
+#endif
+};
+struct BLEventCount {
+#ifdef BL_PLATFORM_OSX
+  char pad[120];
+#elif defined(BL_PLATFORM_LINUX)
+  int32_t pad[1];   // futex word, which must be 4 byte aligned
 #else
 # error unsupported platform
 #endif
@@ -393,6 +432,15 @@ void bl_thread_create(BLThread* __restrict thread, BLThreadEntryFunc func, void*
 void bl_thread_join(BLThread* __restrict thread);
 void bl_thread_set_name(const char* __restrict name);
 
+// Asks the scheduler to keep the calling thread on the given logical cpu. On OS
+// X this is only a hint: threads given the same cpu share an affinity tag and
+// tend to run on cores that share a cache, while different tags are spread
+// apart.
+void bl_thread_set_affinity(uint32_t cpu);
+
+// Gives up the rest of the calling thread's time slice.
+void bl_thread_yield();
+
 void bl_mutex_create(BLMutex* __restrict mutex);
 void bl_mutex_destroy(BLMutex* __restrict mutex);
 void bl_mutex_lock(BLMutex* __restrict mutex);
@@ -415,6 +463,22 @@ void bl_thread_specific_ptr_destroy(BLThreadSpecificPtr* __restrict tsp);
 void bl_thread_specific_ptr_set(BLThreadSpecificPtr* __restrict tsp, void* value);
 void* bl_thread_specific_ptr_get(BLThreadSpecificPtr* __restrict tsp);
 
+// An event count lets a thread sleep until a condition that is published
+// without a lock (e.g. a lock-free queue becoming non-empty) might be true. A
+// waiter calls bl_event_count_prepare_wait(), re-checks its condition and then
+// either calls bl_event_count_cancel_wait() or bl_event_count_wait() with the
+// returned key. A notifier publishes its change and then calls
+// bl_event_count_notify_all(), which is just a barrier and a load when nobody
+// is waiting. bl_event_count_wait_timeout() also gives up after timeout_ms;
+// the caller re-checks its condition either way.
+void bl_event_count_create(BLEventCount* __restrict ec);
+void bl_event_count_destroy(BLEventCount* __restrict ec);
+int32_t bl_event_count_prepare_wait(BLEventCount* __restrict ec);
+void bl_event_count_cancel_wait(BLEventCount* __restrict ec);
+void bl_event_count_wait(BLEventCount* __restrict ec, int32_t key);
+void bl_event_count_wait_timeout(BLEventCount* __restrict ec, int32_t key, uint64_t timeout_ms);
+void bl_event_count_notify_all(BLEventCount* __restrict ec);
+
 
 //
 // atomic ops
@@ -430,6 +494,11 @@ bool bl_atomic_cas(volatile int32_t* val, int32_t old_value, int32_t new_value);
 bool bl_atomic_cas(volatile int64_t* val, int64_t old_value, int64_t new_value);
 bool bl_atomic_cas(void* volatile* val, void* old_value, void* new_value);
 
+// Stores new_value in *val. Returns the previous value of *val.
+int32_t bl_atomic_swap(volatile int32_t* val, int32_t new_value);
+int64_t bl_atomic_swap(volatile int64_t* val, int64_t new_value);
+void* bl_atomic_swap(void* volatile* val, void* new_value);
+
 // Increments *val. Returns the result of the operation.
 int32_t bl_atomic_increment(volatile int32_t* val);
 int64_t bl_atomic_increment(volatile int64_t* val);
@@ -553,6 +622,26 @@ inline void bl_endian_swap(float* __restrict values, size_t count) {
   }
 }
 
+#if defined(BL_PLATFORM_LINUX) && (BL_POINTER_SIZE == 8)
+//------------------------------------------------------------------------------
+inline unsigned long long bl_endian_swap(unsigned long long value) {
+  return bl_endian_swap((uint64_t)value);
+}
+
+//------------------------------------------------------------------------------
+inline void bl_endian_swap(unsigned long long* __restrict value) {
+  *value = bl_endian_swap(*value);
+}
+
+//------------------------------------------------------------------------------
+inline void bl_endian_swap(unsigned long long* __restrict values, size_t count) {
+  unsigned long long* __restrict end = values + count;
+  for (; values != end; ++values) {
+    bl_endian_swap(values);
+  }
+}
+#endif
+
 
 //
 // atomic ops implementation
@@ -581,6 +670,36 @@ inline bool bl_atomic_cas(void* volatile* val, void* old_value, void* new_value)
   return OSAtomicCompareAndSwapPtr(old_value, new_value, val);
 }
 
+//------------------------------------------------------------------------------
+inline int32_t bl_atomic_swap(volatile int32_t* val, int32_t new_value) {
+  for (;;) {
+    int32_t old_value = *val;
+    if (OSAtomicCompareAndSwap32(old_value, new_value, val)) {
+      return old_value;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+inline int64_t bl_atomic_swap(volatile int64_t* val, int64_t new_value) {
+  for (;;) {
+    int64_t old_value = *val;
+    if (OSAtomicCompareAndSwap64(old_value, new_value, val)) {
+      return old_value;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+inline void* bl_atomic_swap(void* volatile* val, void* new_value) {
+  for (;;) {
+    void* old_value = *val;
+    if (OSAtomicCompareAndSwapPtr(old_value, new_value, val)) {
+      return old_value;
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 inline int32_t bl_atomic_increment(volatile int32_t* val) {
   return OSAtomicIncrement32(val);
@@ -669,6 +788,118 @@ inline uint64_t bl_atomic_xor(volatile uint64_t* val, uint64_t mask) {
   }
 }
 
+#elif defined(BL_PLATFORM_LINUX)
+
+//------------------------------------------------------------------------------
+inline void bl_atomic_barrier() {
+  __sync_synchronize();
+}
+
+//------------------------------------------------------------------------------
+inline bool bl_atomic_cas(volatile int32_t* val, int32_t old_value, int32_t new_value) {
+  return __sync_bool_compare_and_swap(val, old_value, new_value);
+}
+
+//------------------------------------------------------------------------------
+inline bool bl_atomic_cas(volatile int64_t* val, int64_t old_value, int64_t new_value) {
+  return __sync_bool_compare_and_swap(val, old_value, new_value);
+}
+
+//------------------------------------------------------------------------------
+inline bool bl_atomic_cas(void* volatile* val, void* old_value, void* new_value) {
+  return __sync_bool_compare_and_swap(val, old_value, new_value);
+}
+
+//------------------------------------------------------------------------------
+inline int32_t bl_atomic_swap(volatile int32_t* val, int32_t new_value) {
+  // __sync_lock_test_and_set is only an acquire barrier, so add the release
+  // half to match the other platforms
+  __sync_synchronize();
+  return __sync_lock_test_and_set(val, new_value);
+}
+
+//------------------------------------------------------------------------------
+inline int64_t bl_atomic_swap(volatile int64_t* val, int64_t new_value) {
+  __sync_synchronize();
+  return __sync_lock_test_and_set(val, new_value);
+}
+
+//------------------------------------------------------------------------------
+inline void* bl_atomic_swap(void* volatile* val, void* new_value) {
+  __sync_synchronize();
+  return __sync_lock_test_and_set(val, new_value);
+}
+
+//------------------------------------------------------------------------------
+inline int32_t bl_atomic_increment(volatile int32_t* val) {
+  return __sync_add_and_fetch(val, 1);
+}
+
+//------------------------------------------------------------------------------
+inline int64_t bl_atomic_increment(volatile int64_t* val) {
+  return __sync_add_and_fetch(val, 1);
+}
+
+//------------------------------------------------------------------------------
+inline int32_t bl_atomic_decrement(volatile int32_t* val) {
+  return __sync_sub_and_fetch(val, 1);
+}
+
+//------------------------------------------------------------------------------
+inline int64_t bl_atomic_decrement(volatile int64_t* val) {
+  return __sync_sub_and_fetch(val, 1);
+}
+
+//------------------------------------------------------------------------------
+inline int32_t bl_atomic_add(volatile int32_t* val, int32_t amount) {
+  return __sync_add_and_fetch(val, amount);
+}
+
+//------------------------------------------------------------------------------
+inline int64_t bl_atomic_add(volatile int64_t* val, int64_t amount) {
+  return __sync_add_and_fetch(val, amount);
+}
+
+//------------------------------------------------------------------------------
+inline int32_t bl_atomic_sub(volatile int32_t* val, int32_t amount) {
+  return __sync_sub_and_fetch(val, amount);
+}
+
+//------------------------------------------------------------------------------
+inline int64_t bl_atomic_sub(volatile int64_t* val, int64_t amount) {
+  return __sync_sub_and_fetch(val, amount);
+}
+
+//------------------------------------------------------------------------------
+inline uint32_t bl_atomic_and(volatile uint32_t* val, uint32_t mask) {
+  return __sync_and_and_fetch(val, mask);
+}
+
+//------------------------------------------------------------------------------
+inline uint64_t bl_atomic_and(volatile uint64_t* val, uint64_t mask) {
+  return __sync_and_and_fetch(val, mask);
+}
+
+//------------------------------------------------------------------------------
+inline uint32_t bl_atomic_or(volatile uint32_t* val, uint32_t mask) {
+  return __sync_or_and_fetch(val, mask);
+}
+
+//------------------------------------------------------------------------------
+inline uint64_t bl_atomic_or(volatile uint64_t* val, uint64_t mask) {
+  return __sync_or_and_fetch(val, mask);
+}
+
+//------------------------------------------------------------------------------
+inline uint32_t bl_atomic_xor(volatile uint32_t* val, uint32_t mask) {
+  return __sync_xor_and_fetch(val, mask);
+}
+
+//------------------------------------------------------------------------------
+inline uint64_t bl_atomic_xor(volatile uint64_t* val, uint64_t mask) {
+  return __sync_xor_and_fetch(val, mask);
+}
+
 #elif defined(BL_PLATFORM_WINDOWS)
 
 //------------------------------------------------------------------------------
@@ -694,6 +925,21 @@ inline bool atomic_cas(void* volatile* val, void* old_value, void* new_value) {
   return (orig == old_value);
 }
 
+//------------------------------------------------------------------------------
+inline int32_t atomic_swap(volatile int32_t* val, int32_t new_value) {
+  return InterlockedExchange(val, new_value);
+}
+
+//------------------------------------------------------------------------------
+inline int64_t atomic_swap(volatile int64_t* val, int64_t new_value) {
+  return InterlockedExchange64(val, new_value);
+}
+
+//------------------------------------------------------------------------------
+inline void* atomic_swap(void* volatile* val, void* new_value) {
+  return InterlockedExchangePointer(val, new_value);
+}
+
 //------------------------------------------------------------------------------
 inline int32_t atomic_increment(volatile int32_t* val) {
   return InterlockedIncrement(val);
@@ -25,8 +25,11 @@
 
 #include "../base.h"
 #include "base_int.h"
+#include <signal.h>
 #include <stdio.h>
-#include <sys/sysctl.h>
+#ifdef BL_PLATFORM_OSX
+# include <sys/sysctl.h>
+#endif
 
 //
 // local vars
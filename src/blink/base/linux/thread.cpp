@@ -0,0 +1,450 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "../../base.h"
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+//
+// local types
+//
+
+struct Thread {
+  BLThreadEntryFunc entry_func;
+  void*             param;
+  pthread_t         handle;
+};
+
+// the low bit of state is set while there are waiters; the rest is a counter
+// that is bumped by every notify that finds waiters. waiters sleep on the state
+// word itself with a futex.
+struct EventCount {
+  volatile int32_t  state;
+};
+
+// verify struct sizes match
+BL_STATIC_ASSERT(sizeof(BLThread) == sizeof(Thread));
+BL_STATIC_ASSERT(sizeof(BLMutex) == sizeof(pthread_mutex_t));
+BL_STATIC_ASSERT(sizeof(BLCond) == sizeof(pthread_cond_t));
+BL_STATIC_ASSERT(sizeof(BLSemaphore) == sizeof(sem_t));
+BL_STATIC_ASSERT(sizeof(BLThreadSpecificPtr) == sizeof(pthread_key_t));
+BL_STATIC_ASSERT(sizeof(BLEventCount) == sizeof(EventCount));
+
+
+//
+// local functions
+//
+
+//------------------------------------------------------------------------------
+static int futex(volatile int32_t* addr, int op, int32_t value, const timespec* timeout = NULL) {
+  return (int)syscall(SYS_futex, addr, op, value, timeout, NULL, 0);
+}
+
+//------------------------------------------------------------------------------
+static void* thread_trampoline(void* param) {
+  Thread* thread = (Thread*)param;
+  thread->entry_func(thread->param);
+  return NULL;
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+void bl_thread_create(BLThread* __restrict thread, BLThreadEntryFunc func, void* param) {
+  BL_ASSERT(thread);
+  BL_ASSERT(func);
+  Thread* __restrict impl = (Thread*)thread;
+
+  // setup the thread
+  impl->entry_func  = func;
+  impl->param       = param;
+
+  // setup the pthread attributes
+  int ret;
+  pthread_attr_t attr;
+  ret = pthread_attr_init(&attr);
+  BL_ASSERT(ret == 0);
+
+  // create the thread
+  ret = pthread_create(&impl->handle, &attr, &thread_trampoline, impl);
+  BL_ASSERT(ret == 0);
+
+  // destroy the pthread attributes
+  ret = pthread_attr_destroy(&attr);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_thread_join(BLThread* __restrict thread) {
+  BL_ASSERT(thread);
+  Thread* __restrict impl = (Thread*)thread;
+
+  // wait for the thread to terminate
+  int ret;
+  ret = pthread_join(impl->handle, NULL);
+  BL_ASSERT(ret == 0);
+
+  // cleanup the thread
+  impl->entry_func  = NULL;
+  impl->param       = NULL;
+  impl->handle      = 0;
+}
+
+//------------------------------------------------------------------------------
+void bl_thread_set_name(const char* __restrict name) {
+  BL_ASSERT(name);
+
+  // linux limits thread names to 15 characters
+  char short_name[16];
+  bl_strcpy(short_name, name, sizeof(short_name));
+
+  int ret;
+  ret = pthread_setname_np(pthread_self(), short_name);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_thread_set_affinity(uint32_t cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+
+  int ret;
+  ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_thread_yield() {
+  sched_yield();
+}
+
+//------------------------------------------------------------------------------
+void bl_mutex_create(BLMutex* __restrict mutex) {
+  BL_ASSERT(mutex);
+  pthread_mutex_t* __restrict handle = (pthread_mutex_t*)mutex;
+
+  // setup the mutex attributes
+  int ret;
+  pthread_mutexattr_t attr;
+  ret = pthread_mutexattr_init(&attr);
+  BL_ASSERT(ret == 0);
+
+  // create the mutex
+  ret = pthread_mutex_init(handle, &attr);
+  BL_ASSERT(ret == 0);
+
+  // destroy the mutex attributes
+  ret = pthread_mutexattr_destroy(&attr);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_mutex_destroy(BLMutex* __restrict mutex) {
+  BL_ASSERT(mutex);
+  pthread_mutex_t* __restrict handle = (pthread_mutex_t*)mutex;
+
+  int ret;
+  ret = pthread_mutex_destroy(handle);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_mutex_lock(BLMutex* __restrict mutex) {
+  BL_ASSERT(mutex);
+  pthread_mutex_t* __restrict handle = (pthread_mutex_t*)mutex;
+
+  int ret;
+  ret = pthread_mutex_lock(handle);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_mutex_unlock(BLMutex* __restrict mutex) {
+  BL_ASSERT(mutex);
+  pthread_mutex_t* __restrict handle = (pthread_mutex_t*)mutex;
+
+  int ret;
+  ret = pthread_mutex_unlock(handle);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_cond_create(BLCond* __restrict cond) {
+  BL_ASSERT(cond);
+  pthread_cond_t* __restrict handle = (pthread_cond_t*)cond;
+
+  // setup the condition variable attributes
+  int ret;
+  pthread_condattr_t attr;
+  ret = pthread_condattr_init(&attr);
+  BL_ASSERT(ret == 0);
+
+  // create the condition variable
+  ret = pthread_cond_init(handle, &attr);
+  BL_ASSERT(ret == 0);
+
+  // destroy the condition variable attributes
+  ret = pthread_condattr_destroy(&attr);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_cond_destroy(BLCond* __restrict cond) {
+  BL_ASSERT(cond);
+  pthread_cond_t* __restrict handle = (pthread_cond_t*)cond;
+
+  int ret;
+  ret = pthread_cond_destroy(handle);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_cond_notify_one(BLCond* __restrict cond) {
+  BL_ASSERT(cond);
+  pthread_cond_t* __restrict handle = (pthread_cond_t*)cond;
+
+  int ret;
+  ret = pthread_cond_signal(handle);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_cond_notify_all(BLCond* __restrict cond) {
+  BL_ASSERT(cond);
+  pthread_cond_t* __restrict handle = (pthread_cond_t*)cond;
+
+  int ret;
+  ret = pthread_cond_broadcast(handle);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_cond_wait(BLCond* __restrict cond, BLMutex* __restrict mutex) {
+  BL_ASSERT(cond);
+  BL_ASSERT(mutex);
+  pthread_cond_t* __restrict cond_handle = (pthread_cond_t*)cond;
+  pthread_mutex_t* __restrict mutex_handle = (pthread_mutex_t*)mutex;
+
+  int ret;
+  ret = pthread_cond_wait(cond_handle, mutex_handle);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_cond_wait_timeout(BLCond* __restrict cond, BLMutex* __restrict mutex, uint64_t timeout_ms) {
+  BL_ASSERT(cond);
+  BL_ASSERT(mutex);
+  pthread_cond_t* __restrict cond_handle = (pthread_cond_t*)cond;
+  pthread_mutex_t* __restrict mutex_handle = (pthread_mutex_t*)mutex;
+
+  int ret;
+
+  // pthread wants an absolute time
+  timespec wait_time;
+  ret = clock_gettime(CLOCK_REALTIME, &wait_time);
+  BL_ASSERT(ret == 0);
+  uint64_t ns = (uint64_t)wait_time.tv_nsec + ((timeout_ms % 1000ULL) * 1000000ULL);
+  wait_time.tv_sec  += (time_t)((timeout_ms / 1000ULL) + (ns / 1000000000ULL));
+  wait_time.tv_nsec = (long)(ns % 1000000000ULL);
+
+  ret = pthread_cond_timedwait(cond_handle, mutex_handle, &wait_time);
+  BL_ASSERT(ret == 0 || ret == ETIMEDOUT);
+}
+
+//------------------------------------------------------------------------------
+void bl_semaphore_create(BLSemaphore* __restrict semaphore, int initial_value) {
+  BL_ASSERT(semaphore);
+  sem_t* __restrict handle = (sem_t*)semaphore;
+
+  int ret;
+  ret = sem_init(handle, 0, initial_value);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_semaphore_destroy(BLSemaphore* __restrict semaphore) {
+  BL_ASSERT(semaphore);
+  sem_t* __restrict handle = (sem_t*)semaphore;
+
+  int ret;
+  ret = sem_destroy(handle);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_semaphore_post(BLSemaphore* __restrict semaphore) {
+  BL_ASSERT(semaphore);
+  sem_t* __restrict handle = (sem_t*)semaphore;
+
+  int ret;
+  ret = sem_post(handle);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_semaphore_wait(BLSemaphore* __restrict semaphore) {
+  BL_ASSERT(semaphore);
+  sem_t* __restrict handle = (sem_t*)semaphore;
+
+  // retry if a signal interrupts the wait
+  int ret;
+  do {
+    ret = sem_wait(handle);
+  } while ((ret == -1) && (errno == EINTR));
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_thread_specific_ptr_create(BLThreadSpecificPtr* __restrict tsp) {
+  BL_ASSERT(tsp);
+  pthread_key_t* __restrict handle = (pthread_key_t*)tsp;
+
+  int ret;
+  ret = pthread_key_create(handle, NULL);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_thread_specific_ptr_destroy(BLThreadSpecificPtr* __restrict tsp) {
+  BL_ASSERT(tsp);
+  pthread_key_t* __restrict handle = (pthread_key_t*)tsp;
+
+  int ret;
+  ret = pthread_key_delete(*handle);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_thread_specific_ptr_set(BLThreadSpecificPtr* __restrict tsp, void* value) {
+  BL_ASSERT(tsp);
+  pthread_key_t* __restrict handle = (pthread_key_t*)tsp;
+
+  int ret;
+  ret = pthread_setspecific(*handle, value);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void* bl_thread_specific_ptr_get(BLThreadSpecificPtr* __restrict tsp) {
+  BL_ASSERT(tsp);
+  pthread_key_t* __restrict handle = (pthread_key_t*)tsp;
+
+  return pthread_getspecific(*handle);
+}
+
+//------------------------------------------------------------------------------
+void bl_event_count_create(BLEventCount* __restrict ec) {
+  BL_ASSERT(ec);
+  EventCount* __restrict impl = (EventCount*)ec;
+  impl->state = 0;
+}
+
+//------------------------------------------------------------------------------
+void bl_event_count_destroy(BLEventCount* __restrict ec) {
+  BL_ASSERT(ec);
+}
+
+//------------------------------------------------------------------------------
+int32_t bl_event_count_prepare_wait(BLEventCount* __restrict ec) {
+  BL_ASSERT(ec);
+  EventCount* __restrict impl = (EventCount*)ec;
+
+  // flag that there is a waiter. the cas is a full barrier so the caller's
+  // re-check of its condition can't be reordered before the flag is visible.
+  for (;;) {
+    int32_t state = impl->state;
+    if (bl_atomic_cas(&impl->state, state, state | 1)) {
+      return state | 1;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void bl_event_count_cancel_wait(BLEventCount* __restrict ec) {
+  BL_ASSERT(ec);
+
+  // nothing to do; the waiter flag is left set and the next notify clears it
+  // at the cost of one unneeded wake.
+}
+
+//------------------------------------------------------------------------------
+void bl_event_count_wait(BLEventCount* __restrict ec, int32_t key) {
+  BL_ASSERT(ec);
+  EventCount* __restrict impl = (EventCount*)ec;
+
+  // the kernel only puts us to sleep if the state still matches the key, so a
+  // notify that lands before the call can't be missed
+  while (impl->state == key) {
+    futex(&impl->state, FUTEX_WAIT_PRIVATE, key);
+  }
+}
+
+//------------------------------------------------------------------------------
+void bl_event_count_wait_timeout(BLEventCount* __restrict ec, int32_t key, uint64_t timeout_ms) {
+  BL_ASSERT(ec);
+  EventCount* __restrict impl = (EventCount*)ec;
+
+  // FUTEX_WAIT takes a relative timeout. a single wait is enough since the
+  // caller re-checks its condition anyway.
+  timespec wait_time;
+  wait_time.tv_sec  = (time_t)(timeout_ms / 1000ULL);
+  wait_time.tv_nsec = (long)((timeout_ms % 1000ULL) * 1000000ULL);
+  if (impl->state == key) {
+    futex(&impl->state, FUTEX_WAIT_PRIVATE, key, &wait_time);
+  }
+}
+
+//------------------------------------------------------------------------------
+void bl_event_count_notify_all(BLEventCount* __restrict ec) {
+  BL_ASSERT(ec);
+  EventCount* __restrict impl = (EventCount*)ec;
+
+  // make the caller's change visible before checking for waiters. this is the
+  // entire cost when nobody is waiting.
+  bl_atomic_barrier();
+  if (BL_LIKELY(!(impl->state & 1))) {
+    return;
+  }
+
+  // start a new epoch with no waiters and wake everybody from the last one
+  for (;;) {
+    int32_t state = impl->state;
+    if (bl_atomic_cas(&impl->state, state, (state + 2) & ~1)) {
+      break;
+    }
+  }
+  futex(&impl->state, FUTEX_WAKE_PRIVATE, INT_MAX);
+}
@@ -33,6 +33,9 @@
 #include <mach/semaphore.h>
 #include <mach/task.h>
 #include <mach/mach_init.h>
+#include <mach/thread_act.h>
+#include <mach/thread_policy.h>
+#include <sched.h>
 
 //
 // local types
@@ -44,12 +47,21 @@ struct Thread {
   pthread_t         handle;
 };
 
+// the low bit of state is set while there are waiters; the rest is a counter
+// that is bumped by every notify that finds waiters.
+struct EventCount {
+  volatile int32_t  state;
+  pthread_mutex_t   mutex;
+  pthread_cond_t    cond;
+};
+
 // verify struct sizes match
 BL_STATIC_ASSERT(sizeof(BLThread) == sizeof(Thread));
 BL_STATIC_ASSERT(sizeof(BLMutex) == sizeof(pthread_mutex_t));
 BL_STATIC_ASSERT(sizeof(BLCond) == sizeof(pthread_cond_t));
 BL_STATIC_ASSERT(sizeof(BLSemaphore) == sizeof(semaphore_t));
 BL_STATIC_ASSERT(sizeof(BLThreadSpecificPtr) == sizeof(pthread_key_t));
+BL_STATIC_ASSERT(sizeof(BLEventCount) == sizeof(EventCount));
 
 
 //
@@ -118,6 +130,23 @@ void bl_thread_set_name(const char* __restrict name) {
   BL_ASSERT(ret == 0);
 }
 
+//------------------------------------------------------------------------------
+void bl_thread_set_affinity(uint32_t cpu) {
+  // there is no way to pin a thread to a cpu; the closest thing is an affinity
+  // tag. tag 0 means no affinity, so shift the cpu up by one.
+  thread_affinity_policy_data_t policy;
+  policy.affinity_tag = (integer_t)(cpu + 1);
+
+  kern_return_t ret;
+  ret = thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY, (thread_policy_t)&policy, THREAD_AFFINITY_POLICY_COUNT);
+  BL_ASSERT(ret == KERN_SUCCESS);
+}
+
+//------------------------------------------------------------------------------
+void bl_thread_yield() {
+  sched_yield();
+}
+
 //------------------------------------------------------------------------------
 void bl_mutex_create(BLMutex* __restrict mutex) {
   BL_ASSERT(mutex);
@@ -334,3 +363,123 @@ void* bl_thread_specific_ptr_get(BLThreadSpecificPtr* __restrict tsp) {
 
   return pthread_getspecific(*handle);
 }
+
+//------------------------------------------------------------------------------
+void bl_event_count_create(BLEventCount* __restrict ec) {
+  BL_ASSERT(ec);
+  EventCount* __restrict impl = (EventCount*)ec;
+
+  int ret;
+  impl->state = 0;
+  ret = pthread_mutex_init(&impl->mutex, NULL);
+  BL_ASSERT(ret == 0);
+  ret = pthread_cond_init(&impl->cond, NULL);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_event_count_destroy(BLEventCount* __restrict ec) {
+  BL_ASSERT(ec);
+  EventCount* __restrict impl = (EventCount*)ec;
+
+  int ret;
+  ret = pthread_cond_destroy(&impl->cond);
+  BL_ASSERT(ret == 0);
+  ret = pthread_mutex_destroy(&impl->mutex);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+int32_t bl_event_count_prepare_wait(BLEventCount* __restrict ec) {
+  BL_ASSERT(ec);
+  EventCount* __restrict impl = (EventCount*)ec;
+
+  // flag that there is a waiter. the cas is a full barrier so the caller's
+  // re-check of its condition can't be reordered before the flag is visible.
+  for (;;) {
+    int32_t state = impl->state;
+    if (bl_atomic_cas(&impl->state, state, state | 1)) {
+      return state | 1;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void bl_event_count_cancel_wait(BLEventCount* __restrict ec) {
+  BL_ASSERT(ec);
+
+  // nothing to do; the waiter flag is left set and the next notify clears it
+  // at the cost of one unneeded broadcast.
+}
+
+//------------------------------------------------------------------------------
+void bl_event_count_wait(BLEventCount* __restrict ec, int32_t key) {
+  BL_ASSERT(ec);
+  EventCount* __restrict impl = (EventCount*)ec;
+
+  int ret;
+  ret = pthread_mutex_lock(&impl->mutex);
+  BL_ASSERT(ret == 0);
+  while (impl->state == key) {
+    ret = pthread_cond_wait(&impl->cond, &impl->mutex);
+    BL_ASSERT(ret == 0);
+  }
+  ret = pthread_mutex_unlock(&impl->mutex);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_event_count_wait_timeout(BLEventCount* __restrict ec, int32_t key, uint64_t timeout_ms) {
+  BL_ASSERT(ec);
+  EventCount* __restrict impl = (EventCount*)ec;
+
+  int ret;
+
+  // pthread wants an absolute time
+  timeval now;
+  ret = gettimeofday(&now, NULL);
+  BL_ASSERT(ret == 0);
+  uint64_t ns = ((uint64_t)now.tv_usec * 1000ULL) + ((timeout_ms % 1000ULL) * 1000000ULL);
+  timespec wait_time;
+  wait_time.tv_sec  = now.tv_sec + (time_t)((timeout_ms / 1000ULL) + (ns / 1000000000ULL));
+  wait_time.tv_nsec = (long)(ns % 1000000000ULL);
+
+  ret = pthread_mutex_lock(&impl->mutex);
+  BL_ASSERT(ret == 0);
+  while (impl->state == key) {
+    ret = pthread_cond_timedwait(&impl->cond, &impl->mutex, &wait_time);
+    if (ret != 0) {
+      break;
+    }
+  }
+  ret = pthread_mutex_unlock(&impl->mutex);
+  BL_ASSERT(ret == 0);
+}
+
+//------------------------------------------------------------------------------
+void bl_event_count_notify_all(BLEventCount* __restrict ec) {
+  BL_ASSERT(ec);
+  EventCount* __restrict impl = (EventCount*)ec;
+
+  // make the caller's change visible before checking for waiters. this is the
+  // entire cost when nobody is waiting.
+  bl_atomic_barrier();
+  if (BL_LIKELY(!(impl->state & 1))) {
+    return;
+  }
+
+  // start a new epoch with no waiters and wake everybody from the last one
+  int ret;
+  ret = pthread_mutex_lock(&impl->mutex);
+  BL_ASSERT(ret == 0);
+  for (;;) {
+    int32_t state = impl->state;
+    if (bl_atomic_cas(&impl->state, state, (state + 2) & ~1)) {
+      break;
+    }
+  }
+  ret = pthread_cond_broadcast(&impl->cond);
+  BL_ASSERT(ret == 0);
+  ret = pthread_mutex_unlock(&impl->mutex);
+  BL_ASSERT(ret == 0);
+}
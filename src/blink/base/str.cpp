@@ -44,12 +44,32 @@ int bl_stricmp(const char* __restrict a, const char* __restrict b, size_t size)
 
 //------------------------------------------------------------------------------
 size_t bl_strcpy(char* __restrict dest, const char* __restrict src, size_t size) {
+#ifdef BL_PLATFORM_LINUX
+  // glibc has no strlcpy
+  size_t len = strlen(src);
+  if (size > 0) {
+    size_t copy = len < size - 1 ? len : size - 1;
+    memcpy(dest, src, copy);
+    dest[copy] = '\0';
+  }
+  return len;
+#else
   return strlcpy(dest, src, size);
+#endif
 }
 
 //------------------------------------------------------------------------------
 size_t bl_strcat(char* __restrict dest, const char* __restrict src, size_t size) {
+#ifdef BL_PLATFORM_LINUX
+  // glibc has no strlcat
+  size_t dest_len = strnlen(dest, size);
+  if (dest_len == size) {
+    return size + strlen(src);
+  }
+  return dest_len + bl_strcpy(dest + dest_len, src, size - dest_len);
+#else
   return strlcat(dest, src, size);
+#endif
 }
 
 //------------------------------------------------------------------------------
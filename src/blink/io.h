@@ -42,24 +42,112 @@ enum BLIoStatus {
   BL_IO_STATUS_ERROR_NOT_FOUND,
   BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC,
   BL_IO_STATUS_ERROR_TOO_MANY_OPEN_FILES,
+  BL_IO_STATUS_ERROR_BAD_FORMAT,
+  BL_IO_STATUS_ERROR_DUPLICATE_ENTRY,
+  BL_IO_STATUS_CANCELLED,
 };
 
 // maximum length of a file name supported by this module
 static const unsigned int BL_IO_MAX_FILE_NAME_LENGTH = 512;
 
+// reads kept in flight on the async path when no init params are given
+static const unsigned int BL_IO_DEFAULT_ASYNC_QUEUE_DEPTH = 128;
+
+// most buffers a single vectored read may fill
+static const unsigned int BL_IO_MAX_READ_BUFFERS = 64;
+
+// size and alignment of the blocks kept by the read cache
+static const unsigned int BL_IO_CACHE_BLOCK_SIZE = 16 * 1024;
+
+// alignment of the file offset, size and buffer of an unbuffered read that
+// lets it go straight from the disk to the buffer
+static const unsigned int BL_IO_UNBUFFERED_ALIGNMENT = 4096;
+
+// alignment of the entries in a pack unless the builder is told otherwise
+static const unsigned int BL_IO_PACK_DEFAULT_ALIGNMENT = 4096;
+
+// uncompressed size of the blocks of a compressed file unless the compressor
+// is told otherwise, and the largest it may be told
+static const unsigned int BL_IO_COMPRESS_DEFAULT_BLOCK_SIZE = 64 * 1024;
+static const unsigned int BL_IO_COMPRESS_MAX_BLOCK_SIZE = 4 * 1024 * 1024;
+
+// size of the chunks a stream reads and how many it keeps in flight unless
+// it's told otherwise
+static const unsigned int BL_IO_STREAM_DEFAULT_CHUNK_SIZE = 256 * 1024;
+static const unsigned int BL_IO_STREAM_DEFAULT_CHUNK_COUNT = 4;
+
 
 //
 // types
 //
 
+struct BLIoCompletionQueue;
 struct BLIoFile;
 struct BLIoOp;
+struct BLIoPack;
+struct BLIoStream;
+struct BLJob;
+struct BLJobQueue;
 
 typedef void (*BLIoOpCallback)(BLIoOp* op, void* context);
 
+struct BLIoLibInitParams {
+  unsigned int  thread_count;         // number of io threads to create (clamped to what the platform supports)
+  unsigned int  async_queue_depth;    // reads kept in flight on the platform's async path (io_uring); 0 services reads on the io threads
+  unsigned int  cache_block_count;    // blocks of BL_IO_CACHE_BLOCK_SIZE kept for repeated reads; 0 disables the cache
+  bool          decompress_on_jobs;   // decompress the blocks of compressed files on the job workers (needs bl_job_lib_initialize()) rather than the io threads
+};
+
+// Counts of reads looked up in the read cache since the library started.
+struct BLIoCacheStats {
+  uint64_t        hits;         // reads served entirely from memory
+  uint64_t        misses;       // reads that went to the file
+  uint64_t        evictions;    // blocks dropped to make room for others
+};
+
+// Reads are issued highest priority first and, within a priority, in file and
+// offset order. A read still waiting deadline_ms after it was issued jumps
+// ahead of everything else. Zero means no deadline. An op with a
+// completion_queue is posted to it once complete, after any callback.
+//
+// An op with a job pushes it onto job_queue once complete, so work on the data
+// starts on a job worker without a thread waiting in between. The job's input
+// is set to the op; its output and user_data are left alone. A place in
+// job_queue is reserved when the op is issued, so bl_job_queue_wait waits for
+// the job even if the op hasn't completed yet. The job must stay alive until
+// it has run, and it's the job's to delete the op.
 struct BLIoOpAttr {
-  BLIoOpCallback  callback;
-  void*           context;
+  BLIoOpCallback        callback;
+  void*                 context;
+  uint32_t              priority;
+  uint32_t              deadline_ms;
+  BLIoCompletionQueue*  completion_queue;
+  BLJob*                job;
+  BLJobQueue*           job_queue;
+};
+
+// Hints for how a mapped view will be read. They may be combined and are
+// ignored where the platform doesn't support them.
+enum BLIoMapAdvice {
+  BL_IO_MAP_ADVICE_NORMAL     = 0,
+  BL_IO_MAP_ADVICE_SEQUENTIAL = 1 << 0,   // read front to back so read ahead aggressively
+  BL_IO_MAP_ADVICE_WILLNEED   = 1 << 1,   // start paging in the whole view now
+  BL_IO_MAP_ADVICE_HUGEPAGE   = 1 << 2,   // back the view with huge pages
+};
+
+// A read-only view of part of a file. data points at the first byte asked for;
+// the rest is bookkeeping for bl_io_file_unmap().
+struct BLIoMapping {
+  const void*     data;
+  uint64_t        size;
+  void*           base;         // (internal) page aligned start of the view
+  uint64_t        base_size;    // (internal) size of the view from base
+};
+
+// One destination of a vectored read.
+struct BLIoBuffer {
+  void*           data;
+  uint64_t        size;
 };
 
 struct BLIoOp {
@@ -77,9 +165,20 @@ struct BLIoOp {
 // library management
 //
 
-void bl_io_lib_initialize();
+// Starts the io threads and the async read path. A NULL params uses a single
+// thread and BL_IO_DEFAULT_ASYNC_QUEUE_DEPTH with no read cache, decompressing
+// on the io threads.
+void bl_io_lib_initialize(const BLIoLibInitParams* params = NULL);
 void bl_io_lib_finalize();
 
+// When the read cache is enabled, small reads from files opened for reading
+// are looked up in it. A hit completes, callbacks and all, before
+// bl_io_file_read() returns. A miss reads the whole blocks around the read on
+// an io thread and keeps them. Blocks are kept per open file, so a block read
+// through one handle isn't served to another. This fetches the cache's
+// counters.
+void bl_io_cache_get_stats(BLIoCacheStats* stats);
+
 
 //
 // file ops
@@ -88,25 +187,194 @@ void bl_io_lib_finalize();
 BLIoOp* bl_io_file_open(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file);
 BLIoStatus bl_io_file_open_sync(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file, uint64_t* file_size = NULL);
 
+// Opens the file for reading around the platform's file cache, for streaming
+// data that won't be read again soon without pushing out data that will.
+// Reads whose file offset, size and buffer are all multiples of
+// BL_IO_UNBUFFERED_ALIGNMENT (see bl_alloc) go straight to the buffer. Other
+// reads have their unaligned parts read through a bounce buffer on an io
+// thread. Falls back to an ordinary open where the file system can't read
+// unbuffered. Unbuffered files bypass the read cache.
+BLIoOp* bl_io_file_open_unbuffered(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file);
+BLIoStatus bl_io_file_open_unbuffered_sync(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file, uint64_t* file_size = NULL);
+
+// Opens a file written by bl_io_compress_file(). Offsets, sizes and the
+// reported file size are all of the uncompressed data, and reads fill their
+// buffers with it: an io thread reads the compressed blocks a read spans in
+// one go and each block is decompressed on its own, on the job workers if the
+// lib was started with decompress_on_jobs. Fails with
+// BL_IO_STATUS_ERROR_BAD_FORMAT if the file wasn't written by the compressor.
+// Compressed files bypass the read cache and can't be mapped.
+BLIoOp* bl_io_file_open_compressed(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file);
+BLIoStatus bl_io_file_open_compressed_sync(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file, uint64_t* file_size = NULL);
+
 BLIoOp* bl_io_file_close(BLIoFile* file, const BLIoOpAttr* attr);
 BLIoStatus bl_io_file_close_sync(BLIoFile* file, const BLIoOpAttr* attr);
 
 BLIoOp* bl_io_file_read(BLIoFile* file, const BLIoOpAttr* attr, void* buffer, uint64_t size);
 BLIoStatus bl_io_file_read_sync(BLIoFile* file, const BLIoOpAttr* attr, void* buffer, uint64_t size);
 
+// Reads the bytes at the file offset straight into several buffers, filling
+// each in turn, as a single op. The buffers array must stay valid until the op
+// completes. fulfilled_size is the total read across all of them.
+BLIoOp* bl_io_file_readv(BLIoFile* file, const BLIoOpAttr* attr, const BLIoBuffer* buffers, uint32_t buffer_count);
+BLIoStatus bl_io_file_readv_sync(BLIoFile* file, const BLIoOpAttr* attr, const BLIoBuffer* buffers, uint32_t buffer_count);
+
+// Creates the file, or truncates it if it already exists, and opens it for
+// writing. With a write_buffer_size, writes that are smaller than the buffer
+// and follow on from each other are gathered on the calling thread and handed
+// to the io threads a buffer at a time. Their ops complete, callbacks and all,
+// before bl_io_file_write() returns, and the caller's buffer is free straight
+// away. The first write to fail is reported by the next flush and by the
+// close.
+BLIoOp* bl_io_file_open_write(const char* file_name, const BLIoOpAttr* attr, uint64_t write_buffer_size, BLIoFile** file);
+BLIoStatus bl_io_file_open_write_sync(const char* file_name, const BLIoOpAttr* attr, uint64_t write_buffer_size, BLIoFile** file);
+
+// Writes size bytes at the file offset. Writes to a file are carried out in
+// the order they are issued.
+BLIoOp* bl_io_file_write(BLIoFile* file, const BLIoOpAttr* attr, const void* buffer, uint64_t size);
+BLIoStatus bl_io_file_write_sync(BLIoFile* file, const BLIoOpAttr* attr, const void* buffer, uint64_t size);
+
+// Writes out anything gathered in the write buffer and waits for everything
+// written so far to reach the disk.
+BLIoOp* bl_io_file_flush(BLIoFile* file, const BLIoOpAttr* attr);
+BLIoStatus bl_io_file_flush_sync(BLIoFile* file, const BLIoOpAttr* attr);
+
 void bl_io_file_seek_sync(BLIoFile* file, uint64_t offset);
 uint64_t bl_io_file_tell_sync(const BLIoFile* file);
 
 const char* bl_io_file_get_filename(const BLIoFile* file);
 
+// Maps size bytes of an open file starting at offset into memory read-only. A
+// size of zero maps to the end of the file. Pages are read in on first touch
+// and shared with the page cache, so nothing is copied. The view stays valid
+// after the file is closed until it is unmapped. advice is a combination of
+// BLIoMapAdvice flags.
+BLIoStatus bl_io_file_map(BLIoFile* file, uint64_t offset, uint64_t size, uint32_t advice, BLIoMapping* mapping);
+void bl_io_file_unmap(BLIoMapping* mapping);
+
+
+//
+// compression
+//
+
+// Writes a compressed copy of source_name to dest_name for
+// bl_io_file_open_compressed(). The data is cut into blocks of block_size
+// bytes, each compressed with a built-in LZ77 codec that favours decoding
+// speed over ratio. Blocks that don't shrink are stored as they are.
+BLIoStatus bl_io_compress_file(const char* source_name, const char* dest_name, uint32_t block_size = BL_IO_COMPRESS_DEFAULT_BLOCK_SIZE);
+
+
+//
+// packs
+//
+
+// A pack is a single read-only file holding many entries, each at an aligned
+// offset and found by a table of contents hashed on the entry name with
+// bl_hash_murmur3. Names are hashed exactly as given so pick one spelling for
+// paths (e.g. relative with forward slashes) and use it everywhere.
+
+// Writes a pack holding the contents of each source_names[i] under
+// entry_names[i]. Fails with BL_IO_STATUS_ERROR_DUPLICATE_ENTRY if two names
+// hash alike; rename one of them.
+BLIoStatus bl_io_pack_build(const char* pack_name, const char* const* entry_names, const char* const* source_names, uint32_t entry_count, uint32_t alignment = BL_IO_PACK_DEFAULT_ALIGNMENT);
+
+// Opens a pack and reads its table of contents. Fails with
+// BL_IO_STATUS_ERROR_BAD_FORMAT if the file isn't a pack.
+BLIoStatus bl_io_pack_open_sync(const char* file_name, BLIoPack** pack);
+
+// Closes a pack. Every entry opened from it has to be closed first.
+BLIoStatus bl_io_pack_close_sync(BLIoPack* pack);
+
+// Opens the entry stored under entry_name as a file of its own: offsets start
+// at the entry, reads stop at its end and all of them go to the pack's one
+// descriptor. Finding the entry is a hash probe with no io so the file is
+// ready to read on return. Close it with bl_io_file_close().
+BLIoStatus bl_io_pack_entry_open(BLIoPack* pack, const char* entry_name, BLIoFile** file, uint64_t* size = NULL);
+
+
+//
+// streams
+//
+
+// A stream reads a range of a file front to back in chunks, keeping
+// chunk_count reads in flight ahead of the consumer so the data is usually
+// there by the time it's wanted. The stream moves the file's offset, so the
+// file shouldn't be read any other way while the stream is in use. Chunks of
+// a multiple of BL_IO_UNBUFFERED_ALIGNMENT go straight from the disk on an
+// unbuffered file if offset is aligned too.
+BLIoStream* bl_io_stream_create(BLIoFile* file, uint64_t offset, uint64_t size, uint32_t chunk_size = BL_IO_STREAM_DEFAULT_CHUNK_SIZE, uint32_t chunk_count = BL_IO_STREAM_DEFAULT_CHUNK_COUNT);
+
+// Cancels the reads that haven't started, waits for the rest and frees the
+// stream. The file is left open.
+void bl_io_stream_destroy(BLIoStream* stream);
+
+// Waits for the next chunk and points data at it. The chunk stays valid until
+// the next call, which hands it back to read further ahead. Returns the status
+// of the read that filled the chunk, with size set to how much it got. Once
+// the range is used up it returns BL_IO_STATUS_OK with a size of zero.
+BLIoStatus bl_io_stream_next(BLIoStream* stream, const void** data, uint64_t* size);
+
+
+//
+// completion queues
+//
+
+// A completion queue collects finished ops for a thread to pick up in
+// batches, e.g. once a frame from the main loop or from a job, instead of
+// waiting on each op or handling it in a callback on an io thread. Ops from
+// any number of threads may be posted to a queue but only one thread at a
+// time may drain it. An op posted to a queue mustn't be deleted until it has
+// been drained.
+BLIoCompletionQueue* bl_io_completion_queue_create();
+
+// Destroys a queue. Ops issued with it must all have been drained.
+void bl_io_completion_queue_destroy(BLIoCompletionQueue* queue);
+
+// Takes up to max_count finished ops off the queue, in the order they
+// completed, and returns how many were taken. Never blocks or takes a lock.
+// The caller deletes each op when it's done with it.
+uint32_t bl_io_completion_queue_drain(BLIoCompletionQueue* queue, BLIoOp** ops, uint32_t max_count);
+
+// Blocks until there may be ops to drain. May return spuriously.
+void bl_io_completion_queue_wait(BLIoCompletionQueue* queue);
+
 
 //
 // ops
 //
 
+// Blocks until the op is complete and returns its status. The timeout version
+// returns BL_IO_STATUS_PENDING if it didn't complete in time. The caller is
+// only woken by this op completing, not by others. An op can be waited on by
+// one thread at a time.
 BLIoStatus bl_io_op_wait(BLIoOp* op);
 BLIoStatus bl_io_op_wait_timeout(BLIoOp* op, uint32_t timeout_ms);
 
+// Blocks until at least one of the ops is complete and returns the index of
+// the first complete op. The timeout version returns count if none completed
+// in time. The caller sleeps until the first of its ops completes and isn't
+// woken by any other op.
+uint32_t bl_io_op_wait_any(BLIoOp** ops, uint32_t count);
+uint32_t bl_io_op_wait_any_timeout(BLIoOp** ops, uint32_t count, uint32_t timeout_ms);
+
+// Blocks until all of the ops are complete. Returns BL_IO_STATUS_OK if they
+// all succeeded, otherwise the status of the first op that didn't. The timeout
+// version returns BL_IO_STATUS_PENDING if they didn't all complete in time.
+// The caller sleeps until the last of its ops completes.
+BLIoStatus bl_io_op_wait_all(BLIoOp** ops, uint32_t count);
+BLIoStatus bl_io_op_wait_all_timeout(BLIoOp** ops, uint32_t count, uint32_t timeout_ms);
+
+// Cancels a read that's still waiting to be issued. The op completes right
+// away with BL_IO_STATUS_CANCELLED, running its callback and handing it on as
+// usual, and the call returns true. Returns false if the read has already
+// been issued, is held back behind an open or write on its file, is served
+// from the cache or isn't a read; the op then completes as it would have.
+bool bl_io_op_cancel(BLIoOp* op);
+
+// Changes the priority of a read that's still waiting to be issued. Returns
+// false if it's too late to make a difference.
+bool bl_io_op_set_priority(BLIoOp* op, uint32_t priority);
+
 void bl_io_op_delete(BLIoOp* op);
 
 #endif
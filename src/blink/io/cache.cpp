@@ -0,0 +1,265 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "io_int.h"
+#include <cstring>
+
+//
+// local types
+//
+
+// One block of the cache. Slots holding blocks that hash alike are chained
+// together off the bucket array.
+struct IoCacheSlot {
+  uint64_t          file_id;        // 0 while the slot is empty
+  uint64_t          block;          // offset in the file / BL_IO_CACHE_BLOCK_SIZE
+  uint32_t          size;           // bytes held; short only for the last block of a file
+  uint32_t          referenced;     // read since the clock hand last passed
+  int32_t           next;           // next slot in the same bucket (-1 ends the chain)
+};
+
+// A fixed number of blocks recycled with the CLOCK algorithm: the hand sweeps
+// the slots, sparing blocks that have been read since it last came by and
+// evicting the first that hasn't.
+struct IoCache {
+  BLMutex           mutex;
+  bool              enabled;
+  uint8_t*          data;
+  IoCacheSlot*      slots;
+  int32_t*          buckets;
+  uint32_t          block_count;
+  uint32_t          bucket_mask;
+  uint32_t          hand;
+  BLIoCacheStats    stats;
+};
+
+
+//
+// local vars
+//
+
+static IoCache s_cache;
+
+
+//
+// local functions
+//
+
+//----------------------------------------------------------------------------
+static uint32_t cache_bucket(const IoCache* cache, uint64_t file_id, uint64_t block) {
+  uint64_t hash = (file_id * 0x9e3779b97f4a7c15ULL) ^ (block * 0xc2b2ae3d27d4eb4fULL);
+  return (uint32_t)(hash ^ (hash >> 32)) & cache->bucket_mask;
+}
+
+//----------------------------------------------------------------------------
+static int32_t cache_find(const IoCache* cache, uint64_t file_id, uint64_t block) {
+  int32_t index = cache->buckets[cache_bucket(cache, file_id, block)];
+  while (index != -1) {
+    const IoCacheSlot* slot = cache->slots + index;
+    if ((slot->file_id == file_id) && (slot->block == block)) {
+      return index;
+    }
+    index = slot->next;
+  }
+  return -1;
+}
+
+//----------------------------------------------------------------------------
+static void cache_unlink(IoCache* cache, int32_t index) {
+  IoCacheSlot* slot = cache->slots + index;
+  int32_t* link = cache->buckets + cache_bucket(cache, slot->file_id, slot->block);
+  while (*link != index) {
+    link = &cache->slots[*link].next;
+  }
+  *link = slot->next;
+  slot->file_id = 0;
+}
+
+//----------------------------------------------------------------------------
+// advances the clock hand to a slot that can be reused and empties it
+static int32_t cache_evict(IoCache* cache) {
+  for (;;) {
+    int32_t index = (int32_t)cache->hand;
+    cache->hand = (cache->hand + 1 == cache->block_count) ? 0 : cache->hand + 1;
+
+    IoCacheSlot* slot = cache->slots + index;
+    if (slot->file_id == 0) {
+      return index;
+    }
+    if (slot->referenced) {
+      slot->referenced = 0;
+      continue;
+    }
+    cache_unlink(cache, index);
+    ++cache->stats.evictions;
+    return index;
+  }
+}
+
+
+//
+// shared functions
+//
+
+//----------------------------------------------------------------------------
+void io_cache_initialize(uint32_t block_count) {
+  IoCache* cache = &s_cache;
+  memset(&cache->stats, 0, sizeof(cache->stats));
+  cache->enabled = (block_count > 0);
+  if (!cache->enabled) {
+    return;
+  }
+
+  // twice as many buckets as blocks, rounded up to a power of two
+  uint32_t bucket_count = 1;
+  while (bucket_count < block_count * 2) {
+    bucket_count <<= 1;
+  }
+
+  bl_mutex_create(&cache->mutex);
+  cache->data         = (uint8_t*)bl_alloc((size_t)block_count * BL_IO_CACHE_BLOCK_SIZE, 4096);
+  cache->slots        = (IoCacheSlot*)bl_alloc(sizeof(IoCacheSlot) * block_count, 64);
+  cache->buckets      = (int32_t*)bl_alloc(sizeof(int32_t) * bucket_count, 64);
+  cache->block_count  = block_count;
+  cache->bucket_mask  = bucket_count - 1;
+  cache->hand         = 0;
+  memset(cache->slots, 0, sizeof(IoCacheSlot) * block_count);
+  memset(cache->buckets, 0xff, sizeof(int32_t) * bucket_count);
+}
+
+//----------------------------------------------------------------------------
+void io_cache_finalize() {
+  IoCache* cache = &s_cache;
+  if (!cache->enabled) {
+    return;
+  }
+
+  bl_free(cache->buckets);
+  bl_free(cache->slots);
+  bl_free(cache->data);
+  bl_mutex_destroy(&cache->mutex);
+  cache->enabled = false;
+}
+
+//----------------------------------------------------------------------------
+bool io_cache_enabled() {
+  return s_cache.enabled;
+}
+
+//----------------------------------------------------------------------------
+bool io_cache_read(const BLIoFile* file, void* dest, uint64_t offset, uint64_t size) {
+  IoCache* cache = &s_cache;
+  if (size == 0) {
+    return false;
+  }
+
+  uint64_t end = offset + size;
+  uint64_t first_block = offset / BL_IO_CACHE_BLOCK_SIZE;
+  uint64_t last_block = (end - 1) / BL_IO_CACHE_BLOCK_SIZE;
+
+  bl_mutex_lock(&cache->mutex);
+
+  // every block has to be there, holding as much of itself as is asked for
+  for (uint64_t block = first_block; block <= last_block; ++block) {
+    int32_t index = cache_find(cache, file->id, block);
+    uint64_t held_end = (index == -1) ? 0 : block * BL_IO_CACHE_BLOCK_SIZE + cache->slots[index].size;
+    uint64_t wanted_end = (block == last_block) ? end : (block + 1) * BL_IO_CACHE_BLOCK_SIZE;
+    if (held_end < wanted_end) {
+      ++cache->stats.misses;
+      bl_mutex_unlock(&cache->mutex);
+      return false;
+    }
+  }
+
+  uint8_t* dest_bytes = (uint8_t*)dest;
+  for (uint64_t block = first_block; block <= last_block; ++block) {
+    int32_t index = cache_find(cache, file->id, block);
+    IoCacheSlot* slot = cache->slots + index;
+    uint64_t block_offset = block * BL_IO_CACHE_BLOCK_SIZE;
+    uint64_t copy_begin = (offset > block_offset) ? offset : block_offset;
+    uint64_t copy_end = (end < block_offset + slot->size) ? end : block_offset + slot->size;
+    memcpy(dest_bytes + (copy_begin - offset), cache->data + (uint64_t)index * BL_IO_CACHE_BLOCK_SIZE + (copy_begin - block_offset), (size_t)(copy_end - copy_begin));
+    slot->referenced = 1;
+  }
+  ++cache->stats.hits;
+  bl_mutex_unlock(&cache->mutex);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void io_cache_insert(const BLIoFile* file, uint64_t offset, const void* data, uint64_t size) {
+  IoCache* cache = &s_cache;
+  uint64_t end = offset + size;
+  bool reaches_eof = (end >= file->size);
+
+  // only blocks the data covers from their start
+  uint64_t block = (offset + BL_IO_CACHE_BLOCK_SIZE - 1) / BL_IO_CACHE_BLOCK_SIZE;
+  const uint8_t* src = (const uint8_t*)data;
+
+  bl_mutex_lock(&cache->mutex);
+  for (;; ++block) {
+    uint64_t block_offset = block * BL_IO_CACHE_BLOCK_SIZE;
+    if (block_offset >= end) {
+      break;
+    }
+    uint64_t block_size = end - block_offset;
+    if (block_size > BL_IO_CACHE_BLOCK_SIZE) {
+      block_size = BL_IO_CACHE_BLOCK_SIZE;
+    }
+    if ((block_size < BL_IO_CACHE_BLOCK_SIZE) && !reaches_eof) {
+      break;
+    }
+
+    // another thread may have got here first
+    if (cache_find(cache, file->id, block) != -1) {
+      continue;
+    }
+
+    int32_t index = cache_evict(cache);
+    IoCacheSlot* slot = cache->slots + index;
+    slot->file_id     = file->id;
+    slot->block       = block;
+    slot->size        = (uint32_t)block_size;
+    slot->referenced  = 0;
+    int32_t* bucket = cache->buckets + cache_bucket(cache, file->id, block);
+    slot->next = *bucket;
+    *bucket = index;
+    memcpy(cache->data + (uint64_t)index * BL_IO_CACHE_BLOCK_SIZE, src + (block_offset - offset), (size_t)block_size);
+  }
+  bl_mutex_unlock(&cache->mutex);
+}
+
+//----------------------------------------------------------------------------
+void io_cache_get_stats(BLIoCacheStats* stats) {
+  IoCache* cache = &s_cache;
+  if (!cache->enabled) {
+    *stats = cache->stats;
+    return;
+  }
+
+  bl_mutex_lock(&cache->mutex);
+  *stats = cache->stats;
+  bl_mutex_unlock(&cache->mutex);
+}
@@ -0,0 +1,577 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "io_int.h"
+#include "../job.h"
+#include <cstring>
+
+//
+// constants
+//
+
+// first bytes of every compressed file ("BLZC")
+static const uint32_t IO_COMPRESS_MAGIC = 0x435a4c42;
+static const uint32_t IO_COMPRESS_VERSION = 1;
+
+// the codec's matches are at least this long and at most this far back
+static const uint32_t LZ_MIN_MATCH = 4;
+static const uint32_t LZ_MAX_OFFSET = 65535;
+
+// the last bytes of a block are always stored as literals
+static const uint32_t LZ_LAST_LITERALS = 5;
+
+// the compressor finds matches through a table of 1 << LZ_HASH_BITS positions
+static const uint32_t LZ_HASH_BITS = 14;
+
+
+//
+// local types
+//
+
+// A compressed file starts with this header followed by the block table:
+// block_count + 1 offsets, one for where each block's data starts and one for
+// where the last block's ends. A block is its uncompressed size (block_size
+// for all but the last) if it's stored as it is and smaller if it's
+// compressed. All fields are little endian.
+struct CompressedHeader {
+  uint32_t          magic;
+  uint32_t          version;
+  uint32_t          block_size;
+  uint32_t          block_count;
+  uint64_t          size;           // of the uncompressed data
+};
+
+// One read of a compressed file, shared by the jobs decompressing its blocks.
+// The last job to finish completes the op and frees it all.
+struct DecompressRead {
+  IoOpImpl*         op;
+  uint8_t*          data;           // compressed bytes of the blocks the read spans
+  BLJob*            jobs;
+  uint64_t          readable;       // bytes of the read that lie inside the file
+  volatile int32_t  pending;        // blocks left to decompress
+  volatile int32_t  failed;         // blocks that wouldn't decode
+};
+
+// kept in the user data of each block's job
+struct DecompressBlock {
+  DecompressRead*   read;
+  const uint8_t*    src;
+  uint32_t          src_size;
+  uint32_t          size;           // uncompressed
+  uint64_t          offset;         // of the uncompressed block in the file
+};
+BL_STATIC_ASSERT(sizeof(DecompressBlock) <= sizeof(((BLJob*)0)->user_data));
+
+
+//
+// local vars
+//
+
+// jobs of every read go in this one queue; pushing is safe from any io
+// thread and only bl_io_lib_finalize() waits on it (NULL decompresses on the
+// io threads)
+static BLJobQueue*    s_decompress_queue;
+
+
+//
+// local functions
+//
+
+//----------------------------------------------------------------------------
+static uint32_t lz_read32(const uint8_t* src) {
+  uint32_t value;
+  memcpy(&value, src, sizeof(value));
+  return value;
+}
+
+//----------------------------------------------------------------------------
+static uint32_t lz_hash(uint32_t value) {
+  return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+//----------------------------------------------------------------------------
+// most bytes lz_compress() can write for size bytes of input
+static uint32_t lz_bound(uint32_t size) {
+  return size + size / 255 + 16;
+}
+
+//----------------------------------------------------------------------------
+// writes the part of a sequence length that doesn't fit in its nibble
+static uint8_t* lz_write_length(uint8_t* dest, uint32_t length) {
+  while (length >= 255) {
+    *dest++ = 255;
+    length -= 255;
+  }
+  *dest++ = (uint8_t)length;
+  return dest;
+}
+
+//----------------------------------------------------------------------------
+// writes a run of literals followed by a match. the last sequence of a block
+// has a match_length of zero and no match.
+static uint8_t* lz_write_sequence(uint8_t* dest, const uint8_t* literals, uint32_t literal_count, uint32_t offset, uint32_t match_length) {
+  uint32_t match_code = (match_length > 0) ? match_length - LZ_MIN_MATCH : 0;
+  *dest++ = (uint8_t)(((literal_count < 15) ? literal_count : 15) << 4 | ((match_code < 15) ? match_code : 15));
+  if (literal_count >= 15) {
+    dest = lz_write_length(dest, literal_count - 15);
+  }
+  memcpy(dest, literals, literal_count);
+  dest += literal_count;
+  if (match_length > 0) {
+    dest[0] = (uint8_t)offset;
+    dest[1] = (uint8_t)(offset >> 8);
+    dest += 2;
+    if (match_code >= 15) {
+      dest = lz_write_length(dest, match_code - 15);
+    }
+  }
+  return dest;
+}
+
+//----------------------------------------------------------------------------
+// compresses size bytes from src into dest, which must hold lz_bound(size)
+// bytes, and returns the compressed size. the data is a series of sequences
+// in the LZ4 block layout: a token with the literal count and match length in
+// its nibbles, the literals, then a two byte offset back to the match.
+static uint32_t lz_compress(const uint8_t* src, uint32_t size, uint8_t* dest, uint32_t* table) {
+  memset(table, 0, sizeof(uint32_t) << LZ_HASH_BITS);
+  uint8_t* out = dest;
+  uint32_t anchor = 0;
+  if (size > LZ_MIN_MATCH + LZ_LAST_LITERALS) {
+    uint32_t limit = size - LZ_LAST_LITERALS;
+    uint32_t position = 0;
+    while (position + LZ_MIN_MATCH <= limit) {
+      uint32_t sequence = lz_read32(src + position);
+      uint32_t* slot = table + lz_hash(sequence);
+      uint32_t candidate = *slot;
+      *slot = position;
+      if ((candidate >= position) || (position - candidate > LZ_MAX_OFFSET) || (lz_read32(src + candidate) != sequence)) {
+        ++position;
+        continue;
+      }
+
+      // take the match as far as it goes
+      uint32_t match_length = LZ_MIN_MATCH;
+      while ((position + match_length < limit) && (src[candidate + match_length] == src[position + match_length])) {
+        ++match_length;
+      }
+      out = lz_write_sequence(out, src + anchor, position - anchor, position - candidate, match_length);
+      position += match_length;
+      anchor = position;
+    }
+  }
+  out = lz_write_sequence(out, src + anchor, size - anchor, 0, 0);
+  return (uint32_t)(out - dest);
+}
+
+//----------------------------------------------------------------------------
+// adds the bytes of a sequence length that follow its nibble. returns false if
+// the data ends first or the length can't fit in max_length.
+static bool lz_read_length(const uint8_t** src, const uint8_t* src_end, uint32_t max_length, uint32_t* length) {
+  uint8_t byte;
+  do {
+    if ((*src == src_end) || (*length > max_length)) {
+      return false;
+    }
+    byte = *(*src)++;
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// decompresses src into exactly size bytes at dest. returns false if the data
+// is malformed; nothing is read or written outside the two buffers either way.
+static bool lz_decompress(const uint8_t* src, uint32_t src_size, uint8_t* dest, uint32_t size) {
+  const uint8_t* in = src;
+  const uint8_t* in_end = src + src_size;
+  uint8_t* out = dest;
+  uint8_t* out_end = dest + size;
+  while (in < in_end) {
+    uint32_t token = *in++;
+    uint32_t literal_count = token >> 4;
+    if ((literal_count == 15) && !lz_read_length(&in, in_end, size, &literal_count)) {
+      return false;
+    }
+    if ((literal_count > (uint32_t)(in_end - in)) || (literal_count > (uint32_t)(out_end - out))) {
+      return false;
+    }
+    memcpy(out, in, literal_count);
+    in += literal_count;
+    out += literal_count;
+
+    // the last sequence has no match
+    if (in == in_end) {
+      break;
+    }
+    if (in_end - in < 2) {
+      return false;
+    }
+    uint32_t offset = in[0] | ((uint32_t)in[1] << 8);
+    in += 2;
+    uint32_t match_length = token & 15;
+    if ((match_length == 15) && !lz_read_length(&in, in_end, size, &match_length)) {
+      return false;
+    }
+    match_length += LZ_MIN_MATCH;
+    if ((offset == 0) || (offset > (uint32_t)(out - dest)) || (match_length > (uint32_t)(out_end - out))) {
+      return false;
+    }
+
+    // a match closer than its length repeats the bytes it's copying
+    const uint8_t* match = out - offset;
+    if (offset >= match_length) {
+      memcpy(out, match, match_length);
+    }
+    else {
+      for (uint32_t index = 0; index < match_length; ++index) {
+        out[index] = match[index];
+      }
+    }
+    out += match_length;
+  }
+  return out == out_end;
+}
+
+//----------------------------------------------------------------------------
+// converts a header between the file's little endian layout and the host's.
+// converting twice gives back what was there so it serves both ways.
+static void compressed_header_convert(CompressedHeader* header) {
+  header->magic       = BL_FROM_LITTLE_ENDIAN(header->magic);
+  header->version     = BL_FROM_LITTLE_ENDIAN(header->version);
+  header->block_size  = BL_FROM_LITTLE_ENDIAN(header->block_size);
+  header->block_count = BL_FROM_LITTLE_ENDIAN(header->block_count);
+  header->size        = BL_FROM_LITTLE_ENDIAN(header->size);
+}
+
+//----------------------------------------------------------------------------
+// converts the block table the same way
+static void compressed_offsets_convert(uint64_t* offsets, uint64_t count) {
+  for (uint64_t index = 0; index < count; ++index) {
+    offsets[index] = BL_FROM_LITTLE_ENDIAN(offsets[index]);
+  }
+}
+
+//----------------------------------------------------------------------------
+// copies size bytes that belong at position in the read's destination, which
+// may be spread over several buffers
+static void copy_to_op(IoOpImpl* op, uint64_t position, const uint8_t* src, uint64_t size) {
+  if (!op->buffers) {
+    memcpy((uint8_t*)op->buffer + position, src, (size_t)size);
+    return;
+  }
+  for (uint32_t index = 0; (index < op->buffer_count) && (size > 0); ++index) {
+    uint64_t buffer_size = op->buffers[index].size;
+    if (position >= buffer_size) {
+      position -= buffer_size;
+      continue;
+    }
+    uint64_t copy_size = (size < buffer_size - position) ? size : buffer_size - position;
+    memcpy((uint8_t*)op->buffers[index].data + position, src, (size_t)copy_size);
+    src += copy_size;
+    size -= copy_size;
+    position = 0;
+  }
+}
+
+//----------------------------------------------------------------------------
+static bool decode_block(const DecompressBlock* block, uint8_t* dest) {
+  if (block->src_size == block->size) {
+    memcpy(dest, block->src, block->size);
+    return true;
+  }
+  return lz_decompress(block->src, block->src_size, dest, block->size);
+}
+
+//----------------------------------------------------------------------------
+static void finish_read(DecompressRead* read) {
+  IoOpImpl* op = read->op;
+  BLIoStatus status = BL_IO_STATUS_OK;
+  uint64_t fulfilled_size = read->readable;
+  if (read->failed) {
+    status = BL_IO_STATUS_ERROR_BAD_FORMAT;
+    fulfilled_size = 0;
+  }
+  else if (read->readable < op->requested_size) {
+    status = BL_IO_STATUS_ERROR_EOF;
+  }
+
+  bl_free(read->data);
+  bl_free(read->jobs);
+  bl_free(read);
+  io_read_complete(op, status, fulfilled_size);
+}
+
+//----------------------------------------------------------------------------
+// decompresses one block of a read into place. the worker doesn't touch the
+// job once this returns so the last one is free to release them all.
+static void decompress_block_job(const BLJob* __restrict job) {
+  const DecompressBlock* block = (const DecompressBlock*)job->user_data;
+  DecompressRead* read = block->read;
+  IoOpImpl* op = read->op;
+
+  // the part of the block inside the read
+  uint64_t read_end = op->offset + read->readable;
+  uint64_t block_end = block->offset + block->size;
+  uint64_t start = (block->offset > op->offset) ? block->offset : op->offset;
+  uint64_t end = (block_end < read_end) ? block_end : read_end;
+
+  // a block wholly inside a plain read decodes straight into its buffer
+  bool decoded;
+  if (!op->buffers && (start == block->offset) && (end == block_end)) {
+    decoded = decode_block(block, (uint8_t*)op->buffer + (start - op->offset));
+  }
+  else {
+    uint8_t* scratch = (uint8_t*)bl_alloc(block->size, 16);
+    decoded = decode_block(block, scratch);
+    if (decoded) {
+      copy_to_op(op, start - op->offset, scratch + (start - block->offset), end - start);
+    }
+    bl_free(scratch);
+  }
+  if (!decoded) {
+    bl_atomic_increment(&read->failed);
+  }
+
+  // the last block to finish completes the read
+  if (bl_atomic_decrement(&read->pending) == 0) {
+    finish_read(read);
+  }
+}
+
+
+//
+// shared functions
+//
+
+//----------------------------------------------------------------------------
+void io_compress_initialize(bool use_jobs) {
+  s_decompress_queue = use_jobs ? bl_job_queue_create() : NULL;
+}
+
+//----------------------------------------------------------------------------
+void io_compress_finalize() {
+  if (s_decompress_queue) {
+    bl_job_queue_destroy(s_decompress_queue);
+    s_decompress_queue = NULL;
+  }
+}
+
+//----------------------------------------------------------------------------
+BLIoStatus io_compressed_open(BLIoFile* file, uint64_t* size) {
+  BL_ASSERT(!file->pack);
+  uint64_t file_size = *size;
+
+  // the header has to describe a table that fits in the file
+  CompressedHeader header;
+  uint64_t fulfilled_size = 0;
+  BLIoStatus status = io_platform_read(file, &header, 0, sizeof(header), &fulfilled_size);
+  uint64_t table_size = 0;
+  if (status == BL_IO_STATUS_OK) {
+    compressed_header_convert(&header);
+    bool valid =
+      (header.magic == IO_COMPRESS_MAGIC) &&
+      (header.version == IO_COMPRESS_VERSION) &&
+      (header.block_size > 0) &&
+      (header.block_size <= BL_IO_COMPRESS_MAX_BLOCK_SIZE) &&
+      (header.block_count == header.size / header.block_size + ((header.size % header.block_size) ? 1 : 0));
+    table_size = sizeof(uint64_t) * ((uint64_t)header.block_count + 1);
+    if (!valid || (table_size > file_size - sizeof(header))) {
+      status = BL_IO_STATUS_ERROR_BAD_FORMAT;
+    }
+  }
+  else if (status == BL_IO_STATUS_ERROR_EOF) {
+    status = BL_IO_STATUS_ERROR_BAD_FORMAT;
+  }
+
+  // every block has to lie inside the file and be no bigger than it was
+  uint64_t* block_offsets = NULL;
+  if (status == BL_IO_STATUS_OK) {
+    block_offsets = (uint64_t*)bl_alloc(table_size, 8);
+    status = io_platform_read(file, block_offsets, sizeof(header), table_size, &fulfilled_size);
+    if (status == BL_IO_STATUS_OK) {
+      compressed_offsets_convert(block_offsets, (uint64_t)header.block_count + 1);
+      bool valid = (block_offsets[0] == sizeof(header) + table_size) && (block_offsets[header.block_count] <= file_size);
+      for (uint32_t index = 0; (index < header.block_count) && valid; ++index) {
+        uint64_t block_offset = (uint64_t)index * header.block_size;
+        uint64_t block_size = (header.size - block_offset < header.block_size) ? header.size - block_offset : header.block_size;
+        valid = (block_offsets[index + 1] >= block_offsets[index]) && (block_offsets[index + 1] - block_offsets[index] <= block_size);
+      }
+      if (!valid) {
+        status = BL_IO_STATUS_ERROR_BAD_FORMAT;
+      }
+    }
+  }
+
+  if (status != BL_IO_STATUS_OK) {
+    bl_free(block_offsets);
+    io_platform_close(file);
+    return status;
+  }
+  file->block_size = header.block_size;
+  file->block_count = header.block_count;
+  file->block_offsets = block_offsets;
+  *size = header.size;
+  return BL_IO_STATUS_OK;
+}
+
+//----------------------------------------------------------------------------
+void io_compressed_read(IoOpImpl* op) {
+  BLIoFile* file = op->file;
+  uint64_t readable = 0;
+  if (op->offset < file->size) {
+    readable = (op->requested_size < file->size - op->offset) ? op->requested_size : file->size - op->offset;
+  }
+  if (readable == 0) {
+    io_read_complete(op, (op->requested_size > 0) ? BL_IO_STATUS_ERROR_EOF : BL_IO_STATUS_OK, 0);
+    return;
+  }
+
+  // read the compressed blocks the read spans in one go
+  uint32_t first_block = (uint32_t)(op->offset / file->block_size);
+  uint32_t last_block = (uint32_t)((op->offset + readable - 1) / file->block_size);
+  uint32_t block_count = last_block - first_block + 1;
+  uint64_t span_offset = file->block_offsets[first_block];
+  uint64_t span_size = file->block_offsets[last_block + 1] - span_offset;
+  uint8_t* data = (uint8_t*)bl_alloc(span_size, 16);
+  uint64_t fulfilled_size = 0;
+  BLIoStatus status = io_platform_read(file, data, span_offset, span_size, &fulfilled_size);
+  if (status != BL_IO_STATUS_OK) {
+    // the table said the blocks were there
+    bl_free(data);
+    io_read_complete(op, (status == BL_IO_STATUS_ERROR_EOF) ? BL_IO_STATUS_ERROR_BAD_FORMAT : status, 0);
+    return;
+  }
+
+  DecompressRead* read = (DecompressRead*)bl_alloc(sizeof(DecompressRead), 8);
+  read->op        = op;
+  read->data      = data;
+  read->jobs      = (BLJob*)bl_alloc(sizeof(BLJob) * block_count, 128);
+  read->readable  = readable;
+  read->pending   = (int32_t)block_count;
+  read->failed    = 0;
+
+  // a job per block. once the last is handed over the read may be gone.
+  BLJob* jobs = read->jobs;
+  for (uint32_t index = 0; index < block_count; ++index) {
+    uint32_t block_index = first_block + index;
+    BLJob* job = jobs + index;
+    job->func   = &decompress_block_job;
+    job->input  = NULL;
+    job->output = NULL;
+    DecompressBlock* block = (DecompressBlock*)job->user_data;
+    block->read     = read;
+    block->src      = data + (file->block_offsets[block_index] - span_offset);
+    block->src_size = (uint32_t)(file->block_offsets[block_index + 1] - file->block_offsets[block_index]);
+    block->offset   = (uint64_t)block_index * file->block_size;
+    block->size     = (uint32_t)((file->size - block->offset < file->block_size) ? file->size - block->offset : file->block_size);
+
+    // decompress here if there are no workers or their queue is full
+    if (!s_decompress_queue || (bl_job_queue_push_job(s_decompress_queue, job) != BL_JOB_STATUS_OK)) {
+      decompress_block_job(job);
+    }
+  }
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_compress_file(const char* source_name, const char* dest_name, uint32_t block_size) {
+  BL_ASSERT(source_name);
+  BL_ASSERT(dest_name);
+  BL_ASSERT((block_size > 0) && (block_size <= BL_IO_COMPRESS_MAX_BLOCK_SIZE));
+
+  BLIoFile* source;
+  uint64_t size = 0;
+  BLIoStatus status = bl_io_file_open_sync(source_name, NULL, &source, &size);
+  if (status != BL_IO_STATUS_OK) {
+    return status;
+  }
+  BLIoFile* dest;
+  status = bl_io_file_open_write_sync(dest_name, NULL, 64 * 1024, &dest);
+  if (status != BL_IO_STATUS_OK) {
+    bl_io_file_close_sync(source, NULL);
+    return status;
+  }
+
+  // the header and a table to fill in once the blocks are written
+  CompressedHeader header;
+  header.magic        = IO_COMPRESS_MAGIC;
+  header.version      = IO_COMPRESS_VERSION;
+  header.block_size   = block_size;
+  header.block_count  = (uint32_t)(size / block_size + ((size % block_size) ? 1 : 0));
+  header.size         = size;
+  uint64_t table_size = sizeof(uint64_t) * ((uint64_t)header.block_count + 1);
+  uint64_t* block_offsets = (uint64_t*)bl_alloc(table_size, 8);
+  memset(block_offsets, 0, (size_t)table_size);
+  CompressedHeader file_header = header;
+  compressed_header_convert(&file_header);
+  status = bl_io_file_write_sync(dest, NULL, &file_header, sizeof(file_header));
+  if (status == BL_IO_STATUS_OK) {
+    status = bl_io_file_write_sync(dest, NULL, block_offsets, table_size);
+  }
+
+  // compress each block, keeping it as it is if that doesn't help
+  uint8_t* raw = (uint8_t*)bl_alloc(block_size, 16);
+  uint8_t* packed = (uint8_t*)bl_alloc(lz_bound(block_size), 16);
+  uint32_t* table = (uint32_t*)bl_alloc(sizeof(uint32_t) << LZ_HASH_BITS, 16);
+  for (uint32_t index = 0; (index < header.block_count) && (status == BL_IO_STATUS_OK); ++index) {
+    uint64_t block_offset = (uint64_t)index * block_size;
+    uint32_t raw_size = (uint32_t)((size - block_offset < block_size) ? size - block_offset : block_size);
+    status = bl_io_file_read_sync(source, NULL, raw, raw_size);
+    if (status != BL_IO_STATUS_OK) {
+      break;
+    }
+    block_offsets[index] = bl_io_file_tell_sync(dest);
+    uint32_t packed_size = lz_compress(raw, raw_size, packed, table);
+    if (packed_size < raw_size) {
+      status = bl_io_file_write_sync(dest, NULL, packed, packed_size);
+    }
+    else {
+      status = bl_io_file_write_sync(dest, NULL, raw, raw_size);
+    }
+  }
+  bl_free(table);
+  bl_free(packed);
+  bl_free(raw);
+
+  if (status == BL_IO_STATUS_OK) {
+    block_offsets[header.block_count] = bl_io_file_tell_sync(dest);
+    compressed_offsets_convert(block_offsets, (uint64_t)header.block_count + 1);
+    bl_io_file_seek_sync(dest, sizeof(header));
+    status = bl_io_file_write_sync(dest, NULL, block_offsets, table_size);
+  }
+  if (status == BL_IO_STATUS_OK) {
+    status = bl_io_file_flush_sync(dest, NULL);
+  }
+  bl_free(block_offsets);
+
+  BLIoStatus close_status = bl_io_file_close_sync(dest, NULL);
+  bl_io_file_close_sync(source, NULL);
+  return (status != BL_IO_STATUS_OK) ? status : close_status;
+}
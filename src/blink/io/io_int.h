@@ -0,0 +1,307 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "../io.h"
+#include "../queue.h"
+
+#if defined(BL_PLATFORM_OSX)
+# include <cstdio>
+#endif
+
+//
+// constants
+//
+
+enum IoOpType {
+  IO_OP_TYPE_CLOSE,
+  IO_OP_TYPE_OPEN,
+  IO_OP_TYPE_READ,
+  IO_OP_TYPE_WRITE,
+  IO_OP_TYPE_FLUSH,
+};
+
+
+// reads are merged into one when the gap between them is at most this many
+// bytes; the gap is read and thrown away
+static const uint64_t IO_COALESCE_MAX_GAP = 16 * 1024;
+
+// most reads merged into one, and the most bytes the merged read may span
+static const uint32_t IO_COALESCE_MAX_OPS = 16;
+static const uint64_t IO_COALESCE_MAX_SIZE = 1024 * 1024;
+
+
+//
+// types
+//
+
+// the platform's handle to an open file
+#if defined(BL_PLATFORM_OSX)
+struct IoPlatformFile {
+  FILE* handle;
+};
+#elif defined(BL_PLATFORM_LINUX)
+struct IoPlatformFile {
+  int   fd;
+};
+#else
+# error unsupported platform
+#endif
+
+struct IoWaiter;
+
+// Ops are carved out of slabs and recycled through a free list, so issuing an
+// op costs no allocation. A waiting caller sleeps on an event count of its own
+// that the op points at, rather than a mutex and cond per op.
+struct IoOpImpl : public BLIoOp, public BLQueueMPSCNode {
+  IoOpType          op_type;
+  volatile int32_t  complete;       // set once the io lib is done with the op
+  IoWaiter* volatile waiter;        // caller sleeping on the op (IO_WAITER_DONE once complete)
+  IoOpImpl*         next_parked;    // next op waiting on the same file
+  uint64_t          deadline_ns;    // bl_time_ns() by which a read should be issued (0 for none)
+  const BLIoBuffer* buffers;        // destinations of a vectored read (NULL reads into buffer)
+  uint32_t          buffer_count;
+  bool              write_behind;   // writes out a file's write buffer; owns the buffer and nobody waits on it
+  bool              cache_fill;     // missed the read cache; read as whole blocks that go into it
+  bool              bounce;         // unaligned read of an unbuffered file; read through a bounce buffer
+  uint32_t          pool_index;     // 1-based index of this op in the pool
+  volatile uint32_t next_free;      // pool_index of the next free op (0 ends the list)
+};
+
+// Ops on one file may be serviced by different io threads, so each file gates
+// its own ops: reads and writes wait for the open to finish and the close
+// waits for the ones in flight to drain. Reads are free to run concurrently;
+// writes and flushes all go to one thread so they land in the order issued.
+struct BLIoFile {
+  char            file_name[BL_IO_MAX_FILE_NAME_LENGTH];
+  uint64_t        id;             // unique to this open; keys the file's blocks in the read cache
+  uint64_t        offset;
+  uint64_t        size;           // size of the file when it was opened
+  IoPlatformFile  platform;
+  BLMutex         gate_mutex;
+  bool            opening;        // the open op hasn't completed yet
+  uint32_t        inflight;       // reads and writes handed to the io threads
+  IoOpImpl*       parked_head;    // reads and writes waiting for the open to complete
+  IoOpImpl*       parked_tail;
+  IoOpImpl*       parked_close;   // close waiting for the reads and writes to drain
+  BLIoPack*       pack;           // pack this file is an entry of (NULL for a file of its own)
+  uint64_t        base_offset;    // where the file starts in the pack
+  bool            unbuffered;     // opened to read around the platform's file cache
+  uint32_t        direct_alignment; // alignment the platform needs for unbuffered reads (0 for none)
+
+  // compressed files
+  bool            compressed;     // opened to read a file written by bl_io_compress_file()
+  uint32_t        block_size;     // uncompressed size of every block but the last
+  uint32_t        block_count;
+  uint64_t*       block_offsets;  // where each block starts in the file, then where the last one ends
+
+  // writing
+  bool            writable;       // opened for writing rather than reading
+  uint32_t        write_thread;   // io thread that services the file's writes
+  BLIoStatus      write_error;    // first failed write since the last flush
+  uint8_t*        write_buffer;   // small writes gathered on the calling thread (NULL until needed)
+  uint64_t        write_buffer_capacity;
+  uint64_t        write_buffer_offset;  // file offset of the first gathered byte
+  uint64_t        write_buffer_used;
+};
+
+
+//
+// platform layer
+//
+
+// Returns the most io threads the platform can service ops from at once.
+uint32_t io_platform_max_thread_count();
+
+// Sets up the platform handle of a new, unopened file.
+void io_platform_file_init(BLIoFile* file);
+
+// Opens the file named by file->file_name and reports its size. A writable
+// file is created, or truncated if it exists, and opened for writing. An
+// unbuffered file is read around the file cache if the platform can, and
+// file->direct_alignment set to what the platform requires of those reads.
+BLIoStatus io_platform_open(BLIoFile* file, uint64_t* file_size);
+
+// Closes an open file.
+BLIoStatus io_platform_close(BLIoFile* file);
+
+// Reads size bytes at offset into buffer. fulfilled_size is set to the number
+// of bytes read even if the read fails part way.
+BLIoStatus io_platform_read(BLIoFile* file, void* buffer, uint64_t offset, uint64_t size, uint64_t* fulfilled_size);
+
+// Reads contiguous bytes starting at offset, scattering them across up to
+// BL_IO_MAX_READ_BUFFERS buffers in order. fulfilled_size is the total read.
+BLIoStatus io_platform_readv(BLIoFile* file, uint64_t offset, const BLIoBuffer* buffers, uint32_t buffer_count, uint64_t* fulfilled_size);
+
+// Writes size bytes from buffer at offset. fulfilled_size is set to the number
+// of bytes written even if the write fails part way.
+BLIoStatus io_platform_write(BLIoFile* file, const void* buffer, uint64_t offset, uint64_t size, uint64_t* fulfilled_size);
+
+// Waits for everything written to the file so far to reach the disk.
+BLIoStatus io_platform_sync(BLIoFile* file);
+
+// Maps size bytes at offset read-only into mapping and applies the
+// BLIoMapAdvice flags in advice. The range has already been checked against
+// the file size.
+BLIoStatus io_platform_map(BLIoFile* file, uint64_t offset, uint64_t size, uint32_t advice, BLIoMapping* mapping);
+
+// Releases a view made by io_platform_map().
+void io_platform_unmap(BLIoMapping* mapping);
+
+// Starts the platform's asynchronous read path with room for queue_depth reads
+// in flight. Returns false if the platform has none, in which case reads are
+// serviced by the io threads with io_platform_read().
+bool io_platform_async_initialize(uint32_t queue_depth);
+
+// Stops the asynchronous read path. Reads still in flight are completed first.
+void io_platform_async_finalize();
+
+// Tells the asynchronous path that reads are waiting in the scheduler. May be
+// called from any thread. The platform takes reads with io_sched_pop() and
+// reports each result with io_read_complete().
+void io_platform_async_kick();
+
+
+//
+// scheduler
+//
+
+void io_sched_initialize();
+void io_sched_finalize();
+
+// Queues a read to be issued.
+void io_sched_push(IoOpImpl* op);
+
+// Takes up to max_count reads to issue next, in the order they should be
+// issued, and returns how many were taken.
+uint32_t io_sched_pop(IoOpImpl** ops, uint32_t max_count);
+
+// Takes the next read to issue along with the reads that follow it closely
+// enough in the same file to be merged into one (see IO_COALESCE_MAX_GAP).
+// The reads are in offset order and don't overlap. Returns how many were
+// taken, at most IO_COALESCE_MAX_OPS.
+uint32_t io_sched_pop_run(IoOpImpl** ops);
+
+// Removes a read that hasn't been issued yet. Returns false if it was already
+// taken, in which case it completes as usual.
+bool io_sched_cancel(IoOpImpl* op);
+
+// Changes the priority of a read that hasn't been issued yet. Returns false
+// if it was already taken.
+bool io_sched_set_priority(IoOpImpl* op, uint32_t priority);
+
+// Returns true if no reads are waiting. Doesn't take the lock so it's only a
+// snapshot.
+bool io_sched_empty();
+
+
+//
+// read cache
+//
+
+// size of the buffer the io threads read the unaligned parts of unbuffered
+// reads through
+static const uint64_t IO_BOUNCE_BUFFER_SIZE = 256 * 1024;
+
+// most bytes of whole blocks a read may span and still go through the cache;
+// bigger reads go straight to the file
+static const uint64_t IO_CACHE_MAX_FILL_SIZE = 4 * BL_IO_CACHE_BLOCK_SIZE;
+
+// Returns true if the blocks spanned by size bytes at offset fit in
+// IO_CACHE_MAX_FILL_SIZE.
+inline bool io_cache_span_fits(uint64_t offset, uint64_t size) {
+  uint64_t first_block = offset / BL_IO_CACHE_BLOCK_SIZE;
+  uint64_t end_block = (offset + size + BL_IO_CACHE_BLOCK_SIZE - 1) / BL_IO_CACHE_BLOCK_SIZE;
+  return (end_block - first_block) * BL_IO_CACHE_BLOCK_SIZE <= IO_CACHE_MAX_FILL_SIZE;
+}
+
+// Sets up a cache of block_count blocks. With zero the cache is disabled and
+// every lookup misses.
+void io_cache_initialize(uint32_t block_count);
+void io_cache_finalize();
+
+bool io_cache_enabled();
+
+// Copies size bytes at offset in the file into dest if every block they span
+// is cached and returns true. Counts a hit or a miss either way.
+bool io_cache_read(const BLIoFile* file, void* dest, uint64_t offset, uint64_t size);
+
+// Caches every block that lies wholly inside the size bytes at offset, along
+// with the last block of the file if the data reaches the end of it.
+void io_cache_insert(const BLIoFile* file, uint64_t offset, const void* data, uint64_t size);
+
+void io_cache_get_stats(BLIoCacheStats* stats);
+
+
+//
+// compressed files
+//
+
+// Starts decompressing on the job workers, or on the io threads when
+// use_jobs is false.
+void io_compress_initialize(bool use_jobs);
+
+// Waits for blocks still being decompressed.
+void io_compress_finalize();
+
+// Reads and checks the header and block table of a compressed file just
+// opened by the platform. size goes in as the size on disk and comes out as
+// the uncompressed size. The file is closed again if it fails.
+BLIoStatus io_compressed_open(BLIoFile* file, uint64_t* size);
+
+// Carries out a read of a compressed file on an io thread. The op completes
+// once its last block is decompressed, which may be on a job worker.
+void io_compressed_read(IoOpImpl* op);
+
+
+//
+// shared
+//
+
+// Maps an errno value from a failed open to a status.
+BLIoStatus io_status_from_errno(int err);
+
+// Allocates an unopened file handle.
+BLIoFile* io_file_create(const char* file_name, bool writable, uint64_t write_buffer_size);
+
+// Returns how many of the size bytes at offset can be read from the file. A
+// pack entry ends where the entry does; other files are read until the
+// platform reports the end.
+inline uint64_t io_file_readable(const BLIoFile* file, uint64_t offset, uint64_t size) {
+  if (!file->pack) {
+    return size;
+  }
+  if (offset >= file->size) {
+    return 0;
+  }
+  return (size < file->size - offset) ? size : file->size - offset;
+}
+
+// Called by the close of a pack entry once its file is gone.
+void io_pack_entry_closed(BLIoPack* pack);
+
+// Completes a read op and lets the file's waiting ops through.
+void io_read_complete(IoOpImpl* op, BLIoStatus status, uint64_t fulfilled_size);
@@ -0,0 +1,289 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "../io_int.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+//
+// platform layer
+//
+
+//----------------------------------------------------------------------------
+uint32_t io_platform_max_thread_count() {
+  // pread doesn't share a file position so any number of threads can read
+  // the same file. past this the threads just contend in the kernel.
+  return 64;
+}
+
+//----------------------------------------------------------------------------
+void io_platform_file_init(BLIoFile* file) {
+  file->platform.fd = -1;
+}
+
+//----------------------------------------------------------------------------
+BLIoStatus io_platform_open(BLIoFile* file, uint64_t* file_size) {
+  // verify file is not already open
+  if (file->platform.fd != -1) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
+  }
+
+  // open the file
+  int flags = file->writable ? (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC);
+  if (file->unbuffered) {
+    flags |= O_DIRECT;
+  }
+  int fd;
+  do {
+    fd = open(file->file_name, flags, 0644);
+  } while ((fd == -1) && (errno == EINTR));
+
+  // some file systems (tmpfs) refuse O_DIRECT; read those through the cache
+  if ((fd == -1) && (errno == EINVAL) && (flags & O_DIRECT)) {
+    flags &= ~O_DIRECT;
+    do {
+      fd = open(file->file_name, flags, 0644);
+    } while ((fd == -1) && (errno == EINTR));
+  }
+  if (fd == -1) {
+    return io_status_from_errno(errno);
+  }
+  file->platform.fd = fd;
+  file->direct_alignment = (flags & O_DIRECT) ? BL_IO_UNBUFFERED_ALIGNMENT : 0;
+
+  // get the file size
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
+  }
+
+  *file_size = (uint64_t)st.st_size;
+  return BL_IO_STATUS_OK;
+}
+
+//----------------------------------------------------------------------------
+BLIoStatus io_platform_close(BLIoFile* file) {
+  // verify the file is open
+  if (file->platform.fd == -1) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
+  }
+
+  // the descriptor is released even if close reports an error so don't retry
+  int ret = close(file->platform.fd);
+  file->platform.fd = -1;
+  if ((ret == -1) && (errno != EINTR)) {
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
+  }
+  return BL_IO_STATUS_OK;
+}
+
+//----------------------------------------------------------------------------
+BLIoStatus io_platform_read(BLIoFile* file, void* buffer, uint64_t offset, uint64_t size, uint64_t* fulfilled_size) {
+  // verify the file is open
+  int fd = file->platform.fd;
+  if (fd == -1) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
+  }
+
+  // pread may return less than asked for so keep going until the request is
+  // filled or the end of the file is hit
+  uint8_t* dest = (uint8_t*)buffer;
+  uint64_t total = 0;
+  while (total < size) {
+    ssize_t ret = pread(fd, dest + total, (size_t)(size - total), (off_t)(offset + total));
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      *fulfilled_size = total;
+      return (errno == EBADF) ? BL_IO_STATUS_ERROR_BAD_FILE_HANDLE : BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
+    }
+    if (ret == 0) {
+      *fulfilled_size = total;
+      return BL_IO_STATUS_ERROR_EOF;
+    }
+    total += (uint64_t)ret;
+
+    // an unbuffered read only stops part way through a block at the end of
+    // the file, and carrying on from there would be unaligned
+    if (file->direct_alignment && ((uint64_t)ret % file->direct_alignment) && (total < size)) {
+      *fulfilled_size = total;
+      return BL_IO_STATUS_ERROR_EOF;
+    }
+  }
+
+  *fulfilled_size = total;
+  return BL_IO_STATUS_OK;
+}
+
+//----------------------------------------------------------------------------
+BLIoStatus io_platform_readv(BLIoFile* file, uint64_t offset, const BLIoBuffer* buffers, uint32_t buffer_count, uint64_t* fulfilled_size) {
+  BL_ASSERT(buffer_count <= BL_IO_MAX_READ_BUFFERS);
+
+  // verify the file is open
+  int fd = file->platform.fd;
+  if (fd == -1) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
+  }
+
+  struct iovec iov[BL_IO_MAX_READ_BUFFERS];
+  uint64_t size = 0;
+  for (uint32_t index = 0; index < buffer_count; ++index) {
+    iov[index].iov_base = buffers[index].data;
+    iov[index].iov_len  = (size_t)buffers[index].size;
+    size += buffers[index].size;
+  }
+
+  // preadv may stop short too; step past the filled pieces and keep going
+  struct iovec* pending = iov;
+  int pending_count = (int)buffer_count;
+  uint64_t total = 0;
+  while (total < size) {
+    ssize_t ret = preadv(fd, pending, pending_count, (off_t)(offset + total));
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      *fulfilled_size = total;
+      return (errno == EBADF) ? BL_IO_STATUS_ERROR_BAD_FILE_HANDLE : BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
+    }
+    if (ret == 0) {
+      *fulfilled_size = total;
+      return BL_IO_STATUS_ERROR_EOF;
+    }
+    total += (uint64_t)ret;
+    if (file->direct_alignment && ((uint64_t)ret % file->direct_alignment) && (total < size)) {
+      *fulfilled_size = total;
+      return BL_IO_STATUS_ERROR_EOF;
+    }
+
+    size_t advance = (size_t)ret;
+    while (pending_count && (advance >= pending->iov_len)) {
+      advance -= pending->iov_len;
+      ++pending;
+      --pending_count;
+    }
+    if (pending_count) {
+      pending->iov_base = (uint8_t*)pending->iov_base + advance;
+      pending->iov_len -= advance;
+    }
+  }
+
+  *fulfilled_size = total;
+  return BL_IO_STATUS_OK;
+}
+
+//----------------------------------------------------------------------------
+BLIoStatus io_platform_write(BLIoFile* file, const void* buffer, uint64_t offset, uint64_t size, uint64_t* fulfilled_size) {
+  // verify the file is open
+  int fd = file->platform.fd;
+  if (fd == -1) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
+  }
+
+  // pwrite may also come up short
+  const uint8_t* src = (const uint8_t*)buffer;
+  uint64_t total = 0;
+  while (total < size) {
+    ssize_t ret = pwrite(fd, src + total, (size_t)(size - total), (off_t)(offset + total));
+    if (ret == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      *fulfilled_size = total;
+      return io_status_from_errno(errno);
+    }
+    total += (uint64_t)ret;
+  }
+
+  *fulfilled_size = total;
+  return BL_IO_STATUS_OK;
+}
+
+//----------------------------------------------------------------------------
+BLIoStatus io_platform_sync(BLIoFile* file) {
+  // verify the file is open
+  int fd = file->platform.fd;
+  if (fd == -1) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
+  }
+
+  int ret;
+  do {
+    ret = fsync(fd);
+  } while ((ret == -1) && (errno == EINTR));
+  if (ret == -1) {
+    return io_status_from_errno(errno);
+  }
+  return BL_IO_STATUS_OK;
+}
+
+//----------------------------------------------------------------------------
+BLIoStatus io_platform_map(BLIoFile* file, uint64_t offset, uint64_t size, uint32_t advice, BLIoMapping* mapping) {
+  // verify the file is open
+  int fd = file->platform.fd;
+  if (fd == -1) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
+  }
+
+  // views have to start on a page boundary
+  uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+  uint64_t base_offset = offset & ~(page_size - 1);
+  uint64_t base_size = size + (offset - base_offset);
+  void* base = mmap(NULL, (size_t)base_size, PROT_READ, MAP_SHARED, fd, (off_t)base_offset);
+  if (base == MAP_FAILED) {
+    return io_status_from_errno(errno);
+  }
+
+  // the advice is only a hint so failures don't matter
+  if (advice & BL_IO_MAP_ADVICE_SEQUENTIAL) {
+    madvise(base, (size_t)base_size, MADV_SEQUENTIAL);
+  }
+  if (advice & BL_IO_MAP_ADVICE_WILLNEED) {
+    madvise(base, (size_t)base_size, MADV_WILLNEED);
+  }
+#if defined(MADV_HUGEPAGE)
+  // only has an effect if the filesystem supports huge pages for file views
+  if (advice & BL_IO_MAP_ADVICE_HUGEPAGE) {
+    madvise(base, (size_t)base_size, MADV_HUGEPAGE);
+  }
+#endif
+
+  mapping->data       = (const uint8_t*)base + (offset - base_offset);
+  mapping->size       = size;
+  mapping->base       = base;
+  mapping->base_size  = base_size;
+  return BL_IO_STATUS_OK;
+}
+
+//----------------------------------------------------------------------------
+void io_platform_unmap(BLIoMapping* mapping) {
+  int ret = munmap(mapping->base, (size_t)mapping->base_size);
+  BL_ASSERT(ret == 0);
+}
@@ -0,0 +1,506 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "../io_int.h"
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+//
+// constants
+//
+
+// user_data of the read that is kept armed on the wake eventfd
+static const uint64_t WAKE_USER_DATA = 0;
+
+// most reads taken from the scheduler at once
+static const uint32_t MAX_FILL_BATCH = 64;
+
+// largest single read handed to the kernel; bigger reads are split
+static const uint64_t MAX_READ_SIZE = 1u << 30;
+
+// vectored reads hand BLIoBuffer arrays to the kernel as iovecs
+BL_STATIC_ASSERT(sizeof(BLIoBuffer) == sizeof(iovec));
+BL_STATIC_ASSERT(offsetof(BLIoBuffer, data) == offsetof(iovec, iov_base));
+BL_STATIC_ASSERT(offsetof(BLIoBuffer, size) == offsetof(iovec, iov_len));
+
+
+//
+// local types
+//
+
+// An io_uring instance serviced by a single thread. Reads wait in the io
+// scheduler; the ring thread takes them in scheduled order into the submission ring,
+// submits the whole batch with one io_uring_enter() call and reaps every
+// completion that has arrived in the same call.
+struct IoRing {
+  volatile int32_t    sleeping;         // ring thread is blocked in the kernel
+  volatile bool       quit;
+  BLThread            thread;
+
+  int                 ring_fd;
+  int                 wake_fd;          // eventfd written to pull the ring thread out of the kernel
+  uint64_t            wake_value;       // destination of the armed eventfd read
+
+  // submission ring
+  volatile uint32_t*  sq_head;
+  volatile uint32_t*  sq_tail;
+  uint32_t            sq_mask;
+  uint32_t*           sq_array;
+  io_uring_sqe*       sqes;
+  uint32_t            sq_pending;       // sqes written but not yet submitted
+
+  // completion ring
+  volatile uint32_t*  cq_head;
+  volatile uint32_t*  cq_tail;
+  uint32_t            cq_mask;
+  io_uring_cqe*       cqes;
+
+  // mappings
+  void*               sq_map;
+  size_t              sq_map_size;
+  void*               cq_map;
+  size_t              cq_map_size;
+  size_t              sqes_map_size;
+
+  uint32_t            queue_depth;      // most reads in the kernel at once
+  uint32_t            inflight;         // reads currently in the kernel
+  IoOpImpl*           backlog_head;     // short reads waiting to go around again
+  IoOpImpl*           backlog_tail;
+};
+
+
+//
+// local vars
+//
+
+static IoRing s_ring;
+
+
+//
+// local functions
+//
+
+//----------------------------------------------------------------------------
+static int sys_io_uring_setup(uint32_t entries, io_uring_params* params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+//----------------------------------------------------------------------------
+static int sys_io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+//----------------------------------------------------------------------------
+static int sys_io_uring_register(int fd, uint32_t opcode, void* arg, uint32_t nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+//----------------------------------------------------------------------------
+// checks the kernel knows IORING_OP_READ (added after io_uring itself)
+static bool ring_supports_read(int ring_fd) {
+  const uint32_t op_count = 256;
+  size_t size = sizeof(io_uring_probe) + op_count * sizeof(io_uring_probe_op);
+  io_uring_probe* probe = (io_uring_probe*)bl_alloc(size, 8);
+  memset(probe, 0, size);
+  bool supported = false;
+  if (sys_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, op_count) == 0) {
+    supported = (probe->last_op >= IORING_OP_READ) && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+  }
+  bl_free(probe);
+  return supported;
+}
+
+//----------------------------------------------------------------------------
+static bool ring_create(IoRing* ring, uint32_t entries) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring->ring_fd = sys_io_uring_setup(entries, &params);
+  if (ring->ring_fd < 0) {
+    return false;
+  }
+  if (!ring_supports_read(ring->ring_fd)) {
+    close(ring->ring_fd);
+    return false;
+  }
+
+  // map the rings; newer kernels share one mapping between them
+  ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_map && (ring->cq_map_size > ring->sq_map_size)) {
+    ring->sq_map_size = ring->cq_map_size;
+  }
+  ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+  if (ring->sq_map == MAP_FAILED) {
+    close(ring->ring_fd);
+    return false;
+  }
+  if (single_map) {
+    ring->cq_map = ring->sq_map;
+  }
+  else {
+    ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+    if (ring->cq_map == MAP_FAILED) {
+      munmap(ring->sq_map, ring->sq_map_size);
+      close(ring->ring_fd);
+      return false;
+    }
+  }
+  ring->sqes_map_size = params.sq_entries * sizeof(io_uring_sqe);
+  ring->sqes = (io_uring_sqe*)mmap(NULL, ring->sqes_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    if (!single_map) {
+      munmap(ring->cq_map, ring->cq_map_size);
+    }
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->ring_fd);
+    return false;
+  }
+
+  uint8_t* sq = (uint8_t*)ring->sq_map;
+  ring->sq_head   = (volatile uint32_t*)(sq + params.sq_off.head);
+  ring->sq_tail   = (volatile uint32_t*)(sq + params.sq_off.tail);
+  ring->sq_mask   = *(uint32_t*)(sq + params.sq_off.ring_mask);
+  ring->sq_array  = (uint32_t*)(sq + params.sq_off.array);
+  ring->sq_pending = 0;
+
+  uint8_t* cq = (uint8_t*)ring->cq_map;
+  ring->cq_head   = (volatile uint32_t*)(cq + params.cq_off.head);
+  ring->cq_tail   = (volatile uint32_t*)(cq + params.cq_off.tail);
+  ring->cq_mask   = *(uint32_t*)(cq + params.cq_off.ring_mask);
+  ring->cqes      = (io_uring_cqe*)(cq + params.cq_off.cqes);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+static void ring_destroy(IoRing* ring) {
+  munmap(ring->sqes, ring->sqes_map_size);
+  if (ring->cq_map != ring->sq_map) {
+    munmap(ring->cq_map, ring->cq_map_size);
+  }
+  munmap(ring->sq_map, ring->sq_map_size);
+  close(ring->ring_fd);
+}
+
+//----------------------------------------------------------------------------
+// returns the next free sqe, cleared. only the ring thread writes the
+// submission ring so there's no need to guard the tail.
+static io_uring_sqe* ring_get_sqe(IoRing* ring) {
+  uint32_t tail = *ring->sq_tail + ring->sq_pending;
+  uint32_t index = tail & ring->sq_mask;
+  io_uring_sqe* sqe = ring->sqes + index;
+  memset(sqe, 0, sizeof(*sqe));
+  ring->sq_array[index] = index;
+  ++ring->sq_pending;
+  return sqe;
+}
+
+//----------------------------------------------------------------------------
+// publishes the pending sqes to the kernel and returns how many it has yet to
+// consume, including any left over from a short submit
+static uint32_t ring_flush_sqes(IoRing* ring) {
+  if (ring->sq_pending) {
+    bl_atomic_barrier();
+    *ring->sq_tail = *ring->sq_tail + ring->sq_pending;
+    ring->sq_pending = 0;
+  }
+  return *ring->sq_tail - *ring->sq_head;
+}
+
+//----------------------------------------------------------------------------
+static void ring_arm_wake(IoRing* ring) {
+  io_uring_sqe* sqe = ring_get_sqe(ring);
+  sqe->opcode     = IORING_OP_READ;
+  sqe->fd         = ring->wake_fd;
+  sqe->addr       = (uint64_t)(uintptr_t)&ring->wake_value;
+  sqe->len        = sizeof(ring->wake_value);
+  sqe->user_data  = WAKE_USER_DATA;
+}
+
+//----------------------------------------------------------------------------
+// writes the sqe for the unread remainder of a read. op->fulfilled_size
+// tracks how much has been read so far.
+static void ring_prep_read(IoRing* ring, IoOpImpl* op) {
+  io_uring_sqe* sqe = ring_get_sqe(ring);
+  sqe->fd         = op->file->platform.fd;
+  sqe->off        = op->file->base_offset + op->offset + op->fulfilled_size;
+  sqe->user_data  = (uint64_t)(uintptr_t)op;
+  ++ring->inflight;
+
+  // a vectored read goes to the kernel whole the first time around since the
+  // caller's buffer list doubles as the iovec array
+  if (op->buffers && (op->fulfilled_size == 0)) {
+    sqe->opcode   = IORING_OP_READV;
+    sqe->addr     = (uint64_t)(uintptr_t)op->buffers;
+    sqe->len      = op->buffer_count;
+    return;
+  }
+
+  // otherwise read the rest of the buffer the read stopped in; a short
+  // vectored read finishes off one buffer at a time
+  uint8_t* dest;
+  uint64_t remaining;
+  if (op->buffers) {
+    uint64_t skip = op->fulfilled_size;
+    uint32_t index = 0;
+    while (skip >= op->buffers[index].size) {
+      skip -= op->buffers[index].size;
+      ++index;
+    }
+    dest      = (uint8_t*)op->buffers[index].data + skip;
+    remaining = op->buffers[index].size - skip;
+  }
+  else {
+    dest      = (uint8_t*)op->buffer + op->fulfilled_size;
+    remaining = io_file_readable(op->file, op->offset, op->requested_size) - op->fulfilled_size;
+  }
+  sqe->opcode     = IORING_OP_READ;
+  sqe->addr       = (uint64_t)(uintptr_t)dest;
+  sqe->len        = (uint32_t)(remaining < MAX_READ_SIZE ? remaining : MAX_READ_SIZE);
+}
+
+//----------------------------------------------------------------------------
+static void backlog_push(IoRing* ring, IoOpImpl* op) {
+  op->next_parked = NULL;
+  if (ring->backlog_tail) {
+    ring->backlog_tail->next_parked = op;
+  }
+  else {
+    ring->backlog_head = op;
+  }
+  ring->backlog_tail = op;
+}
+
+//----------------------------------------------------------------------------
+static IoOpImpl* backlog_pop(IoRing* ring) {
+  IoOpImpl* op = ring->backlog_head;
+  if (op) {
+    ring->backlog_head = op->next_parked;
+    if (!ring->backlog_head) {
+      ring->backlog_tail = NULL;
+    }
+  }
+  return op;
+}
+
+//----------------------------------------------------------------------------
+// moves as many waiting reads into the submission ring as there is room for
+static void ring_fill(IoRing* ring) {
+  // finish off short reads before starting new ones
+  while (ring->backlog_head && (ring->inflight < ring->queue_depth)) {
+    ring_prep_read(ring, backlog_pop(ring));
+  }
+
+  while (ring->inflight < ring->queue_depth) {
+    IoOpImpl* ops[MAX_FILL_BATCH];
+    uint32_t room = ring->queue_depth - ring->inflight;
+    uint32_t count = io_sched_pop(ops, room < MAX_FILL_BATCH ? room : MAX_FILL_BATCH);
+    if (!count) {
+      break;
+    }
+    for (uint32_t index = 0; index < count; ++index) {
+      // nothing to read, or nothing left in a pack entry; don't bother the
+      // kernel
+      IoOpImpl* op = ops[index];
+      if (op->requested_size == 0) {
+        io_read_complete(op, BL_IO_STATUS_OK, 0);
+        continue;
+      }
+      if (io_file_readable(op->file, op->offset, op->requested_size) == 0) {
+        io_read_complete(op, BL_IO_STATUS_ERROR_EOF, 0);
+        continue;
+      }
+      ring_prep_read(ring, op);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+static void ring_complete_read(IoRing* ring, IoOpImpl* op, int32_t res) {
+  --ring->inflight;
+  if (res < 0) {
+    io_read_complete(op, (res == -EBADF) ? BL_IO_STATUS_ERROR_BAD_FILE_HANDLE : BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC, op->fulfilled_size);
+    return;
+  }
+  if (res == 0) {
+    io_read_complete(op, BL_IO_STATUS_ERROR_EOF, op->fulfilled_size);
+    return;
+  }
+
+  // done once everything readable is in. a pack entry ends before the pack
+  // does; a vectored read may have gone past it into the buffers but the
+  // extra doesn't count.
+  op->fulfilled_size += (uint64_t)res;
+  uint64_t readable = io_file_readable(op->file, op->offset, op->requested_size);
+  if (op->fulfilled_size >= readable) {
+    op->fulfilled_size = readable;
+    io_read_complete(op, (readable < op->requested_size) ? BL_IO_STATUS_ERROR_EOF : BL_IO_STATUS_OK, readable);
+    return;
+  }
+
+  // short reads go around again for the rest, same as the pread loop. an
+  // unbuffered read stopping part way through a block has hit the end of the
+  // file.
+  uint32_t alignment = op->file->direct_alignment;
+  if (alignment && ((uint32_t)res % alignment)) {
+    io_read_complete(op, BL_IO_STATUS_ERROR_EOF, op->fulfilled_size);
+    return;
+  }
+  backlog_push(ring, op);
+}
+
+//----------------------------------------------------------------------------
+// handles every completion posted so far
+static void ring_reap(IoRing* ring) {
+  uint32_t head = *ring->cq_head;
+  bl_atomic_barrier();
+  uint32_t tail = *ring->cq_tail;
+  bl_atomic_barrier();
+  if (head == tail) {
+    return;
+  }
+
+  for (; head != tail; ++head) {
+    io_uring_cqe* cqe = ring->cqes + (head & ring->cq_mask);
+    uint64_t user_data = cqe->user_data;
+    int32_t res = cqe->res;
+
+    // hand the slot back before completing so the kernel can reuse it
+    bl_atomic_barrier();
+    *ring->cq_head = head + 1;
+
+    if (user_data == WAKE_USER_DATA) {
+      ring_arm_wake(ring);
+    }
+    else {
+      ring_complete_read(ring, (IoOpImpl*)(uintptr_t)user_data, res);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+static void ring_thread_proc(void* param) {
+  IoRing* ring = (IoRing*)param;
+  bl_thread_set_name("io_uring");
+
+  ring_arm_wake(ring);
+  for (;;) {
+    ring_fill(ring);
+
+    // nothing queued, nothing in the kernel and asked to stop. the armed wake
+    // read goes away with the ring.
+    if (ring->quit && (ring->inflight == 0) && !ring->backlog_head && io_sched_empty()) {
+      break;
+    }
+
+    // submit the batch and block for a completion in the same call. it is
+    // always safe to block: either reads are in flight or a producer will
+    // write the eventfd. announce it and look at the scheduler once more so
+    // a read queued in between is seen either here or by its producer.
+    ring->sleeping = 1;
+    bl_atomic_barrier();
+    if (!io_sched_empty() && (ring->inflight < ring->queue_depth)) {
+      ring->sleeping = 0;
+      continue;
+    }
+
+    uint32_t to_submit = ring_flush_sqes(ring);
+    int ret = sys_io_uring_enter(ring->ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+    ring->sleeping = 0;
+    if ((ret < 0) && (errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY)) {
+      BL_FATAL("io_uring_enter failed: %d", errno);
+    }
+    ring_reap(ring);
+  }
+}
+
+//----------------------------------------------------------------------------
+static void ring_wake(IoRing* ring) {
+  uint64_t value = 1;
+  ssize_t ret;
+  do {
+    ret = write(ring->wake_fd, &value, sizeof(value));
+  } while ((ret == -1) && (errno == EINTR));
+}
+
+
+//
+// platform layer
+//
+
+//----------------------------------------------------------------------------
+bool io_platform_async_initialize(uint32_t queue_depth) {
+  IoRing* ring = &s_ring;
+
+  // one extra entry for the wake read
+  if (!ring_create(ring, queue_depth + 1)) {
+    return false;
+  }
+  ring->wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (ring->wake_fd == -1) {
+    ring_destroy(ring);
+    return false;
+  }
+
+  ring->sleeping      = 0;
+  ring->quit          = false;
+  ring->queue_depth   = queue_depth;
+  ring->inflight      = 0;
+  ring->backlog_head  = NULL;
+  ring->backlog_tail  = NULL;
+  bl_thread_create(&ring->thread, &ring_thread_proc, ring);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void io_platform_async_finalize() {
+  IoRing* ring = &s_ring;
+
+  ring->quit = true;
+  bl_atomic_barrier();
+  ring_wake(ring);
+  bl_thread_join(&ring->thread);
+
+  close(ring->wake_fd);
+  ring_destroy(ring);
+}
+
+//----------------------------------------------------------------------------
+void io_platform_async_kick() {
+  IoRing* ring = &s_ring;
+
+  // the ring thread only looks at the scheduler between trips into the kernel
+  bl_atomic_barrier();
+  if (ring->sleeping) {
+    ring_wake(ring);
+  }
+}
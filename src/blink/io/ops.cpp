@@ -0,0 +1,1584 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "io_int.h"
+#include "../job.h"
+#include <cerrno>
+#include <cstring>
+
+//
+// constants
+//
+
+// ops allocated at a time when the pool runs dry
+static const uint32_t IO_OP_SLAB_SIZE = 256;
+
+// limits the pool to IO_OP_SLAB_SIZE * IO_OP_MAX_SLABS live ops
+static const uint32_t IO_OP_MAX_SLABS = 1024;
+
+// left in an op's waiter slot once it has completed
+static IoWaiter* const IO_WAITER_DONE = (IoWaiter*)1;
+
+
+//
+// local types
+//
+
+// A lock-free stack of free ops. free_head holds the pool_index of the top op
+// in its low 32 bits and a tag in its high 32 bits that changes on every push
+// and pop, so a stale head can't be swapped back in (ABA). Slabs are never
+// freed until the lib is finalized, so reading next_free from an op that was
+// popped by another thread in the meantime is harmless.
+struct IoOpPool {
+  volatile int64_t  free_head;
+  IoOpImpl*         slabs[IO_OP_MAX_SLABS];
+  volatile int32_t  slab_count;
+  BLMutex           grow_mutex;
+};
+
+// Opens and closes are handed to a particular thread. Reads wait in the
+// scheduler and are taken by whichever thread is free next.
+struct IoThread {
+  BLQueueMPSC       queue;          // opens and closes for this thread to service
+  volatile int32_t  pending;        // opens and closes queued or in progress on this thread
+  volatile int32_t  idle;           // waiting for work; cleared by whoever wakes it
+  uint8_t*          gap_buffer;     // soaks up the bytes between merged reads
+  uint8_t*          cache_buffer;   // whole blocks read to fill the read cache
+  uint8_t*          bounce_buffer;  // unaligned parts of unbuffered reads (allocated on first use)
+  BLThread          thread;
+};
+
+// A caller blocked in one of the bl_io_op_wait calls. Each op it waits on points at it
+// and counts remaining down as it completes, so the caller is woken once when
+// enough of its own ops are done rather than by every completion. The waiter
+// lives on the caller's stack, so released counts the completions that are
+// done touching it and the caller doesn't return while one still might.
+struct IoWaiter {
+  BLEventCount      event;
+  volatile int32_t  remaining;      // completions still needed before the caller wakes
+  volatile int32_t  released;       // completions that have let go of the waiter
+};
+
+// Finished ops are chained onto the queue through the same link they use to
+// wait in an io thread's queue, which they're done with by then.
+struct BLIoCompletionQueue {
+  BLQueueMPSC       queue;
+};
+
+
+//
+// local vars
+//
+
+static IoThread*              s_threads;
+static uint32_t               s_thread_count;
+static volatile bool          s_thread_quit;
+static bool                   s_async_reads;
+static IoOpPool               s_op_pool;
+static volatile int64_t       s_next_file_id;
+
+// setup a default op attribute
+static BLIoOpAttr             s_default_op_attr = {
+  NULL,
+  NULL,
+  0,
+  0,
+  NULL,
+  NULL,
+  NULL
+};
+
+
+//
+// local functions
+//
+
+//----------------------------------------------------------------------------
+static IoOpImpl* op_from_pool_index(uint32_t pool_index) {
+  uint32_t index = pool_index - 1;
+  return s_op_pool.slabs[index / IO_OP_SLAB_SIZE] + (index % IO_OP_SLAB_SIZE);
+}
+
+//----------------------------------------------------------------------------
+// pushes the chain of ops first..last (linked by next_free) onto the free list
+static void op_pool_push(IoOpImpl* first, IoOpImpl* last) {
+  for (;;) {
+    uint64_t head = (uint64_t)s_op_pool.free_head;
+    last->next_free = (uint32_t)head;
+    uint64_t new_head = (((head >> 32) + 1) << 32) | first->pool_index;
+    if (bl_atomic_cas(&s_op_pool.free_head, (int64_t)head, (int64_t)new_head)) {
+      return;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+static void op_pool_grow() {
+  bl_mutex_lock(&s_op_pool.grow_mutex);
+
+  // somebody else may have refilled the pool while we waited for the lock
+  if ((uint32_t)s_op_pool.free_head != 0) {
+    bl_mutex_unlock(&s_op_pool.grow_mutex);
+    return;
+  }
+
+  int32_t slab_index = s_op_pool.slab_count;
+  if (slab_index == (int32_t)IO_OP_MAX_SLABS) {
+    BL_FATAL("io op pool exhausted (%u ops live)", IO_OP_SLAB_SIZE * IO_OP_MAX_SLABS);
+  }
+
+  // chain the new ops together and publish the slab before its ops can be
+  // popped; the push is a full barrier
+  IoOpImpl* slab = (IoOpImpl*)bl_alloc(sizeof(IoOpImpl) * IO_OP_SLAB_SIZE, 64);
+  for (uint32_t index = 0; index < IO_OP_SLAB_SIZE; ++index) {
+    slab[index].pool_index = (uint32_t)slab_index * IO_OP_SLAB_SIZE + index + 1;
+    slab[index].next_free = slab[index].pool_index + 1;
+  }
+  s_op_pool.slabs[slab_index] = slab;
+  s_op_pool.slab_count = slab_index + 1;
+  op_pool_push(slab, slab + IO_OP_SLAB_SIZE - 1);
+
+  bl_mutex_unlock(&s_op_pool.grow_mutex);
+}
+
+//----------------------------------------------------------------------------
+static IoOpImpl* op_pool_pop() {
+  for (;;) {
+    uint64_t head = (uint64_t)s_op_pool.free_head;
+    uint32_t pool_index = (uint32_t)head;
+    if (!pool_index) {
+      op_pool_grow();
+      continue;
+    }
+    IoOpImpl* op = op_from_pool_index(pool_index);
+    uint64_t new_head = (((head >> 32) + 1) << 32) | op->next_free;
+    if (bl_atomic_cas(&s_op_pool.free_head, (int64_t)head, (int64_t)new_head)) {
+      return op;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// called whenever an op completes whether successfully or with error.
+// this will signal completion of the op and issue any associated
+// callbacks.
+static void mark_op_complete(IoOpImpl* op, BLIoStatus status) {
+  // update the op's status
+  op->status = status;
+
+  // issue the callback if requested
+  if (op->attr.callback) {
+    op->attr.callback(op, op->attr.context);
+  }
+
+  // hand the op to its job
+  BLJob* job = op->attr.job;
+  BLJobQueue* job_queue = op->attr.job_queue;
+  if (job) {
+    job->input = op;
+  }
+
+  // signal completion of the op. the waiter is free to delete the op as soon
+  // as it sees the flag, or the drainer or job once it's posted, so nothing
+  // can touch the op after this.
+  BLIoCompletionQueue* completion_queue = op->attr.completion_queue;
+  bl_atomic_barrier();
+  IoWaiter* waiter = (IoWaiter*)bl_atomic_swap((void* volatile*)&op->waiter, IO_WAITER_DONE);
+  op->complete = 1;
+  if (completion_queue) {
+    bl_queue_mpsc_push(&completion_queue->queue, op);
+  }
+  if (job) {
+    bl_job_queue_push_reserved_job(job_queue, job);
+  }
+
+  // count down the op's waiter and wake it if this was the completion it
+  // needed. letting go of it must come last.
+  if (waiter) {
+    if (bl_atomic_decrement(&waiter->remaining) == 0) {
+      bl_event_count_notify_all(&waiter->event);
+    }
+    bl_atomic_increment(&waiter->released);
+  }
+}
+
+//----------------------------------------------------------------------------
+// wakes one idle thread to take a read from the scheduler. if none are idle
+// the busy ones get to it once they finish what they're doing.
+static void wake_idle_thread() {
+  bl_atomic_barrier();
+  for (uint32_t index = 0; index < s_thread_count; ++index) {
+    IoThread* thread = s_threads + index;
+    if (thread->idle && bl_atomic_cas(&thread->idle, 1, 0)) {
+      bl_queue_mpsc_wake(&thread->queue);
+      return;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+static uint32_t least_busy_thread() {
+  uint32_t target = 0;
+  for (uint32_t index = 1; index < s_thread_count; ++index) {
+    if (s_threads[index].pending < s_threads[target].pending) {
+      target = index;
+    }
+  }
+  return target;
+}
+
+//----------------------------------------------------------------------------
+static bool is_aligned(uint64_t value, uint32_t alignment) {
+  return (value % alignment) == 0;
+}
+
+//----------------------------------------------------------------------------
+static bool read_is_aligned(const IoOpImpl* op, uint32_t alignment) {
+  if (!is_aligned(op->offset, alignment)) {
+    return false;
+  }
+  if (!op->buffers) {
+    return is_aligned((uintptr_t)op->buffer, alignment) && is_aligned(op->requested_size, alignment);
+  }
+  for (uint32_t index = 0; index < op->buffer_count; ++index) {
+    if (!is_aligned((uintptr_t)op->buffers[index].data, alignment) || !is_aligned(op->buffers[index].size, alignment)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+static void dispatch_op(IoOpImpl* op) {
+  // unaligned reads of an unbuffered file need a bounce buffer. the file has
+  // finished opening by now so its alignment is known.
+  if (op->op_type == IO_OP_TYPE_READ) {
+    op->bounce = (op->file->direct_alignment != 0) && !read_is_aligned(op, op->file->direct_alignment);
+  }
+
+  // reads go through the scheduler to whichever path services them. reads
+  // filling the cache, bouncing or decompressing need what only the io
+  // threads have.
+  if ((op->op_type == IO_OP_TYPE_READ) && !(s_async_reads && (op->cache_fill || op->bounce || op->file->compressed))) {
+    io_sched_push(op);
+    if (s_async_reads) {
+      io_platform_async_kick();
+    }
+    else {
+      wake_idle_thread();
+    }
+    return;
+  }
+
+  // writes and flushes stay in order on the file's write thread. other ops go
+  // to the least busy thread so a slow open doesn't hold up ops queued behind
+  // it while another thread sits idle.
+  IoThread* target;
+  if ((op->op_type == IO_OP_TYPE_WRITE) || (op->op_type == IO_OP_TYPE_FLUSH)) {
+    target = s_threads + op->file->write_thread;
+  }
+  else {
+    target = s_threads + least_busy_thread();
+  }
+
+  // queue the op; this wakes the thread if needed
+  bl_atomic_increment(&target->pending);
+  bl_queue_mpsc_push(&target->queue, op);
+}
+
+//----------------------------------------------------------------------------
+static void queue_op(IoOpImpl* op) {
+  BLIoFile* file = op->file;
+
+  // opens never wait
+  if (op->op_type == IO_OP_TYPE_OPEN) {
+    dispatch_op(op);
+    return;
+  }
+
+  // small reads served from the cache never reach the file
+  if ((op->op_type == IO_OP_TYPE_READ) && io_cache_enabled() && !op->buffers && !file->writable && !file->unbuffered && !file->compressed && io_cache_span_fits(op->offset, op->requested_size)) {
+    if (io_cache_read(file, op->buffer, op->offset, op->requested_size)) {
+      op->fulfilled_size = op->requested_size;
+      mark_op_complete(op, BL_IO_STATUS_OK);
+      return;
+    }
+    op->cache_fill = true;
+  }
+
+  bl_mutex_lock(&file->gate_mutex);
+  bool dispatch = true;
+  if (op->op_type != IO_OP_TYPE_CLOSE) {
+    if (file->opening) {
+      // park the read or write until the open completes
+      op->next_parked = NULL;
+      if (file->parked_tail) {
+        file->parked_tail->next_parked = op;
+      }
+      else {
+        file->parked_head = op;
+      }
+      file->parked_tail = op;
+      dispatch = false;
+    }
+    else {
+      ++file->inflight;
+    }
+  }
+  else if (file->opening || (file->inflight > 0)) {
+    // park the close until the reads and writes drain
+    BL_ASSERT(!file->parked_close);
+    file->parked_close = op;
+    dispatch = false;
+  }
+  bl_mutex_unlock(&file->gate_mutex);
+
+  if (dispatch) {
+    dispatch_op(op);
+  }
+}
+
+//----------------------------------------------------------------------------
+// called by an io thread once an open, a read or a write has completed to let
+// the file's waiting ops through.
+static void release_file_gate(BLIoFile* file, IoOpType op_type) {
+  bl_mutex_lock(&file->gate_mutex);
+  if (op_type == IO_OP_TYPE_OPEN) {
+    // let the parked ops go. they're dispatched under the lock so parked
+    // writes are queued ahead of any issued from here on.
+    file->opening = false;
+    IoOpImpl* parked = file->parked_head;
+    file->parked_head = NULL;
+    file->parked_tail = NULL;
+    while (parked) {
+      IoOpImpl* next = parked->next_parked;
+      ++file->inflight;
+      dispatch_op(parked);
+      parked = next;
+    }
+  }
+  else {
+    --file->inflight;
+  }
+
+  // let the close go once nothing else is outstanding
+  IoOpImpl* close = NULL;
+  if (!file->opening && (file->inflight == 0)) {
+    close = file->parked_close;
+    file->parked_close = NULL;
+  }
+  bl_mutex_unlock(&file->gate_mutex);
+
+  if (close) {
+    dispatch_op(close);
+  }
+}
+
+//----------------------------------------------------------------------------
+static void process_op_open(IoOpImpl* op) {
+  BLIoFile* file = op->file;
+  uint64_t file_size = 0;
+  BLIoStatus status = io_platform_open(file, &file_size);
+  if ((status == BL_IO_STATUS_OK) && file->compressed) {
+    status = io_compressed_open(file, &file_size);
+  }
+  file->size = file_size;
+  op->fulfilled_size = file_size;
+  mark_op_complete(op, status);
+  release_file_gate(file, IO_OP_TYPE_OPEN);
+}
+
+//----------------------------------------------------------------------------
+static void process_op_close(IoOpImpl* op) {
+  BLIoFile* file = op->file;
+
+  // pack entries share the pack's handle and leave it open
+  BLIoPack* pack = file->pack;
+  BLIoStatus status = pack ? BL_IO_STATUS_OK : io_platform_close(file);
+
+  // the pack may be closed as soon as the close completes
+  if (pack) {
+    io_pack_entry_closed(pack);
+  }
+
+  // a failed write that nobody has flushed is reported here
+  BLIoStatus write_error = file->write_error;
+  mark_op_complete(op, ((status == BL_IO_STATUS_OK) && (write_error != BL_IO_STATUS_OK)) ? write_error : status);
+
+  // nothing can be queued on the file any more
+  if (status == BL_IO_STATUS_OK) {
+    bl_free(file->write_buffer);
+    bl_free(file->block_offsets);
+    bl_mutex_destroy(&file->gate_mutex);
+    bl_free(file);
+  }
+}
+
+//----------------------------------------------------------------------------
+// reads from the file, keeping pack entries to their part of the pack
+static BLIoStatus file_read(BLIoFile* file, void* buffer, uint64_t offset, uint64_t size, uint64_t* fulfilled_size) {
+  uint64_t readable = io_file_readable(file, offset, size);
+  BLIoStatus status = io_platform_read(file, buffer, file->base_offset + offset, readable, fulfilled_size);
+  if ((status == BL_IO_STATUS_OK) && (readable < size)) {
+    status = BL_IO_STATUS_ERROR_EOF;
+  }
+  return status;
+}
+
+//----------------------------------------------------------------------------
+static BLIoStatus file_readv(BLIoFile* file, uint64_t offset, const BLIoBuffer* buffers, uint32_t buffer_count, uint64_t* fulfilled_size) {
+  if (!file->pack) {
+    return io_platform_readv(file, offset, buffers, buffer_count, fulfilled_size);
+  }
+
+  // trim the buffer list to the end of the entry
+  uint64_t size = 0;
+  for (uint32_t index = 0; index < buffer_count; ++index) {
+    size += buffers[index].size;
+  }
+  uint64_t readable = io_file_readable(file, offset, size);
+  if (readable == 0) {
+    *fulfilled_size = 0;
+    return (size > 0) ? BL_IO_STATUS_ERROR_EOF : BL_IO_STATUS_OK;
+  }
+  BLIoBuffer trimmed[BL_IO_MAX_READ_BUFFERS];
+  uint32_t trimmed_count = 0;
+  for (uint64_t left = readable; (trimmed_count < buffer_count) && (left > 0); ++trimmed_count) {
+    trimmed[trimmed_count] = buffers[trimmed_count];
+    if (trimmed[trimmed_count].size > left) {
+      trimmed[trimmed_count].size = left;
+    }
+    left -= trimmed[trimmed_count].size;
+  }
+
+  BLIoStatus status = io_platform_readv(file, file->base_offset + offset, trimmed, trimmed_count, fulfilled_size);
+  if ((status == BL_IO_STATUS_OK) && (readable < size)) {
+    status = BL_IO_STATUS_ERROR_EOF;
+  }
+  return status;
+}
+
+//----------------------------------------------------------------------------
+// reads the whole blocks around a read that missed the cache, caches them and
+// hands the read its part
+static void process_op_read_cached(IoThread* thread, IoOpImpl* op) {
+  BLIoFile* file = op->file;
+  uint64_t span_offset = op->offset - (op->offset % BL_IO_CACHE_BLOCK_SIZE);
+  uint64_t span_end = op->offset + op->requested_size + BL_IO_CACHE_BLOCK_SIZE - 1;
+  span_end -= span_end % BL_IO_CACHE_BLOCK_SIZE;
+
+  uint64_t span_fulfilled = 0;
+  BLIoStatus status = file_read(file, thread->cache_buffer, span_offset, span_end - span_offset, &span_fulfilled);
+  if ((status == BL_IO_STATUS_OK) || (status == BL_IO_STATUS_ERROR_EOF)) {
+    io_cache_insert(file, span_offset, thread->cache_buffer, span_fulfilled);
+  }
+
+  // the span running short only matters if it cuts into the read
+  uint64_t skip = op->offset - span_offset;
+  uint64_t fulfilled_size = (span_fulfilled > skip) ? span_fulfilled - skip : 0;
+  if (fulfilled_size >= op->requested_size) {
+    fulfilled_size = op->requested_size;
+    status = BL_IO_STATUS_OK;
+  }
+  memcpy(op->buffer, thread->cache_buffer + skip, (size_t)fulfilled_size);
+  io_read_complete(op, status, fulfilled_size);
+}
+
+//----------------------------------------------------------------------------
+// reads size bytes at offset from an unbuffered file into dest. the parts that
+// line up with the file's alignment go straight into dest and the rest
+// through the thread's bounce buffer a chunk at a time.
+static BLIoStatus read_bounced(IoThread* thread, BLIoFile* file, uint8_t* dest, uint64_t offset, uint64_t size, uint64_t* fulfilled_size) {
+  uint32_t alignment = file->direct_alignment;
+  if (!thread->bounce_buffer) {
+    thread->bounce_buffer = (uint8_t*)bl_alloc(IO_BOUNCE_BUFFER_SIZE, alignment);
+  }
+
+  uint64_t done = 0;
+  BLIoStatus status = BL_IO_STATUS_OK;
+  while ((done < size) && (status == BL_IO_STATUS_OK)) {
+    uint64_t position = offset + done;
+    uint64_t remaining = size - done;
+    uint64_t skip = position % alignment;
+    uint64_t read_size;
+
+    // whole aligned blocks go straight into the destination when it lines up
+    if ((skip == 0) && is_aligned((uintptr_t)(dest + done), alignment) && (remaining >= alignment)) {
+      read_size = remaining - (remaining % alignment);
+      status = file_read(file, dest + done, position, read_size, &read_size);
+      done += read_size;
+      continue;
+    }
+
+    // otherwise read the blocks around the next piece and copy it out
+    uint64_t span = skip + remaining + alignment - 1;
+    span -= span % alignment;
+    if (span > IO_BOUNCE_BUFFER_SIZE) {
+      span = IO_BOUNCE_BUFFER_SIZE;
+    }
+    status = file_read(file, thread->bounce_buffer, position - skip, span, &read_size);
+    uint64_t copy_size = (read_size > skip) ? read_size - skip : 0;
+    if (copy_size > remaining) {
+      copy_size = remaining;
+    }
+    memcpy(dest + done, thread->bounce_buffer + skip, (size_t)copy_size);
+    done += copy_size;
+
+    // blocks past the end of what was asked for don't matter
+    if ((status == BL_IO_STATUS_ERROR_EOF) && (done == size)) {
+      status = BL_IO_STATUS_OK;
+    }
+  }
+
+  *fulfilled_size = done;
+  return status;
+}
+
+//----------------------------------------------------------------------------
+static void process_op_read_bounced(IoThread* thread, IoOpImpl* op) {
+  BLIoFile* file = op->file;
+  if (!op->buffers) {
+    uint64_t fulfilled_size = 0;
+    BLIoStatus status = read_bounced(thread, file, (uint8_t*)op->buffer, op->offset, op->requested_size, &fulfilled_size);
+    io_read_complete(op, status, fulfilled_size);
+    return;
+  }
+
+  // a vectored read fills its buffers one after another
+  uint64_t fulfilled_size = 0;
+  BLIoStatus status = BL_IO_STATUS_OK;
+  for (uint32_t index = 0; (index < op->buffer_count) && (status == BL_IO_STATUS_OK); ++index) {
+    uint64_t buffer_fulfilled = 0;
+    status = read_bounced(thread, file, (uint8_t*)op->buffers[index].data, op->offset + fulfilled_size, op->buffers[index].size, &buffer_fulfilled);
+    fulfilled_size += buffer_fulfilled;
+  }
+  io_read_complete(op, status, fulfilled_size);
+}
+
+//----------------------------------------------------------------------------
+static void process_op_read(IoThread* thread, IoOpImpl* op) {
+  if (op->file->compressed) {
+    io_compressed_read(op);
+    return;
+  }
+  if (op->cache_fill) {
+    process_op_read_cached(thread, op);
+    return;
+  }
+  if (op->bounce) {
+    process_op_read_bounced(thread, op);
+    return;
+  }
+
+  BLIoFile* file = op->file;
+  uint64_t fulfilled_size = 0;
+  BLIoStatus status;
+  if (op->buffers) {
+    status = file_readv(file, op->offset, op->buffers, op->buffer_count, &fulfilled_size);
+  }
+  else {
+    status = file_read(file, op->buffer, op->offset, op->requested_size, &fulfilled_size);
+  }
+  io_read_complete(op, status, fulfilled_size);
+}
+
+//----------------------------------------------------------------------------
+static void process_op_write(IoOpImpl* op) {
+  BLIoFile* file = op->file;
+  uint64_t fulfilled_size = 0;
+  BLIoStatus status = io_platform_write(file, op->buffer, op->offset, op->requested_size, &fulfilled_size);
+
+  // remember the first failure for the next flush or the close. only the
+  // file's write thread touches this until the close.
+  if ((status != BL_IO_STATUS_OK) && (file->write_error == BL_IO_STATUS_OK)) {
+    file->write_error = status;
+  }
+
+  // nobody waits on a write-behind op so it cleans up after itself
+  if (op->write_behind) {
+    bl_free(op->buffer);
+    op_pool_push(op, op);
+  }
+  else {
+    op->fulfilled_size = fulfilled_size;
+    mark_op_complete(op, status);
+  }
+  release_file_gate(file, IO_OP_TYPE_WRITE);
+}
+
+//----------------------------------------------------------------------------
+static void process_op_flush(IoOpImpl* op) {
+  BLIoFile* file = op->file;
+
+  // every write issued before the flush has been carried out by now
+  BLIoStatus status = file->write_error;
+  file->write_error = BL_IO_STATUS_OK;
+  if (status == BL_IO_STATUS_OK) {
+    status = io_platform_sync(file);
+  }
+  mark_op_complete(op, status);
+  release_file_gate(file, IO_OP_TYPE_FLUSH);
+}
+
+//----------------------------------------------------------------------------
+// services a run of nearby reads in one file with a single scattered read,
+// sending the bytes between them to the thread's gap buffer
+static void process_read_run(IoThread* thread, IoOpImpl** ops, uint32_t count) {
+  if (count == 1) {
+    process_op_read(thread, ops[0]);
+    return;
+  }
+
+  BLIoFile* file = ops[0]->file;
+  uint64_t run_offset = ops[0]->offset;
+  BLIoBuffer buffers[IO_COALESCE_MAX_OPS * 2];
+  uint32_t buffer_count = 0;
+  uint64_t run_end = run_offset;
+  for (uint32_t index = 0; index < count; ++index) {
+    IoOpImpl* op = ops[index];
+    if (op->offset > run_end) {
+      buffers[buffer_count].data  = thread->gap_buffer;
+      buffers[buffer_count].size  = op->offset - run_end;
+      ++buffer_count;
+    }
+    buffers[buffer_count].data  = op->buffer;
+    buffers[buffer_count].size  = op->requested_size;
+    ++buffer_count;
+    run_end = op->offset + op->requested_size;
+  }
+
+  uint64_t fulfilled_size = 0;
+  BLIoStatus status = file_readv(file, run_offset, buffers, buffer_count, &fulfilled_size);
+
+  // hand each read its share; the ones cut short by an error or the end of
+  // the file get the status of the merged read
+  uint64_t run_fulfilled_end = run_offset + fulfilled_size;
+  for (uint32_t index = 0; index < count; ++index) {
+    IoOpImpl* op = ops[index];
+    uint64_t op_end = op->offset + op->requested_size;
+    if (run_fulfilled_end >= op_end) {
+      io_read_complete(op, BL_IO_STATUS_OK, op->requested_size);
+    }
+    else {
+      uint64_t op_fulfilled = (run_fulfilled_end > op->offset) ? run_fulfilled_end - op->offset : 0;
+      io_read_complete(op, (status == BL_IO_STATUS_OK) ? BL_IO_STATUS_ERROR_EOF : status, op_fulfilled);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+static void io_thread_proc(void* param) {
+  IoThread* thread = (IoThread*)param;
+  bl_thread_set_name("io");
+  for (;;) {
+    // opens and closes first since reads may be waiting on them, then the
+    // next read from the scheduler
+    IoOpImpl* op = static_cast<IoOpImpl*>(bl_queue_mpsc_pop(&thread->queue));
+    if (!op && !s_async_reads) {
+      // take the next read along with any that can be merged into it
+      IoOpImpl* run[IO_COALESCE_MAX_OPS];
+      uint32_t run_count = io_sched_pop_run(run);
+      if (run_count) {
+        process_read_run(thread, run, run_count);
+        continue;
+      }
+    }
+    if (!op) {
+      // kill the thread if there's nothing to do and we need to quit
+      if (s_thread_quit) {
+        break;
+      }
+
+      // announce that we're idle and then look at the scheduler one more time
+      // to catch any read queued before its producer could see us
+      thread->idle = 1;
+      bl_atomic_barrier();
+      if (!s_async_reads && !io_sched_empty()) {
+        thread->idle = 0;
+        continue;
+      }
+
+      // wait for an open or close or to be woken for a read
+      bl_queue_mpsc_wait(&thread->queue);
+      thread->idle = 0;
+      continue;
+    }
+
+    // do the work
+    switch (op->op_type) {
+      case IO_OP_TYPE_CLOSE:
+        process_op_close(op);
+        bl_atomic_decrement(&thread->pending);
+        break;
+
+      case IO_OP_TYPE_OPEN:
+        process_op_open(op);
+        bl_atomic_decrement(&thread->pending);
+        break;
+
+      case IO_OP_TYPE_READ:
+        process_op_read(thread, op);
+        bl_atomic_decrement(&thread->pending);
+        break;
+
+      case IO_OP_TYPE_WRITE:
+        process_op_write(op);
+        bl_atomic_decrement(&thread->pending);
+        break;
+
+      case IO_OP_TYPE_FLUSH:
+        process_op_flush(op);
+        bl_atomic_decrement(&thread->pending);
+        break;
+
+      default:
+        BL_FATAL("unhandled op type: %u", op->op_type);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+static IoOpImpl* create_op(IoOpType op_type, BLIoFile* file, const BLIoOpAttr* attr) {
+  // protect against being given a NULL attribute
+  if (!attr) {
+    attr = &s_default_op_attr;
+  }
+
+  // count the op's job against its queue now so waiting on the queue covers
+  // the read as well as the job
+  if (attr->job) {
+    bl_job_queue_reserve(attr->job_queue);
+  }
+
+  IoOpImpl* __restrict op = op_pool_pop();
+  op->attr            = *attr;
+  op->fulfilled_size  = 0;
+  op->offset          = 0;
+  op->requested_size  = 0;
+  op->buffer          = NULL;
+  op->file            = file;
+  op->status          = BL_IO_STATUS_PENDING;
+  op->op_type         = op_type;
+  op->complete        = 0;
+  op->waiter          = NULL;
+  op->next_parked     = NULL;
+  op->deadline_ns     = attr->deadline_ms ? bl_time_ns() + (uint64_t)attr->deadline_ms * 1000000ULL : 0;
+  op->buffers         = NULL;
+  op->buffer_count    = 0;
+  op->write_behind    = false;
+  op->cache_fill      = false;
+  op->bounce          = false;
+  return op;
+}
+
+//----------------------------------------------------------------------------
+// hands whatever is gathered in the file's write buffer to its write thread
+static void write_behind_flush(BLIoFile* file) {
+  if (file->write_buffer_used == 0) {
+    return;
+  }
+
+  // the op takes the buffer; the next gathered write starts a new one
+  IoOpImpl* op = create_op(IO_OP_TYPE_WRITE, file, NULL);
+  op->offset          = file->write_buffer_offset;
+  op->requested_size  = file->write_buffer_used;
+  op->buffer          = file->write_buffer;
+  op->write_behind    = true;
+  file->write_buffer      = NULL;
+  file->write_buffer_used = 0;
+
+  queue_op(op);
+}
+
+//----------------------------------------------------------------------------
+// checks whether any one of the ops is complete, or all of them. for any, index
+// is set to the first complete op. for all, index is the first op that may
+// still be pending and it's kept between calls since complete ops stay that
+// way.
+static bool ops_ready(BLIoOp** ops, uint32_t count, bool all, uint32_t* index) {
+  if (all) {
+    while (*index < count && ((IoOpImpl*)ops[*index])->complete) {
+      ++*index;
+    }
+    return *index == count;
+  }
+
+  for (uint32_t op_index = 0; op_index < count; ++op_index) {
+    if (((IoOpImpl*)ops[op_index])->complete) {
+      *index = op_index;
+      return true;
+    }
+  }
+  return false;
+}
+
+//----------------------------------------------------------------------------
+// sleeps until any one or all of the ops are complete, woken only by their own
+// completions. an op can only have one waiter at a time. a deadline of zero
+// waits forever. returns false if the deadline passed first.
+static bool wait_ops(BLIoOp** ops, uint32_t count, bool all, uint64_t deadline, uint32_t* index) {
+  BL_ASSERT(ops || count == 0);
+  BL_ASSERT(all || count > 0);
+
+  *index = 0;
+  if (ops_ready(ops, count, all, index)) {
+    bl_atomic_barrier();
+    return true;
+  }
+
+  // point the ops at the waiter. ops that have already completed can't count
+  // it down, so they're counted here instead.
+  IoWaiter waiter;
+  bl_event_count_create(&waiter.event);
+  waiter.remaining  = all ? (int32_t)count : 1;
+  waiter.released   = 0;
+  int32_t done_count = 0;
+  uint32_t attached_count = 0;
+  while ((attached_count < count) && (waiter.remaining > 0)) {
+    IoOpImpl* op = (IoOpImpl*)ops[attached_count++];
+    if (!bl_atomic_cas((void* volatile*)&op->waiter, NULL, &waiter)) {
+      BL_ASSERT(op->waiter == IO_WAITER_DONE);
+      ++done_count;
+      bl_atomic_decrement(&waiter.remaining);
+    }
+  }
+
+  // sleep until the last completion needed
+  while (waiter.remaining > 0) {
+    uint64_t now = 0;
+    if (deadline) {
+      now = bl_time_ns();
+      if (now >= deadline) {
+        break;
+      }
+    }
+    int32_t key = bl_event_count_prepare_wait(&waiter.event);
+    if (waiter.remaining <= 0) {
+      bl_event_count_cancel_wait(&waiter.event);
+      break;
+    }
+    if (deadline) {
+      bl_event_count_wait_timeout(&waiter.event, key, (deadline - now + 999999ULL) / 1000000ULL);
+    }
+    else {
+      bl_event_count_wait(&waiter.event, key);
+    }
+  }
+
+  // take the waiter back off the ops. any that completed in the meantime have
+  // it in hand, so wait for them to let go before it goes out of scope.
+  int32_t taken_count = -done_count;
+  for (uint32_t op_index = 0; op_index < attached_count; ++op_index) {
+    IoOpImpl* op = (IoOpImpl*)ops[op_index];
+    if (!bl_atomic_cas((void* volatile*)&op->waiter, &waiter, NULL)) {
+      ++taken_count;
+    }
+  }
+  while (waiter.released != taken_count) {
+    bl_thread_yield();
+  }
+  bl_event_count_destroy(&waiter.event);
+
+  // ops counted before they were reached may still be setting their flags
+  bool ready = ops_ready(ops, count, all, index);
+  while (!ready && (waiter.remaining <= 0)) {
+    bl_thread_yield();
+    ready = ops_ready(ops, count, all, index);
+  }
+
+  // don't let the results be read before the flags
+  bl_atomic_barrier();
+  return ready;
+}
+
+//----------------------------------------------------------------------------
+// the status of the first op that failed, or ok if none did
+static BLIoStatus ops_status(BLIoOp** ops, uint32_t count) {
+  for (uint32_t index = 0; index < count; ++index) {
+    if (ops[index]->status != BL_IO_STATUS_OK) {
+      return ops[index]->status;
+    }
+  }
+  return BL_IO_STATUS_OK;
+}
+
+
+//
+// shared functions
+//
+
+//------------------------------------------------------------------------------
+BLIoStatus io_status_from_errno(int err) {
+  switch (err) {
+    case EACCES:        // access denied
+    case EPERM:         // access denied (when trying to set atime?)
+      return BL_IO_STATUS_ERROR_ACCESS_DENIED;
+
+    case EMFILE:        // too many open files for the process
+    case ENFILE:        // too many open files for the OS
+      return BL_IO_STATUS_ERROR_TOO_MANY_OPEN_FILES;
+
+    case ENOENT:        // file not found
+      return BL_IO_STATUS_ERROR_NOT_FOUND;
+
+    case EBADF:         // not an open file descriptor
+      return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
+
+    case EEXIST:        // file already exists and mode wasn't setup to overwrite the file
+    case EFAULT:        // bad filename pointer
+    case EINVAL:        // bad mode argument
+    case EISDIR:        // filename is a directory
+    case ELOOP:         // symlink loop
+    case ENAMETOOLONG:  // filename is too long
+    case ENODEV:        // filename refers to a non-existent device
+    case ENOMEM:        // out of memory
+    case ENOSPC:        // no space left on device (for creating new files)
+    case ENOTDIR:       // tried to open as a directory but not filename is not a directory
+    case ENXIO:         // tried to open a special device file with wrong mode
+    case EOVERFLOW:     // file is too large
+    case EROFS:         // tried to open read-only filesystem with write mode
+    case ETXTBSY:       // filename is executable and already running when opened with write mode
+    case EWOULDBLOCK:   // O_NONBLOCK specified but is incompatible with file
+    default:
+      return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+BLIoFile* io_file_create(const char* file_name, bool writable, uint64_t write_buffer_size) {
+  BLIoFile* __restrict file = (BLIoFile*)bl_alloc(sizeof(BLIoFile), 8);
+  file->id            = (uint64_t)bl_atomic_increment(&s_next_file_id);
+  file->offset        = 0;
+  file->size          = 0;
+  file->opening       = true;
+  file->inflight      = 0;
+  file->parked_head   = NULL;
+  file->parked_tail   = NULL;
+  file->parked_close  = NULL;
+  file->pack          = NULL;
+  file->base_offset   = 0;
+  file->unbuffered    = false;
+  file->direct_alignment = 0;
+  file->compressed    = false;
+  file->block_size    = 0;
+  file->block_count   = 0;
+  file->block_offsets = NULL;
+  file->writable      = writable;
+  file->write_thread  = writable ? least_busy_thread() : 0;
+  file->write_error   = BL_IO_STATUS_OK;
+  file->write_buffer  = NULL;
+  file->write_buffer_capacity = write_buffer_size;
+  file->write_buffer_offset   = 0;
+  file->write_buffer_used     = 0;
+  bl_mutex_create(&file->gate_mutex);
+  io_platform_file_init(file);
+  bl_strcpy(file->file_name, file_name, BL_IO_MAX_FILE_NAME_LENGTH);
+  return file;
+}
+
+//------------------------------------------------------------------------------
+void io_read_complete(IoOpImpl* op, BLIoStatus status, uint64_t fulfilled_size) {
+  BLIoFile* file = op->file;
+  op->fulfilled_size = fulfilled_size;
+  mark_op_complete(op, status);
+  release_file_gate(file, IO_OP_TYPE_READ);
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+void bl_io_lib_initialize(const BLIoLibInitParams* params) {
+  // use as many threads as asked for, within what the platform can handle
+  uint32_t thread_count = params ? params->thread_count : 1;
+  uint32_t async_queue_depth = params ? params->async_queue_depth : BL_IO_DEFAULT_ASYNC_QUEUE_DEPTH;
+  uint32_t cache_block_count = params ? params->cache_block_count : 0;
+  uint32_t max_thread_count = io_platform_max_thread_count();
+  if (thread_count < 1) {
+    thread_count = 1;
+  }
+  if (thread_count > max_thread_count) {
+    thread_count = max_thread_count;
+  }
+
+  // setup the op pool; it fills on first use
+  s_op_pool.free_head = 0;
+  s_op_pool.slab_count = 0;
+  bl_mutex_create(&s_op_pool.grow_mutex);
+  io_sched_initialize();
+  io_cache_initialize(cache_block_count);
+  io_compress_initialize(params ? params->decompress_on_jobs : false);
+
+  // startup the worker threads, each with its own work queue
+  s_thread_quit = false;
+  s_thread_count = thread_count;
+  s_threads = (IoThread*)bl_alloc(sizeof(IoThread) * thread_count, 128);
+  for (uint32_t index = 0; index < thread_count; ++index) {
+    IoThread* thread = s_threads + index;
+    bl_queue_mpsc_init(&thread->queue);
+    thread->pending = 0;
+    thread->idle = 0;
+    thread->gap_buffer = (uint8_t*)bl_alloc(IO_COALESCE_MAX_GAP, 64);
+    thread->cache_buffer = cache_block_count ? (uint8_t*)bl_alloc(IO_CACHE_MAX_FILL_SIZE, 64) : NULL;
+    thread->bounce_buffer = NULL;
+    bl_thread_create(&thread->thread, &io_thread_proc, thread);
+  }
+
+  // reads fall back to the threads if the platform has no async path
+  s_async_reads = (async_queue_depth > 0) && io_platform_async_initialize(async_queue_depth);
+}
+
+//------------------------------------------------------------------------------
+void bl_io_lib_finalize() {
+  // stop the async path first; it has nothing to hand back to the threads
+  if (s_async_reads) {
+    io_platform_async_finalize();
+    s_async_reads = false;
+  }
+
+  // blocks still decompressing may yet hand a close to the threads
+  io_compress_finalize();
+
+  // signal the worker threads to exit and wait
+  s_thread_quit = true;
+  for (uint32_t index = 0; index < s_thread_count; ++index) {
+    bl_queue_mpsc_wake(&s_threads[index].queue);
+  }
+  for (uint32_t index = 0; index < s_thread_count; ++index) {
+    bl_thread_join(&s_threads[index].thread);
+    bl_queue_mpsc_destroy(&s_threads[index].queue);
+    bl_free(s_threads[index].gap_buffer);
+    bl_free(s_threads[index].cache_buffer);
+    bl_free(s_threads[index].bounce_buffer);
+  }
+
+  bl_free(s_threads);
+  s_threads = NULL;
+  s_thread_count = 0;
+
+  // every op must have been deleted by now
+  for (int32_t index = 0; index < s_op_pool.slab_count; ++index) {
+    bl_free(s_op_pool.slabs[index]);
+  }
+  s_op_pool.slab_count = 0;
+  s_op_pool.free_head = 0;
+  bl_mutex_destroy(&s_op_pool.grow_mutex);
+  io_sched_finalize();
+  io_cache_finalize();
+}
+
+//------------------------------------------------------------------------------
+void bl_io_cache_get_stats(BLIoCacheStats* stats) {
+  BL_ASSERT(stats);
+  io_cache_get_stats(stats);
+}
+
+//------------------------------------------------------------------------------
+BLIoOp* bl_io_file_open(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file) {
+  BL_ASSERT(file_name);
+  BL_ASSERT(file);
+
+  // create the file handle
+  BLIoFile* new_file = io_file_create(file_name, false, 0);
+  *file = new_file;
+
+  // define the async op
+  IoOpImpl* op = create_op(IO_OP_TYPE_OPEN, new_file, attr);
+
+  queue_op(op);
+  return op;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_file_open_sync(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file, uint64_t* file_size) {
+  BL_ASSERT(file_name);
+  BL_ASSERT(file);
+
+  // handle file_size optional argument as NULL
+  uint64_t local_file_size;
+  if (!file_size) {
+    file_size = &local_file_size;
+  }
+
+  BLIoOp* op = bl_io_file_open(file_name, attr, file);
+  BLIoStatus status = bl_io_op_wait(op);
+  *file_size = op->fulfilled_size;
+  bl_io_op_delete(op);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+BLIoOp* bl_io_file_open_unbuffered(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file) {
+  BL_ASSERT(file_name);
+  BL_ASSERT(file);
+
+  // create the file handle
+  BLIoFile* new_file = io_file_create(file_name, false, 0);
+  new_file->unbuffered = true;
+  *file = new_file;
+
+  // define the async op
+  IoOpImpl* op = create_op(IO_OP_TYPE_OPEN, new_file, attr);
+
+  queue_op(op);
+  return op;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_file_open_unbuffered_sync(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file, uint64_t* file_size) {
+  BL_ASSERT(file_name);
+  BL_ASSERT(file);
+
+  // handle file_size optional argument as NULL
+  uint64_t local_file_size;
+  if (!file_size) {
+    file_size = &local_file_size;
+  }
+
+  BLIoOp* op = bl_io_file_open_unbuffered(file_name, attr, file);
+  BLIoStatus status = bl_io_op_wait(op);
+  *file_size = op->fulfilled_size;
+  bl_io_op_delete(op);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+BLIoOp* bl_io_file_open_compressed(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file) {
+  BL_ASSERT(file_name);
+  BL_ASSERT(file);
+
+  // create the file handle
+  BLIoFile* new_file = io_file_create(file_name, false, 0);
+  new_file->compressed = true;
+  *file = new_file;
+
+  // define the async op
+  IoOpImpl* op = create_op(IO_OP_TYPE_OPEN, new_file, attr);
+
+  queue_op(op);
+  return op;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_file_open_compressed_sync(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file, uint64_t* file_size) {
+  BL_ASSERT(file_name);
+  BL_ASSERT(file);
+
+  // handle file_size optional argument as NULL
+  uint64_t local_file_size;
+  if (!file_size) {
+    file_size = &local_file_size;
+  }
+
+  BLIoOp* op = bl_io_file_open_compressed(file_name, attr, file);
+  BLIoStatus status = bl_io_op_wait(op);
+  *file_size = op->fulfilled_size;
+  bl_io_op_delete(op);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+BLIoOp* bl_io_file_open_write(const char* file_name, const BLIoOpAttr* attr, uint64_t write_buffer_size, BLIoFile** file) {
+  BL_ASSERT(file_name);
+  BL_ASSERT(file);
+
+  // create the file handle
+  BLIoFile* new_file = io_file_create(file_name, true, write_buffer_size);
+  *file = new_file;
+
+  // define the async op
+  IoOpImpl* op = create_op(IO_OP_TYPE_OPEN, new_file, attr);
+
+  queue_op(op);
+  return op;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_file_open_write_sync(const char* file_name, const BLIoOpAttr* attr, uint64_t write_buffer_size, BLIoFile** file) {
+  BL_ASSERT(file_name);
+  BL_ASSERT(file);
+
+  BLIoOp* op = bl_io_file_open_write(file_name, attr, write_buffer_size, file);
+  BLIoStatus status = bl_io_op_wait(op);
+  bl_io_op_delete(op);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+BLIoOp* bl_io_file_close(BLIoFile* file, const BLIoOpAttr* attr) {
+  BL_ASSERT(file);
+
+  // gathered writes go out ahead of the close
+  write_behind_flush(file);
+
+  // define the async op
+  IoOpImpl* op = create_op(IO_OP_TYPE_CLOSE, file, attr);
+
+  queue_op(op);
+  return op;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_file_close_sync(BLIoFile* file, const BLIoOpAttr* attr) {
+  BL_ASSERT(file);
+
+  BLIoOp* op = bl_io_file_close(file, attr);
+  BLIoStatus status = bl_io_op_wait(op);
+  bl_io_op_delete(op);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+BLIoOp* bl_io_file_read(BLIoFile* file, const BLIoOpAttr* attr, void* dest, uint64_t size) {
+  BL_ASSERT(file);
+  BL_ASSERT(dest || size == 0);
+
+  // define the async op
+  IoOpImpl* op = create_op(IO_OP_TYPE_READ, file, attr);
+  op->offset          = file->offset;
+  op->requested_size  = size;
+  op->buffer          = dest;
+
+  // move the file offset along for the next op
+  file->offset += size;
+
+  queue_op(op);
+  return op;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_file_read_sync(BLIoFile* file, const BLIoOpAttr* attr, void* dest, uint64_t size) {
+  BL_ASSERT(file);
+  BL_ASSERT(dest || size == 0);
+
+  BLIoOp* op = bl_io_file_read(file, attr, dest, size);
+  BLIoStatus status = bl_io_op_wait(op);
+  bl_io_op_delete(op);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+BLIoOp* bl_io_file_readv(BLIoFile* file, const BLIoOpAttr* attr, const BLIoBuffer* buffers, uint32_t buffer_count) {
+  BL_ASSERT(file);
+  BL_ASSERT(buffers || buffer_count == 0);
+  BL_ASSERT(buffer_count <= BL_IO_MAX_READ_BUFFERS);
+
+  uint64_t size = 0;
+  for (uint32_t index = 0; index < buffer_count; ++index) {
+    BL_ASSERT(buffers[index].data || buffers[index].size == 0);
+    size += buffers[index].size;
+  }
+
+  // define the async op
+  IoOpImpl* op = create_op(IO_OP_TYPE_READ, file, attr);
+  op->offset          = file->offset;
+  op->requested_size  = size;
+  op->buffers         = buffers;
+  op->buffer_count    = buffer_count;
+
+  // move the file offset along for the next op
+  file->offset += size;
+
+  queue_op(op);
+  return op;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_file_readv_sync(BLIoFile* file, const BLIoOpAttr* attr, const BLIoBuffer* buffers, uint32_t buffer_count) {
+  BL_ASSERT(file);
+  BL_ASSERT(buffers || buffer_count == 0);
+
+  BLIoOp* op = bl_io_file_readv(file, attr, buffers, buffer_count);
+  BLIoStatus status = bl_io_op_wait(op);
+  bl_io_op_delete(op);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+BLIoOp* bl_io_file_write(BLIoFile* file, const BLIoOpAttr* attr, const void* src, uint64_t size) {
+  BL_ASSERT(file);
+  BL_ASSERT(file->writable);
+  BL_ASSERT(src || size == 0);
+
+  uint64_t offset = file->offset;
+  file->offset += size;
+
+  // small writes are gathered into the write buffer as long as they carry on
+  // from what is already there
+  if (size < file->write_buffer_capacity) {
+    bool follows = (offset == file->write_buffer_offset + file->write_buffer_used);
+    if (!follows || (file->write_buffer_used + size > file->write_buffer_capacity)) {
+      write_behind_flush(file);
+    }
+    if (!file->write_buffer) {
+      file->write_buffer = (uint8_t*)bl_alloc(file->write_buffer_capacity, 64);
+    }
+    if (file->write_buffer_used == 0) {
+      file->write_buffer_offset = offset;
+    }
+    memcpy(file->write_buffer + file->write_buffer_used, src, (size_t)size);
+    file->write_buffer_used += size;
+
+    // the data is safe in the buffer so the op is done
+    IoOpImpl* op = create_op(IO_OP_TYPE_WRITE, file, attr);
+    op->offset          = offset;
+    op->requested_size  = size;
+    op->fulfilled_size  = size;
+    mark_op_complete(op, BL_IO_STATUS_OK);
+    return op;
+  }
+
+  // bigger writes go straight out, behind anything already gathered
+  write_behind_flush(file);
+
+  // define the async op
+  IoOpImpl* op = create_op(IO_OP_TYPE_WRITE, file, attr);
+  op->offset          = offset;
+  op->requested_size  = size;
+  op->buffer          = (void*)src;
+
+  queue_op(op);
+  return op;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_file_write_sync(BLIoFile* file, const BLIoOpAttr* attr, const void* src, uint64_t size) {
+  BL_ASSERT(file);
+  BL_ASSERT(src || size == 0);
+
+  BLIoOp* op = bl_io_file_write(file, attr, src, size);
+  BLIoStatus status = bl_io_op_wait(op);
+  bl_io_op_delete(op);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+BLIoOp* bl_io_file_flush(BLIoFile* file, const BLIoOpAttr* attr) {
+  BL_ASSERT(file);
+  BL_ASSERT(file->writable);
+
+  write_behind_flush(file);
+
+  // define the async op
+  IoOpImpl* op = create_op(IO_OP_TYPE_FLUSH, file, attr);
+
+  queue_op(op);
+  return op;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_file_flush_sync(BLIoFile* file, const BLIoOpAttr* attr) {
+  BL_ASSERT(file);
+
+  BLIoOp* op = bl_io_file_flush(file, attr);
+  BLIoStatus status = bl_io_op_wait(op);
+  bl_io_op_delete(op);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+void bl_io_file_seek_sync(BLIoFile* file, uint64_t offset) {
+  BL_ASSERT(file);
+
+  file->offset = offset;
+}
+
+//------------------------------------------------------------------------------
+uint64_t bl_io_file_tell_sync(const BLIoFile* file) {
+  BL_ASSERT(file);
+  return file->offset;
+}
+
+//------------------------------------------------------------------------------
+const char* bl_io_file_get_filename(const BLIoFile* file) {
+  BL_ASSERT(file);
+  return file->file_name;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_file_map(BLIoFile* file, uint64_t offset, uint64_t size, uint32_t advice, BLIoMapping* mapping) {
+  BL_ASSERT(file);
+  BL_ASSERT(!file->compressed);
+  BL_ASSERT(mapping);
+
+  // the range must lie inside the file
+  if (offset > file->size) {
+    return BL_IO_STATUS_ERROR_EOF;
+  }
+  if (size == 0) {
+    size = file->size - offset;
+  }
+  if (size > file->size - offset) {
+    return BL_IO_STATUS_ERROR_EOF;
+  }
+
+  // an empty view needs no pages
+  if (size == 0) {
+    mapping->data       = NULL;
+    mapping->size       = 0;
+    mapping->base       = NULL;
+    mapping->base_size  = 0;
+    return BL_IO_STATUS_OK;
+  }
+
+  return io_platform_map(file, file->base_offset + offset, size, advice, mapping);
+}
+
+//------------------------------------------------------------------------------
+void bl_io_file_unmap(BLIoMapping* mapping) {
+  BL_ASSERT(mapping);
+
+  if (mapping->base) {
+    io_platform_unmap(mapping);
+  }
+  mapping->data       = NULL;
+  mapping->size       = 0;
+  mapping->base       = NULL;
+  mapping->base_size  = 0;
+}
+
+//------------------------------------------------------------------------------
+BLIoCompletionQueue* bl_io_completion_queue_create() {
+  BLIoCompletionQueue* queue = (BLIoCompletionQueue*)bl_alloc(sizeof(BLIoCompletionQueue), 128);
+  bl_queue_mpsc_init(&queue->queue);
+  return queue;
+}
+
+//------------------------------------------------------------------------------
+void bl_io_completion_queue_destroy(BLIoCompletionQueue* queue) {
+  BL_ASSERT(queue);
+
+  bl_queue_mpsc_destroy(&queue->queue);
+  bl_free(queue);
+}
+
+//------------------------------------------------------------------------------
+uint32_t bl_io_completion_queue_drain(BLIoCompletionQueue* queue, BLIoOp** ops, uint32_t max_count) {
+  BL_ASSERT(queue);
+  BL_ASSERT(ops || max_count == 0);
+
+  uint32_t count = 0;
+  while (count < max_count) {
+    BLQueueMPSCNode* node = bl_queue_mpsc_pop(&queue->queue);
+    if (!node) {
+      break;
+    }
+    ops[count++] = static_cast<IoOpImpl*>(node);
+  }
+  return count;
+}
+
+//------------------------------------------------------------------------------
+void bl_io_completion_queue_wait(BLIoCompletionQueue* queue) {
+  BL_ASSERT(queue);
+  bl_queue_mpsc_wait(&queue->queue);
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_op_wait(BLIoOp* op) {
+  BL_ASSERT(op);
+  uint32_t index;
+  wait_ops(&op, 1, true, 0, &index);
+  return op->status;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_op_wait_timeout(BLIoOp* op, uint32_t timeout_ms) {
+  BL_ASSERT(op);
+  uint32_t index;
+  if (!wait_ops(&op, 1, true, bl_time_ns() + (uint64_t)timeout_ms * 1000000ULL, &index)) {
+    return BL_IO_STATUS_PENDING;
+  }
+  return op->status;
+}
+
+//------------------------------------------------------------------------------
+uint32_t bl_io_op_wait_any(BLIoOp** ops, uint32_t count) {
+  uint32_t index;
+  wait_ops(ops, count, false, 0, &index);
+  return index;
+}
+
+//------------------------------------------------------------------------------
+uint32_t bl_io_op_wait_any_timeout(BLIoOp** ops, uint32_t count, uint32_t timeout_ms) {
+  uint32_t index;
+  if (!wait_ops(ops, count, false, bl_time_ns() + (uint64_t)timeout_ms * 1000000ULL, &index)) {
+    return count;
+  }
+  return index;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_op_wait_all(BLIoOp** ops, uint32_t count) {
+  uint32_t index;
+  wait_ops(ops, count, true, 0, &index);
+  return ops_status(ops, count);
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_op_wait_all_timeout(BLIoOp** ops, uint32_t count, uint32_t timeout_ms) {
+  uint32_t index;
+  if (!wait_ops(ops, count, true, bl_time_ns() + (uint64_t)timeout_ms * 1000000ULL, &index)) {
+    return BL_IO_STATUS_PENDING;
+  }
+  return ops_status(ops, count);
+}
+
+//------------------------------------------------------------------------------
+bool bl_io_op_cancel(BLIoOp* op) {
+  BL_ASSERT(op);
+  IoOpImpl* op_impl = (IoOpImpl*)op;
+
+  // only reads still waiting in the scheduler can be taken back. once it's
+  // out, the read is finished like any other.
+  if ((op_impl->op_type != IO_OP_TYPE_READ) || op_impl->complete || !io_sched_cancel(op_impl)) {
+    return false;
+  }
+  io_read_complete(op_impl, BL_IO_STATUS_CANCELLED, 0);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool bl_io_op_set_priority(BLIoOp* op, uint32_t priority) {
+  BL_ASSERT(op);
+  IoOpImpl* op_impl = (IoOpImpl*)op;
+
+  if ((op_impl->op_type != IO_OP_TYPE_READ) || op_impl->complete) {
+    return false;
+  }
+  return io_sched_set_priority(op_impl, priority);
+}
+
+//------------------------------------------------------------------------------
+void bl_io_op_delete(BLIoOp* op) {
+  BL_ASSERT(op);
+  IoOpImpl* op_impl = (IoOpImpl*)op;
+
+  bl_io_op_wait(op);
+  op_pool_push(op_impl, op_impl);
+}
@@ -23,499 +23,250 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
-#include "../../io.h"
-#include <cstdio>
+#include "../io_int.h"
 #include <cerrno>
-#include <queue>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 //
-// constants
-//
-
-enum IoOpType {
-  IO_OP_TYPE_CLOSE,
-  IO_OP_TYPE_OPEN,
-  IO_OP_TYPE_READ,
-};
-
-
-//
-// local types
-//
-
-struct IoOpImpl : public BLIoOp {
-  BLMutex   complete_mutex;
-  BLCond    complete_cond;
-  IoOpType  op_type;
-};
-
-struct BLIoFile {
-  char      file_name[BL_IO_MAX_FILE_NAME_LENGTH];
-  uint64_t  offset;
-  FILE*     handle;
-};
-
-
-//
-// local vars
-//
-
-static std::queue<IoOpImpl*>  s_work_queue;
-static BLMutex                s_work_queue_mutex;
-static BLCond                 s_work_queue_not_empty_cond;
-
-static volatile bool          s_thread_quit;
-static BLThread               s_thread;
-
-// setup a default op attribute
-static BLIoOpAttr             s_default_op_attr = {
-  NULL,
-  NULL
-};
-
-
-//
-// local functions
+// platform layer
 //
 
 //----------------------------------------------------------------------------
-static void queue_op(IoOpImpl* op) {
-  // queue the op
-  bl_mutex_lock(&s_work_queue_mutex);
-  {
-    s_work_queue.push(op);
-  }
-  bl_mutex_unlock(&s_work_queue_mutex);
-
-  // wake the worker thread if needed
-  bl_cond_notify_one(&s_work_queue_not_empty_cond);
+uint32_t io_platform_max_thread_count() {
+  // a FILE* carries a single seek position, so reads on one file can't run
+  // concurrently. keep to a single thread until this moves to pread.
+  return 1;
 }
 
 //----------------------------------------------------------------------------
-// called whenever an op completes whether successfully or with error.
-// this will signal completion of the op and issue any associated
-// callbacks.
-static void mark_op_complete(IoOpImpl* op, BLIoStatus status) {
-  // update the op's status
-  op->status = status;
-
-  // signal completion of the op
-  bl_cond_notify_all(&op->complete_cond);
-
-  // issue the callback if requested
-  if (op->attr.callback) {
-    op->attr.callback(op, op->attr.context);
-  }
+void io_platform_file_init(BLIoFile* file) {
+  file->platform.handle = NULL;
 }
 
 //----------------------------------------------------------------------------
-static void process_op_open(IoOpImpl* op) {
+BLIoStatus io_platform_open(BLIoFile* file, uint64_t* file_size) {
   // verify file is not already open
-  BLIoFile* file = op->file;
-  if (file->handle != NULL) {
-    mark_op_complete(op, BL_IO_STATUS_ERROR_BAD_FILE_HANDLE);
-    return;
+  if (file->platform.handle != NULL) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
   }
 
   // open the file
-  file->handle = fopen(op->file->file_name, "rb");
-  if (!file->handle) {
-    // determine the error
-    BLIoStatus status;
-    switch (errno) {
-      case EACCES:        // access denied
-      case EPERM:         // access denied (when trying to set atime?)
-        status = BL_IO_STATUS_ERROR_ACCESS_DENIED;
-        break;
-      case EMFILE:        // too many open files for the process
-      case ENFILE:        // too many open files for the OS
-        status = BL_IO_STATUS_ERROR_TOO_MANY_OPEN_FILES;
-        break;
-      case ENOENT:        // file not found
-        status = BL_IO_STATUS_ERROR_NOT_FOUND;
-        break;
-      case EEXIST:        // file already exists and mode wasn't setup to overwrite the file
-      case EFAULT:        // bad filename pointer
-      case EINVAL:        // bad mode argument
-      case EISDIR:        // filename is a directory
-      case ELOOP:         // symlink loop
-      case ENAMETOOLONG:  // filename is too long
-      case ENODEV:        // filename refers to a non-existent device
-      case ENOMEM:        // out of memory
-      case ENOSPC:        // no space left on device (for creating new files)
-      case ENOTDIR:       // tried to open as a directory but not filename is not a directory
-      case ENXIO:         // tried to open a special device file with wrong mode
-      case EOVERFLOW:     // file is too large
-      case EROFS:         // tried to open read-only filesystem with write mode
-      case ETXTBSY:       // filename is executable and already running when opened with write mode
-      case EWOULDBLOCK:   // O_NONBLOCK specified but is incompatible with file
-      default:
-        status = BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
-        break;
-    }
+  FILE* handle = fopen(file->file_name, file->writable ? "wb" : "rb");
+  if (!handle) {
+    return io_status_from_errno(errno);
+  }
+  file->platform.handle = handle;
 
-    mark_op_complete(op, status);
-    return;
+  // F_NOCACHE has no alignment rules, so unbuffered reads just skip stdio's
+  // buffer as well
+  if (file->unbuffered) {
+    setvbuf(handle, NULL, _IONBF, 0);
+    fcntl(fileno(handle), F_NOCACHE, 1);
   }
-  else {
-    int ret;
-
-    // get the file size by seeking to the end of the file and back
-    // to the original position.
-    long curr_pos = ftell(file->handle);
-    if (curr_pos == -1L) {
-      mark_op_complete(op, BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC);
-      return;
-    }
-    ret = fseek(file->handle, 0, SEEK_END);
-    if (ret == -1) {
-      mark_op_complete(op, BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC);
-      return;
-    }
-    long end_pos = ftell(file->handle);
-    if (end_pos == -1L) {
-      mark_op_complete(op, BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC);
-      return;
-    }
-    ret = fseek(file->handle, curr_pos, SEEK_SET);
-    if (ret == -1) {
-      mark_op_complete(op, BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC);
-      return;
-    }
+  file->direct_alignment = 0;
+
+  int ret;
 
-    // op is complete
-    op->fulfilled_size = (uint64_t)end_pos;
-    mark_op_complete(op, BL_IO_STATUS_OK);
+  // get the file size by seeking to the end of the file and back
+  // to the original position.
+  long curr_pos = ftell(handle);
+  if (curr_pos == -1L) {
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
+  }
+  ret = fseek(handle, 0, SEEK_END);
+  if (ret == -1) {
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
+  }
+  long end_pos = ftell(handle);
+  if (end_pos == -1L) {
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
   }
+  ret = fseek(handle, curr_pos, SEEK_SET);
+  if (ret == -1) {
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
+  }
+
+  *file_size = (uint64_t)end_pos;
+  return BL_IO_STATUS_OK;
 }
 
 //----------------------------------------------------------------------------
-static void process_op_close(IoOpImpl* op) {
+BLIoStatus io_platform_close(BLIoFile* file) {
   // verify the file is open
-  BLIoFile* file = op->file;
-  if (!file->handle) {
-    mark_op_complete(op, BL_IO_STATUS_ERROR_BAD_FILE_HANDLE);
-    return;
+  if (!file->platform.handle) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
   }
 
   int ret;
-  ret = fclose(file->handle);
+  ret = fclose(file->platform.handle);
   if (ret == -1) {
-    mark_op_complete(op, BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC);
-    return;
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
   }
 
-  // success
-  mark_op_complete(op, BL_IO_STATUS_OK);
-  bl_free(file);
+  file->platform.handle = NULL;
+  return BL_IO_STATUS_OK;
 }
 
 //----------------------------------------------------------------------------
-static void process_op_read(IoOpImpl* op) {
+BLIoStatus io_platform_read(BLIoFile* file, void* buffer, uint64_t offset, uint64_t size, uint64_t* fulfilled_size) {
   // verify the file is open
-  BLIoFile* file = op->file;
-  if (!file->handle) {
-    mark_op_complete(op, BL_IO_STATUS_ERROR_BAD_FILE_HANDLE);
-    return;
+  FILE* handle = file->platform.handle;
+  if (!handle) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
   }
 
   // seek to the appropriate offset
   int ret;
-  ret = fseek(file->handle, op->offset, SEEK_SET);
+  ret = fseek(handle, offset, SEEK_SET);
   if (ret == -1) {
-    BLIoStatus status;
-    switch (errno) {
-      // TODO: check for specific errors
-      default:
-        status = BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
-        break;
-    }
-
-    mark_op_complete(op, status);
-    return;
+    // TODO: check for specific errors
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
   }
 
   // do the read
   size_t bytes_read;
-  size_t bytes_requested = (size_t)op->requested_size;
-  bytes_read = fread(op->buffer, 1, bytes_requested, file->handle);
-  op->fulfilled_size = (uint64_t)bytes_read;
+  size_t bytes_requested = (size_t)size;
+  bytes_read = fread(buffer, 1, bytes_requested, handle);
+  *fulfilled_size = (uint64_t)bytes_read;
 
   // check for eof or error
-  BLIoStatus status;
-  if (0 != feof(file->handle)) {
-    status = BL_IO_STATUS_ERROR_EOF;
-  }
-  else if (0 != ferror(file->handle)) {
-    status = BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
+  if (0 != feof(handle)) {
+    return BL_IO_STATUS_ERROR_EOF;
   }
-  else {
-    status = BL_IO_STATUS_OK;
+  else if (0 != ferror(handle)) {
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
   }
-  op->status = status;
-  mark_op_complete(op, status);
+  return BL_IO_STATUS_OK;
 }
 
 //----------------------------------------------------------------------------
-static void io_thread_proc(void*) {
-  bl_thread_set_name("io");
-  while (!s_thread_quit) {
-    // grab the next work item off the queue
-    IoOpImpl* op;
-
-    bl_mutex_lock(&s_work_queue_mutex);
-    {
-      // wait while the queue is empty
-      while (s_work_queue.empty() && !s_thread_quit) {
-        bl_cond_wait(&s_work_queue_not_empty_cond, &s_work_queue_mutex);
-      }
-
-      // kill the thread if the queue is empty and we need to quit
-      if (s_thread_quit && s_work_queue.empty()) {
-        bl_mutex_unlock(&s_work_queue_mutex);
-        break;
-      }
-
-      // pull an item off the queue
-      BL_ASSERT(!s_work_queue.empty());
-      op = s_work_queue.front();
-      s_work_queue.pop();
-    }
-    bl_mutex_unlock(&s_work_queue_mutex);
-
-    // do the work
-    switch (op->op_type) {
-      case IO_OP_TYPE_CLOSE:
-        process_op_close(op);
-        break;
-
-      case IO_OP_TYPE_OPEN:
-        process_op_open(op);
-        break;
+BLIoStatus io_platform_readv(BLIoFile* file, uint64_t offset, const BLIoBuffer* buffers, uint32_t buffer_count, uint64_t* fulfilled_size) {
+  // verify the file is open
+  FILE* handle = file->platform.handle;
+  if (!handle) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
+  }
 
-      case IO_OP_TYPE_READ:
-        process_op_read(op);
-        break;
+  // seek once; the pieces are contiguous in the file
+  int ret;
+  ret = fseek(handle, offset, SEEK_SET);
+  if (ret == -1) {
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
+  }
 
-      default:
-        BL_FATAL("unhandled op type: %u", op->op_type);
+  // fill each piece in turn, stopping at the first short read
+  uint64_t total = 0;
+  for (uint32_t index = 0; index < buffer_count; ++index) {
+    size_t bytes_requested = (size_t)buffers[index].size;
+    size_t bytes_read = fread(buffers[index].data, 1, bytes_requested, handle);
+    total += (uint64_t)bytes_read;
+    if (bytes_read != bytes_requested) {
+      break;
     }
   }
-}
+  *fulfilled_size = total;
 
-
-//
-// exported functions
-//
-
-//------------------------------------------------------------------------------
-void bl_io_lib_initialize() {
-  // init the sync primitives
-  bl_mutex_create(&s_work_queue_mutex);
-  bl_cond_create(&s_work_queue_not_empty_cond);
-
-  // startup the worker thread
-  s_thread_quit = false;
-  bl_thread_create(&s_thread, &io_thread_proc, NULL);
-}
-
-//------------------------------------------------------------------------------
-void bl_io_lib_finalize() {
-  // signal the worker thread to exit and wait
-  s_thread_quit = true;
-  bl_cond_notify_all(&s_work_queue_not_empty_cond);
-  bl_thread_join(&s_thread);
-
-  // cleanup sync primitives
-  bl_cond_destroy(&s_work_queue_not_empty_cond);
-  bl_mutex_destroy(&s_work_queue_mutex);
-}
-
-//------------------------------------------------------------------------------
-BLIoOp* bl_io_file_open(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file) {
-  BL_ASSERT(file_name);
-  BL_ASSERT(file);
-
-  // protect against being given a NULL attribute
-  if (!attr) {
-    attr = &s_default_op_attr;
+  // check for eof or error
+  if (0 != feof(handle)) {
+    return BL_IO_STATUS_ERROR_EOF;
   }
-
-  // create the file handle
-  BLIoFile* __restrict new_file = (BLIoFile*)bl_alloc(sizeof(BLIoFile), 4);
-  new_file->offset = 0;
-  new_file->handle = NULL;
-  bl_strcpy(new_file->file_name, file_name, BL_IO_MAX_FILE_NAME_LENGTH);
-  *file = new_file;
-
-  // define the async op
-  IoOpImpl* __restrict op = (IoOpImpl*)bl_alloc(sizeof(IoOpImpl), 4);
-  op->attr            = *attr;
-  op->fulfilled_size  = 0;
-  op->offset          = 0;
-  op->requested_size  = 0;
-  op->buffer          = NULL;
-  op->file            = new_file;
-  op->status          = BL_IO_STATUS_PENDING;
-  op->op_type         = IO_OP_TYPE_OPEN;
-  bl_mutex_create(&op->complete_mutex);
-  bl_cond_create(&op->complete_cond);
-
-  queue_op(op);
-  return op;
-}
-
-//------------------------------------------------------------------------------
-BLIoStatus bl_io_file_open_sync(const char* file_name, const BLIoOpAttr* attr, BLIoFile** file, uint64_t* file_size) {
-  BL_ASSERT(file_name);
-  BL_ASSERT(file);
-
-  // handle file_size optional argument as NULL
-  uint64_t local_file_size;
-  if (!file_size) {
-    file_size = &local_file_size;
+  else if (0 != ferror(handle)) {
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
   }
-
-  BLIoOp* op = bl_io_file_open(file_name, attr, file);
-  BLIoStatus status = bl_io_op_wait(op);
-  *file_size = op->fulfilled_size;
-  bl_io_op_delete(op);
-  return status;
+  return BL_IO_STATUS_OK;
 }
 
-//------------------------------------------------------------------------------
-BLIoOp* bl_io_file_close(BLIoFile* file, const BLIoOpAttr* attr) {
-  BL_ASSERT(file);
-
-  // protect against being given a NULL attribute
-  if (!attr) {
-    attr = &s_default_op_attr;
+//----------------------------------------------------------------------------
+BLIoStatus io_platform_write(BLIoFile* file, const void* buffer, uint64_t offset, uint64_t size, uint64_t* fulfilled_size) {
+  // verify the file is open
+  FILE* handle = file->platform.handle;
+  if (!handle) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
   }
 
-  // define the async op
-  IoOpImpl* __restrict op = (IoOpImpl*)bl_alloc(sizeof(IoOpImpl), 4);
-  op->attr            = *attr;
-  op->fulfilled_size  = 0;
-  op->offset          = 0;
-  op->requested_size  = 0;
-  op->buffer          = NULL;
-  op->file            = file;
-  op->status          = BL_IO_STATUS_PENDING;
-  op->op_type         = IO_OP_TYPE_CLOSE;
-  bl_mutex_create(&op->complete_mutex);
-  bl_cond_create(&op->complete_cond);
-
-  queue_op(op);
-  return op;
-}
-
-//------------------------------------------------------------------------------
-BLIoStatus bl_io_file_close_sync(BLIoFile* file, const BLIoOpAttr* attr) {
-  BL_ASSERT(file);
-
-  BLIoOp* op = bl_io_file_close(file, attr);
-  BLIoStatus status = bl_io_op_wait(op);
-  bl_io_op_delete(op);
-  return status;
-}
-
-//------------------------------------------------------------------------------
-BLIoOp* bl_io_file_read(BLIoFile* file, const BLIoOpAttr* attr, void* dest, uint64_t size) {
-  BL_ASSERT(file);
-  BL_ASSERT(dest || size == 0);
-
-  // protect against being given a NULL attribute
-  if (!attr) {
-    attr = &s_default_op_attr;
+  // seek to the appropriate offset
+  int ret;
+  ret = fseek(handle, offset, SEEK_SET);
+  if (ret == -1) {
+    return BL_IO_STATUS_ERROR_PLATFORM_SPECIFIC;
   }
 
-  // define the async op
-  IoOpImpl* __restrict op = (IoOpImpl*)bl_alloc(sizeof(IoOpImpl), 4);
-  op->attr            = *attr;
-  op->fulfilled_size  = 0;
-  op->offset          = file->offset;
-  op->requested_size  = size;
-  op->buffer          = dest;
-  op->file            = file;
-  op->status          = BL_IO_STATUS_PENDING;
-  op->op_type         = IO_OP_TYPE_READ;
-  bl_mutex_create(&op->complete_mutex);
-  bl_cond_create(&op->complete_cond);
-
-  // move the file offset along for the next op
-  file->offset += size;
-
-  queue_op(op);
-  return op;
+  // do the write
+  size_t bytes_written = fwrite(buffer, 1, (size_t)size, handle);
+  *fulfilled_size = (uint64_t)bytes_written;
+  if (bytes_written != (size_t)size) {
+    return io_status_from_errno(errno);
+  }
+  return BL_IO_STATUS_OK;
 }
 
-//------------------------------------------------------------------------------
-BLIoStatus bl_io_file_read_sync(BLIoFile* file, const BLIoOpAttr* attr, void* dest, uint64_t size) {
-  BL_ASSERT(file);
-  BL_ASSERT(dest || size == 0);
+//----------------------------------------------------------------------------
+BLIoStatus io_platform_sync(BLIoFile* file) {
+  // verify the file is open
+  FILE* handle = file->platform.handle;
+  if (!handle) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
+  }
 
-  BLIoOp* op = bl_io_file_read(file, attr, dest, size);
-  BLIoStatus status = bl_io_op_wait(op);
-  bl_io_op_delete(op);
-  return status;
+  // push stdio's buffer to the kernel and then the kernel's to the disk
+  if ((fflush(handle) != 0) || (fsync(fileno(handle)) == -1)) {
+    return io_status_from_errno(errno);
+  }
+  return BL_IO_STATUS_OK;
 }
 
-//------------------------------------------------------------------------------
-void bl_io_file_seek_sync(BLIoFile* file, uint64_t offset) {
-  BL_ASSERT(file);
+//----------------------------------------------------------------------------
+BLIoStatus io_platform_map(BLIoFile* file, uint64_t offset, uint64_t size, uint32_t advice, BLIoMapping* mapping) {
+  // verify the file is open
+  if (!file->platform.handle) {
+    return BL_IO_STATUS_ERROR_BAD_FILE_HANDLE;
+  }
+  int fd = fileno(file->platform.handle);
+
+  // views have to start on a page boundary
+  uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+  uint64_t base_offset = offset & ~(page_size - 1);
+  uint64_t base_size = size + (offset - base_offset);
+  void* base = mmap(NULL, (size_t)base_size, PROT_READ, MAP_SHARED, fd, (off_t)base_offset);
+  if (base == MAP_FAILED) {
+    return io_status_from_errno(errno);
+  }
 
-  file->offset = offset;
-}
+  // the advice is only a hint so failures don't matter
+  if (advice & BL_IO_MAP_ADVICE_SEQUENTIAL) {
+    madvise(base, (size_t)base_size, MADV_SEQUENTIAL);
+  }
+  if (advice & BL_IO_MAP_ADVICE_WILLNEED) {
+    madvise(base, (size_t)base_size, MADV_WILLNEED);
+  }
+  // BL_IO_MAP_ADVICE_HUGEPAGE has no equivalent for file views
 
-//------------------------------------------------------------------------------
-uint64_t bl_io_file_tell_sync(const BLIoFile* file) {
-  BL_ASSERT(file);
-  return file->offset;
+  mapping->data       = (const uint8_t*)base + (offset - base_offset);
+  mapping->size       = size;
+  mapping->base       = base;
+  mapping->base_size  = base_size;
+  return BL_IO_STATUS_OK;
 }
 
-//------------------------------------------------------------------------------
-const char* bl_io_file_get_filename(const BLIoFile* file) {
-  BL_ASSERT(file);
-  return file->file_name;
+//----------------------------------------------------------------------------
+void io_platform_unmap(BLIoMapping* mapping) {
+  int ret = munmap(mapping->base, (size_t)mapping->base_size);
+  BL_ASSERT(ret == 0);
 }
 
-//------------------------------------------------------------------------------
-BLIoStatus bl_io_op_wait(BLIoOp* op) {
-  BL_ASSERT(op);
-  IoOpImpl* op_impl = (IoOpImpl*)op;
-
-  // wait for the op to complete with the timeout
-  bl_mutex_lock(&op_impl->complete_mutex);
-  while (op_impl->status == BL_IO_STATUS_PENDING) {
-    bl_cond_wait(&op_impl->complete_cond, &op_impl->complete_mutex);
-  }
-  bl_mutex_unlock(&op_impl->complete_mutex);
-
-  return op_impl->status;
+//----------------------------------------------------------------------------
+bool io_platform_async_initialize(uint32_t) {
+  // no async path; reads are serviced by the io threads
+  return false;
 }
 
-//------------------------------------------------------------------------------
-BLIoStatus bl_io_op_wait_timeout(BLIoOp* op, uint32_t timeout_ms) {
-  BL_ASSERT(op);
-  IoOpImpl* op_impl = (IoOpImpl*)op;
-
-  // wait for the op to complete with the timeout
-  bl_mutex_lock(&op_impl->complete_mutex);
-  if (op_impl->status == BL_IO_STATUS_PENDING) {
-    bl_cond_wait_timeout(&op_impl->complete_cond, &op_impl->complete_mutex, timeout_ms);
-  }
-  bl_mutex_unlock(&op_impl->complete_mutex);
-
-  return op_impl->status;
+//----------------------------------------------------------------------------
+void io_platform_async_finalize() {
 }
 
-//------------------------------------------------------------------------------
-void bl_io_op_delete(BLIoOp* op) {
-  BL_ASSERT(op);
-  IoOpImpl* op_impl = (IoOpImpl*)op;
-
-  bl_io_op_wait(op);
-  bl_cond_destroy(&op_impl->complete_cond);
-  bl_mutex_destroy(&op_impl->complete_mutex);
-  bl_free(op_impl);
+//----------------------------------------------------------------------------
+void io_platform_async_kick() {
+  BL_FATAL("async reads are not supported on this platform");
 }
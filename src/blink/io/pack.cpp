@@ -0,0 +1,363 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "io_int.h"
+#include <blink/hash.h>
+#include <cstring>
+
+//
+// constants
+//
+
+// first bytes of every pack ("BLPK")
+static const uint32_t IO_PACK_MAGIC = 0x4b504c42;
+static const uint32_t IO_PACK_VERSION = 1;
+
+// largest table of contents a pack may have
+static const uint32_t IO_PACK_MAX_SLOTS = 1u << 24;
+
+
+//
+// local types
+//
+
+// A pack starts with this header. The entries follow, each at a multiple of
+// the pack's alignment, and the table of contents comes last. All fields are
+// little endian.
+struct PackHeader {
+  uint32_t          magic;
+  uint32_t          version;
+  uint32_t          entry_count;
+  uint32_t          slot_count;     // size of the table of contents; a power of two
+  uint64_t          toc_offset;
+};
+
+// One slot of the table of contents, an open addressed hash table probed
+// linearly from key & (slot_count - 1). Entries never start at offset zero
+// since the header is there, so a zero offset marks an empty slot.
+struct PackSlot {
+  uint64_t          key;            // see pack_key()
+  uint64_t          offset;
+  uint64_t          size;
+};
+
+struct BLIoPack {
+  BLIoFile*         file;
+  PackSlot*         slots;
+  uint32_t          slot_mask;
+  volatile int32_t  open_entries;
+};
+
+
+//
+// local functions
+//
+
+//----------------------------------------------------------------------------
+// the murmur3 hash of the name under two seeds; one alone gives collisions
+// too often with tens of thousands of names
+static uint64_t pack_key(const char* name) {
+  uint32_t len = (uint32_t)strlen(name);
+  uint64_t low = bl_hash_murmur3(name, len, 0);
+  uint64_t high = bl_hash_murmur3(name, len, 0x9747b28cu);
+  return (high << 32) | low;
+}
+
+//----------------------------------------------------------------------------
+// returns the slot holding key, or the empty slot where it would go. returns
+// NULL if every slot is taken by other keys, which only a damaged pack has.
+static PackSlot* pack_probe(PackSlot* slots, uint32_t slot_mask, uint64_t key) {
+  uint32_t index = (uint32_t)key & slot_mask;
+  for (uint32_t step = 0; step <= slot_mask; ++step) {
+    if ((slots[index].offset == 0) || (slots[index].key == key)) {
+      return slots + index;
+    }
+    index = (index + 1) & slot_mask;
+  }
+  return NULL;
+}
+
+//----------------------------------------------------------------------------
+// converts a header between the file's little endian layout and the host's.
+// converting twice gives back what was there so it serves both ways.
+static void pack_header_convert(PackHeader* header) {
+  header->magic       = BL_FROM_LITTLE_ENDIAN(header->magic);
+  header->version     = BL_FROM_LITTLE_ENDIAN(header->version);
+  header->entry_count = BL_FROM_LITTLE_ENDIAN(header->entry_count);
+  header->slot_count  = BL_FROM_LITTLE_ENDIAN(header->slot_count);
+  header->toc_offset  = BL_FROM_LITTLE_ENDIAN(header->toc_offset);
+}
+
+//----------------------------------------------------------------------------
+// converts the table of contents the same way
+static void pack_slots_convert(PackSlot* slots, uint32_t slot_count) {
+  for (uint32_t index = 0; index < slot_count; ++index) {
+    slots[index].key    = BL_FROM_LITTLE_ENDIAN(slots[index].key);
+    slots[index].offset = BL_FROM_LITTLE_ENDIAN(slots[index].offset);
+    slots[index].size   = BL_FROM_LITTLE_ENDIAN(slots[index].size);
+  }
+}
+
+//----------------------------------------------------------------------------
+// writes zeros to bring the file offset up to a multiple of alignment
+static BLIoStatus pack_write_padding(BLIoFile* file, uint64_t alignment) {
+  static const uint8_t zeros[256] = { 0 };
+  uint64_t padding = (alignment - bl_io_file_tell_sync(file) % alignment) % alignment;
+  while (padding > 0) {
+    uint64_t size = (padding < sizeof(zeros)) ? padding : sizeof(zeros);
+    BLIoStatus status = bl_io_file_write_sync(file, NULL, zeros, size);
+    if (status != BL_IO_STATUS_OK) {
+      return status;
+    }
+    padding -= size;
+  }
+  return BL_IO_STATUS_OK;
+}
+
+//----------------------------------------------------------------------------
+// copies a whole file into the pack at its current offset
+static BLIoStatus pack_write_entry(BLIoFile* pack_file, const char* source_name, uint8_t* buffer, uint64_t buffer_size, uint64_t* entry_size) {
+  BLIoFile* source;
+  BLIoStatus status = bl_io_file_open_sync(source_name, NULL, &source, entry_size);
+  if (status != BL_IO_STATUS_OK) {
+    return status;
+  }
+  for (uint64_t copied = 0; (copied < *entry_size) && (status == BL_IO_STATUS_OK); copied += buffer_size) {
+    uint64_t size = *entry_size - copied;
+    if (size > buffer_size) {
+      size = buffer_size;
+    }
+    status = bl_io_file_read_sync(source, NULL, buffer, size);
+    if (status == BL_IO_STATUS_OK) {
+      status = bl_io_file_write_sync(pack_file, NULL, buffer, size);
+    }
+  }
+  BLIoStatus close_status = bl_io_file_close_sync(source, NULL);
+  return (status != BL_IO_STATUS_OK) ? status : close_status;
+}
+
+
+//
+// shared functions
+//
+
+//----------------------------------------------------------------------------
+void io_pack_entry_closed(BLIoPack* pack) {
+  bl_atomic_decrement(&pack->open_entries);
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_pack_build(const char* pack_name, const char* const* entry_names, const char* const* source_names, uint32_t entry_count, uint32_t alignment) {
+  BL_ASSERT(pack_name);
+  BL_ASSERT(entry_names || entry_count == 0);
+  BL_ASSERT(source_names || entry_count == 0);
+  BL_ASSERT(alignment > 0);
+
+  // keep the table at most half full so probes stay short
+  uint32_t slot_count = 1;
+  while (slot_count < entry_count * 2) {
+    slot_count <<= 1;
+  }
+  BL_ASSERT(slot_count <= IO_PACK_MAX_SLOTS);
+  PackSlot* slots = (PackSlot*)bl_alloc(sizeof(PackSlot) * slot_count, 8);
+  memset(slots, 0, sizeof(PackSlot) * slot_count);
+
+  BLIoFile* file;
+  BLIoStatus status = bl_io_file_open_write_sync(pack_name, NULL, 64 * 1024, &file);
+  if (status != BL_IO_STATUS_OK) {
+    bl_free(slots);
+    return status;
+  }
+
+  // leave room for the header, which is written once the toc's place is known
+  PackHeader header;
+  memset(&header, 0, sizeof(header));
+  status = bl_io_file_write_sync(file, NULL, &header, sizeof(header));
+
+  // copy each entry in at the next aligned offset
+  const uint64_t copy_buffer_size = 1024 * 1024;
+  uint8_t* copy_buffer = (uint8_t*)bl_alloc(copy_buffer_size, 64);
+  for (uint32_t index = 0; (index < entry_count) && (status == BL_IO_STATUS_OK); ++index) {
+    uint64_t key = pack_key(entry_names[index]);
+    PackSlot* slot = pack_probe(slots, slot_count - 1, key);
+    BL_ASSERT(slot);
+    if (slot->offset != 0) {
+      status = BL_IO_STATUS_ERROR_DUPLICATE_ENTRY;
+      break;
+    }
+
+    status = pack_write_padding(file, alignment);
+    if (status != BL_IO_STATUS_OK) {
+      break;
+    }
+    slot->key     = key;
+    slot->offset  = bl_io_file_tell_sync(file);
+    status = pack_write_entry(file, source_names[index], copy_buffer, copy_buffer_size, &slot->size);
+  }
+  bl_free(copy_buffer);
+
+  // the toc goes at the end, then the header is filled in
+  if (status == BL_IO_STATUS_OK) {
+    status = pack_write_padding(file, 8);
+  }
+  if (status == BL_IO_STATUS_OK) {
+    header.magic        = IO_PACK_MAGIC;
+    header.version      = IO_PACK_VERSION;
+    header.entry_count  = entry_count;
+    header.slot_count   = slot_count;
+    header.toc_offset   = bl_io_file_tell_sync(file);
+    pack_header_convert(&header);
+    pack_slots_convert(slots, slot_count);
+    status = bl_io_file_write_sync(file, NULL, slots, sizeof(PackSlot) * slot_count);
+  }
+  if (status == BL_IO_STATUS_OK) {
+    bl_io_file_seek_sync(file, 0);
+    status = bl_io_file_write_sync(file, NULL, &header, sizeof(header));
+  }
+  if (status == BL_IO_STATUS_OK) {
+    status = bl_io_file_flush_sync(file, NULL);
+  }
+
+  BLIoStatus close_status = bl_io_file_close_sync(file, NULL);
+  bl_free(slots);
+  return (status != BL_IO_STATUS_OK) ? status : close_status;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_pack_open_sync(const char* file_name, BLIoPack** pack) {
+  BL_ASSERT(file_name);
+  BL_ASSERT(pack);
+
+  BLIoFile* file;
+  uint64_t file_size = 0;
+  BLIoStatus status = bl_io_file_open_sync(file_name, NULL, &file, &file_size);
+  if (status != BL_IO_STATUS_OK) {
+    return status;
+  }
+
+  // check the header describes a toc that fits in the file
+  PackHeader header;
+  status = bl_io_file_read_sync(file, NULL, &header, sizeof(header));
+  pack_header_convert(&header);
+  if ((status == BL_IO_STATUS_OK) || (status == BL_IO_STATUS_ERROR_EOF)) {
+    bool valid =
+      (status == BL_IO_STATUS_OK) &&
+      (header.magic == IO_PACK_MAGIC) &&
+      (header.version == IO_PACK_VERSION) &&
+      (header.slot_count > 0) &&
+      (header.slot_count <= IO_PACK_MAX_SLOTS) &&
+      ((header.slot_count & (header.slot_count - 1)) == 0) &&
+      (header.entry_count < header.slot_count) &&
+      (header.toc_offset >= sizeof(PackHeader)) &&
+      (header.toc_offset <= file_size) &&
+      (sizeof(PackSlot) * (uint64_t)header.slot_count <= file_size - header.toc_offset);
+    status = valid ? BL_IO_STATUS_OK : BL_IO_STATUS_ERROR_BAD_FORMAT;
+  }
+
+  PackSlot* slots = NULL;
+  if (status == BL_IO_STATUS_OK) {
+    slots = (PackSlot*)bl_alloc(sizeof(PackSlot) * header.slot_count, 8);
+    bl_io_file_seek_sync(file, header.toc_offset);
+    status = bl_io_file_read_sync(file, NULL, slots, sizeof(PackSlot) * header.slot_count);
+    pack_slots_convert(slots, header.slot_count);
+  }
+
+  // check every entry lies between the header and the toc, and that there
+  // are as many as the header says so the table has empty slots to stop
+  // probes at
+  if (status == BL_IO_STATUS_OK) {
+    uint32_t used_count = 0;
+    for (uint32_t index = 0; index < header.slot_count; ++index) {
+      const PackSlot* slot = slots + index;
+      if (slot->offset == 0) {
+        continue;
+      }
+      ++used_count;
+      if ((slot->offset < sizeof(PackHeader)) || (slot->offset > header.toc_offset) || (slot->size > header.toc_offset - slot->offset)) {
+        status = BL_IO_STATUS_ERROR_BAD_FORMAT;
+        break;
+      }
+    }
+    if (used_count != header.entry_count) {
+      status = BL_IO_STATUS_ERROR_BAD_FORMAT;
+    }
+  }
+  if (status != BL_IO_STATUS_OK) {
+    bl_free(slots);
+    bl_io_file_close_sync(file, NULL);
+    return status;
+  }
+
+  BLIoPack* new_pack = (BLIoPack*)bl_alloc(sizeof(BLIoPack), 8);
+  new_pack->file          = file;
+  new_pack->slots         = slots;
+  new_pack->slot_mask     = header.slot_count - 1;
+  new_pack->open_entries  = 0;
+  *pack = new_pack;
+  return BL_IO_STATUS_OK;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_pack_close_sync(BLIoPack* pack) {
+  BL_ASSERT(pack);
+  BL_ASSERT(pack->open_entries == 0);
+
+  BLIoStatus status = bl_io_file_close_sync(pack->file, NULL);
+  bl_free(pack->slots);
+  bl_free(pack);
+  return status;
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_pack_entry_open(BLIoPack* pack, const char* entry_name, BLIoFile** file, uint64_t* size) {
+  BL_ASSERT(pack);
+  BL_ASSERT(entry_name);
+  BL_ASSERT(file);
+
+  const PackSlot* slot = pack_probe(pack->slots, pack->slot_mask, pack_key(entry_name));
+  if (!slot || (slot->offset == 0)) {
+    return BL_IO_STATUS_ERROR_NOT_FOUND;
+  }
+
+  // the entry is a window onto the pack's already open handle
+  BLIoFile* entry = io_file_create(entry_name, false, 0);
+  entry->opening      = false;
+  entry->platform     = pack->file->platform;
+  entry->pack         = pack;
+  entry->base_offset  = slot->offset;
+  entry->size         = slot->size;
+  bl_atomic_increment(&pack->open_entries);
+
+  *file = entry;
+  if (size) {
+    *size = slot->size;
+  }
+  return BL_IO_STATUS_OK;
+}
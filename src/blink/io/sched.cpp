@@ -0,0 +1,358 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "io_int.h"
+#include <cstring>
+
+//
+// constants
+//
+
+// pending reads the scheduler has room for before it first grows
+static const uint32_t IO_SCHED_INITIAL_CAPACITY = 256;
+
+
+//
+// local types
+//
+
+// Reads waiting to be issued. ops is kept sorted by priority (highest first),
+// then file and offset, so within a priority the reads can be swept in offset
+// order like a disk elevator. deadlines holds the reads that have a deadline,
+// earliest first, so overdue reads can jump the queue.
+struct IoSched {
+  BLMutex           mutex;
+  IoOpImpl**        ops;
+  IoOpImpl**        deadlines;
+  uint32_t          count;
+  uint32_t          deadline_count;
+  uint32_t          capacity;
+  const BLIoFile*   head_file;      // where the last read issued finished
+  uint64_t          head_offset;
+  volatile int32_t  pending;        // count, readable without the lock
+};
+
+
+//
+// local vars
+//
+
+static IoSched s_sched;
+
+
+//
+// local functions
+//
+
+//----------------------------------------------------------------------------
+// orders reads by priority, file and offset. the op itself breaks ties so
+// every read has a unique position.
+static bool op_before(const IoOpImpl* a, const IoOpImpl* b) {
+  if (a->attr.priority != b->attr.priority) {
+    return a->attr.priority > b->attr.priority;
+  }
+  if (a->file != b->file) {
+    return (uintptr_t)a->file < (uintptr_t)b->file;
+  }
+  if (a->offset != b->offset) {
+    return a->offset < b->offset;
+  }
+  return (uintptr_t)a < (uintptr_t)b;
+}
+
+//----------------------------------------------------------------------------
+static bool deadline_before(const IoOpImpl* a, const IoOpImpl* b) {
+  if (a->deadline_ns != b->deadline_ns) {
+    return a->deadline_ns < b->deadline_ns;
+  }
+  return (uintptr_t)a < (uintptr_t)b;
+}
+
+//----------------------------------------------------------------------------
+// returns the index of the first element of the sorted array that op doesn't
+// come after
+static uint32_t lower_bound(IoOpImpl* const* array, uint32_t count, const IoOpImpl* op, bool (*before)(const IoOpImpl*, const IoOpImpl*)) {
+  uint32_t low = 0;
+  uint32_t high = count;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    if (before(array[mid], op)) {
+      low = mid + 1;
+    }
+    else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+//----------------------------------------------------------------------------
+static void array_insert(IoOpImpl** array, uint32_t count, IoOpImpl* op, bool (*before)(const IoOpImpl*, const IoOpImpl*)) {
+  uint32_t index = lower_bound(array, count, op, before);
+  memmove(array + index + 1, array + index, (count - index) * sizeof(IoOpImpl*));
+  array[index] = op;
+}
+
+//----------------------------------------------------------------------------
+static void array_remove(IoOpImpl** array, uint32_t count, IoOpImpl* op, bool (*before)(const IoOpImpl*, const IoOpImpl*)) {
+  uint32_t index = lower_bound(array, count, op, before);
+  BL_ASSERT(index < count && array[index] == op);
+  memmove(array + index, array + index + 1, (count - index - 1) * sizeof(IoOpImpl*));
+}
+
+//----------------------------------------------------------------------------
+static void sched_grow(IoSched* sched) {
+  uint32_t capacity = sched->capacity * 2;
+  IoOpImpl** ops = (IoOpImpl**)bl_alloc(sizeof(IoOpImpl*) * capacity, 64);
+  IoOpImpl** deadlines = (IoOpImpl**)bl_alloc(sizeof(IoOpImpl*) * capacity, 64);
+  memcpy(ops, sched->ops, sizeof(IoOpImpl*) * sched->count);
+  memcpy(deadlines, sched->deadlines, sizeof(IoOpImpl*) * sched->deadline_count);
+  bl_free(sched->ops);
+  bl_free(sched->deadlines);
+  sched->ops = ops;
+  sched->deadlines = deadlines;
+  sched->capacity = capacity;
+}
+
+//----------------------------------------------------------------------------
+// picks the next read in the elevator sweep: the first read at or past the
+// head in the highest priority that has reads, wrapping around to the start
+// of that priority once the sweep passes the end.
+static IoOpImpl* sched_next_in_sweep(IoSched* sched) {
+  uint32_t priority = sched->ops[0]->attr.priority;
+
+  // find where the highest priority ends
+  uint32_t band_end = 1;
+  while ((band_end < sched->count) && (sched->ops[band_end]->attr.priority == priority)) {
+    ++band_end;
+  }
+
+  // find the first read at or past the head within it
+  uint32_t low = 0;
+  uint32_t high = band_end;
+  while (low < high) {
+    uint32_t mid = low + (high - low) / 2;
+    const IoOpImpl* op = sched->ops[mid];
+    bool behind_head = ((uintptr_t)op->file < (uintptr_t)sched->head_file) || ((op->file == sched->head_file) && (op->offset < sched->head_offset));
+    if (behind_head) {
+      low = mid + 1;
+    }
+    else {
+      high = mid;
+    }
+  }
+  return sched->ops[(low < band_end) ? low : 0];
+}
+
+//----------------------------------------------------------------------------
+// picks the next read to issue: an overdue one if there is any, otherwise the
+// next in the sweep
+static IoOpImpl* sched_next(IoSched* sched, uint64_t now) {
+  if (sched->deadline_count && (sched->deadlines[0]->deadline_ns <= now)) {
+    return sched->deadlines[0];
+  }
+  return sched_next_in_sweep(sched);
+}
+
+//----------------------------------------------------------------------------
+// returns true if the read is still waiting to be issued
+static bool sched_contains(IoSched* sched, const IoOpImpl* op) {
+  uint32_t index = lower_bound(sched->ops, sched->count, op, &op_before);
+  return (index < sched->count) && (sched->ops[index] == op);
+}
+
+//----------------------------------------------------------------------------
+static void sched_remove(IoSched* sched, IoOpImpl* op) {
+  array_remove(sched->ops, sched->count, op, &op_before);
+  --sched->count;
+  if (op->deadline_ns) {
+    array_remove(sched->deadlines, sched->deadline_count, op, &deadline_before);
+    --sched->deadline_count;
+  }
+}
+
+//----------------------------------------------------------------------------
+// removes a read that's about to be issued
+static void sched_take(IoSched* sched, IoOpImpl* op) {
+  sched_remove(sched, op);
+
+  // the next sweep picks up where this read leaves off
+  sched->head_file = op->file;
+  sched->head_offset = op->offset + op->requested_size;
+}
+
+
+//
+// shared functions
+//
+
+//----------------------------------------------------------------------------
+void io_sched_initialize() {
+  IoSched* sched = &s_sched;
+  bl_mutex_create(&sched->mutex);
+  sched->capacity       = IO_SCHED_INITIAL_CAPACITY;
+  sched->ops            = (IoOpImpl**)bl_alloc(sizeof(IoOpImpl*) * sched->capacity, 64);
+  sched->deadlines      = (IoOpImpl**)bl_alloc(sizeof(IoOpImpl*) * sched->capacity, 64);
+  sched->count          = 0;
+  sched->deadline_count = 0;
+  sched->head_file      = NULL;
+  sched->head_offset    = 0;
+  sched->pending        = 0;
+}
+
+//----------------------------------------------------------------------------
+void io_sched_finalize() {
+  IoSched* sched = &s_sched;
+  BL_ASSERT(sched->count == 0);
+  bl_free(sched->ops);
+  bl_free(sched->deadlines);
+  bl_mutex_destroy(&sched->mutex);
+}
+
+//----------------------------------------------------------------------------
+void io_sched_push(IoOpImpl* op) {
+  IoSched* sched = &s_sched;
+  bl_mutex_lock(&sched->mutex);
+  if (sched->count == sched->capacity) {
+    sched_grow(sched);
+  }
+  array_insert(sched->ops, sched->count, op, &op_before);
+  ++sched->count;
+  if (op->deadline_ns) {
+    array_insert(sched->deadlines, sched->deadline_count, op, &deadline_before);
+    ++sched->deadline_count;
+  }
+  sched->pending = (int32_t)sched->count;
+  bl_mutex_unlock(&sched->mutex);
+}
+
+//----------------------------------------------------------------------------
+uint32_t io_sched_pop(IoOpImpl** ops, uint32_t max_count) {
+  IoSched* sched = &s_sched;
+
+  // don't bother with the lock when there's nothing to do
+  if (sched->pending == 0) {
+    return 0;
+  }
+
+  bl_mutex_lock(&sched->mutex);
+  uint64_t now = sched->deadline_count ? bl_time_ns() : 0;
+  uint32_t popped = 0;
+  while ((popped < max_count) && (sched->count > 0)) {
+    IoOpImpl* op = sched_next(sched, now);
+    sched_take(sched, op);
+    ops[popped++] = op;
+  }
+  sched->pending = (int32_t)sched->count;
+  bl_mutex_unlock(&sched->mutex);
+  return popped;
+}
+
+//----------------------------------------------------------------------------
+uint32_t io_sched_pop_run(IoOpImpl** ops) {
+  IoSched* sched = &s_sched;
+
+  // don't bother with the lock when there's nothing to do
+  if (sched->pending == 0) {
+    return 0;
+  }
+
+  bl_mutex_lock(&sched->mutex);
+  if (sched->count == 0) {
+    bl_mutex_unlock(&sched->mutex);
+    return 0;
+  }
+  uint64_t now = sched->deadline_count ? bl_time_ns() : 0;
+  IoOpImpl* first = sched_next(sched, now);
+
+  // reads that follow in the same file and priority sit right after the
+  // first one in the sorted list
+  uint32_t index = lower_bound(sched->ops, sched->count, first, &op_before);
+  uint64_t run_end = first->offset + first->requested_size;
+  uint32_t popped = 0;
+  ops[popped++] = first;
+  for (++index; (index < sched->count) && (popped < IO_COALESCE_MAX_OPS); ++index) {
+    IoOpImpl* op = sched->ops[index];
+    if ((op->file != first->file) || (op->attr.priority != first->attr.priority)) {
+      break;
+    }
+    // vectored reads bring their own buffer lists, reads filling the cache
+    // take whole blocks, unbuffered reads can't share the gap buffer and
+    // compressed reads are decompressed block by block, so they all go alone
+    if (first->buffers || op->buffers || first->cache_fill || op->cache_fill || op->file->direct_alignment || op->file->compressed) {
+      break;
+    }
+    // overlapping reads can't be scattered
+    if ((op->offset < run_end) || (op->offset - run_end > IO_COALESCE_MAX_GAP)) {
+      break;
+    }
+    uint64_t op_end = op->offset + op->requested_size;
+    if (op_end - first->offset > IO_COALESCE_MAX_SIZE) {
+      break;
+    }
+    ops[popped++] = op;
+    run_end = op_end;
+  }
+
+  for (uint32_t run_index = 0; run_index < popped; ++run_index) {
+    sched_take(sched, ops[run_index]);
+  }
+  sched->pending = (int32_t)sched->count;
+  bl_mutex_unlock(&sched->mutex);
+  return popped;
+}
+
+//----------------------------------------------------------------------------
+bool io_sched_cancel(IoOpImpl* op) {
+  IoSched* sched = &s_sched;
+  bl_mutex_lock(&sched->mutex);
+  bool found = sched_contains(sched, op);
+  if (found) {
+    sched_remove(sched, op);
+    sched->pending = (int32_t)sched->count;
+  }
+  bl_mutex_unlock(&sched->mutex);
+  return found;
+}
+
+//----------------------------------------------------------------------------
+bool io_sched_set_priority(IoOpImpl* op, uint32_t priority) {
+  IoSched* sched = &s_sched;
+  bl_mutex_lock(&sched->mutex);
+  bool found = sched_contains(sched, op);
+  if (found) {
+    // the priority is part of the sort key so the read has to move
+    array_remove(sched->ops, sched->count, op, &op_before);
+    op->attr.priority = priority;
+    array_insert(sched->ops, sched->count - 1, op, &op_before);
+  }
+  bl_mutex_unlock(&sched->mutex);
+  return found;
+}
+
+//----------------------------------------------------------------------------
+bool io_sched_empty() {
+  return s_sched.pending == 0;
+}
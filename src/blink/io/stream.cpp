@@ -0,0 +1,149 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "io_int.h"
+
+//
+// local types
+//
+
+// Reads a range of a file through a ring of chunks. Every chunk not held by
+// the consumer has a read in flight, or already done, for the part of the
+// range after the chunks ahead of it.
+struct BLIoStream {
+  BLIoFile*         file;
+  uint8_t*          buffers;        // chunk_count chunks of chunk_size bytes
+  BLIoOp**          ops;            // the read filling each chunk, NULL once the range runs out
+  uint32_t          chunk_size;
+  uint32_t          chunk_count;
+  uint32_t          head;           // chunk handed out by the next call
+  bool              holding;        // the consumer has the chunk before head
+  uint64_t          next_offset;    // where the next read starts
+  uint64_t          end;
+};
+
+
+//
+// local functions
+//
+
+//----------------------------------------------------------------------------
+// starts filling a chunk with the next part of the range, if there's any left
+static void stream_fill(BLIoStream* stream, uint32_t chunk) {
+  BL_ASSERT(!stream->ops[chunk]);
+  if (stream->next_offset >= stream->end) {
+    return;
+  }
+
+  uint64_t size = stream->end - stream->next_offset;
+  if (size > stream->chunk_size) {
+    size = stream->chunk_size;
+  }
+  bl_io_file_seek_sync(stream->file, stream->next_offset);
+  stream->ops[chunk] = bl_io_file_read(stream->file, NULL, stream->buffers + (uint64_t)chunk * stream->chunk_size, size);
+  stream->next_offset += size;
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+BLIoStream* bl_io_stream_create(BLIoFile* file, uint64_t offset, uint64_t size, uint32_t chunk_size, uint32_t chunk_count) {
+  BL_ASSERT(file);
+  BL_ASSERT(chunk_size > 0);
+  BL_ASSERT(chunk_count > 0);
+
+  BLIoStream* stream = (BLIoStream*)bl_alloc(sizeof(BLIoStream), 8);
+  stream->file        = file;
+  stream->buffers     = (uint8_t*)bl_alloc((uint64_t)chunk_size * chunk_count, BL_IO_UNBUFFERED_ALIGNMENT);
+  stream->ops         = (BLIoOp**)bl_alloc(sizeof(BLIoOp*) * chunk_count, 8);
+  stream->chunk_size  = chunk_size;
+  stream->chunk_count = chunk_count;
+  stream->head        = 0;
+  stream->holding     = false;
+  stream->next_offset = offset;
+  stream->end         = offset + size;
+
+  // get every chunk going straight away
+  for (uint32_t chunk = 0; chunk < chunk_count; ++chunk) {
+    stream->ops[chunk] = NULL;
+    stream_fill(stream, chunk);
+  }
+  return stream;
+}
+
+//------------------------------------------------------------------------------
+void bl_io_stream_destroy(BLIoStream* stream) {
+  BL_ASSERT(stream);
+
+  // reads that haven't started yet aren't wanted any more
+  for (uint32_t chunk = 0; chunk < stream->chunk_count; ++chunk) {
+    if (stream->ops[chunk]) {
+      bl_io_op_cancel(stream->ops[chunk]);
+    }
+  }
+  for (uint32_t chunk = 0; chunk < stream->chunk_count; ++chunk) {
+    if (stream->ops[chunk]) {
+      bl_io_op_delete(stream->ops[chunk]);
+    }
+  }
+
+  bl_free(stream->ops);
+  bl_free(stream->buffers);
+  bl_free(stream);
+}
+
+//------------------------------------------------------------------------------
+BLIoStatus bl_io_stream_next(BLIoStream* stream, const void** data, uint64_t* size) {
+  BL_ASSERT(stream);
+  BL_ASSERT(data);
+  BL_ASSERT(size);
+
+  // the chunk handed out last time goes back to reading ahead
+  if (stream->holding) {
+    uint32_t held = (stream->head + stream->chunk_count - 1) % stream->chunk_count;
+    stream_fill(stream, held);
+    stream->holding = false;
+  }
+
+  // no read in the next chunk means the range is used up
+  BLIoOp* op = stream->ops[stream->head];
+  if (!op) {
+    *data = NULL;
+    *size = 0;
+    return BL_IO_STATUS_OK;
+  }
+
+  BLIoStatus status = bl_io_op_wait(op);
+  *data = op->buffer;
+  *size = op->fulfilled_size;
+  bl_io_op_delete(op);
+  stream->ops[stream->head] = NULL;
+  stream->head = (stream->head + 1) % stream->chunk_count;
+  stream->holding = true;
+  return status;
+}
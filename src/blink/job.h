@@ -89,6 +89,16 @@ BLJobStatus bl_job_queue_destroy(BLJobQueue* __restrict queue);
 // Pushes a job onto the queue.
 BLJobStatus bl_job_queue_push_job(BLJobQueue* __restrict queue, BLJob* __restrict job);
 
+// Reserves a place in the queue for a job that will be pushed later, possibly
+// from another thread, with bl_job_queue_push_reserved_job. Waiting on the
+// queue waits for reserved jobs as well as pushed ones.
+BLJobStatus bl_job_queue_reserve(BLJobQueue* __restrict queue);
+
+// Pushes a job into a place reserved with bl_job_queue_reserve. May be called
+// from any thread. Never fails; if the global queue is full the job is run on
+// the calling thread before returning.
+BLJobStatus bl_job_queue_push_reserved_job(BLJobQueue* __restrict queue, BLJob* __restrict job);
+
 // Waits for all jobs in the group to finish.
 BLJobStatus bl_job_queue_wait(BLJobQueue* __restrict queue);
 
@@ -68,13 +68,76 @@ static BLThread*      s_worker_threads;
 static BLQueueSWSR    s_queue;
 static BLMutex        s_queue_write_lock;
 static BLMutex        s_queue_read_lock;
-static BLCond         s_queue_not_empty_cond;
+static BLEventCount   s_queue_not_empty;
 
 
 //
 // local functions
 //
 
+//------------------------------------------------------------------------------
+// pulls a job off the global queue. returns NULL if the queue is empty.
+static BLJob* pop_job() {
+  BLJob* __restrict job = NULL;
+  bl_mutex_lock(&s_queue_read_lock);
+  {
+    BLJob** __restrict job_ptr = (BLJob**)bl_queue_read_fetch(&s_queue);
+    if (job_ptr) {
+      job = *job_ptr;
+      bl_queue_read_consume(&s_queue);
+    }
+  }
+  bl_mutex_unlock(&s_queue_read_lock);
+  return job;
+}
+
+//------------------------------------------------------------------------------
+// runs a job and signals its queue if the queue is waiting on it
+static void run_job(BLJob* __restrict job) {
+  // the queue is read first since a job is free to release its own memory
+  // once it's done
+  BLJobQueue* __restrict queue = job->queue;
+  job->func(job);
+
+  // notify completion of the job
+  int32_t new_wait_count = bl_atomic_decrement(&queue->wait_count);
+  if (BL_UNLIKELY(new_wait_count == 0)) {
+    // queue is waiting on the job and this is the last job, wake it up
+    bl_semaphore_post(&queue->wait_sem);
+  }
+}
+
+//------------------------------------------------------------------------------
+// adds a job to the global queue. a reserved job was already counted against
+// its queue when the reservation was made.
+static BLJobStatus push_job(BLJobQueue* __restrict queue, BLJob* __restrict job, bool reserved) {
+  bl_mutex_lock(&s_queue_write_lock);
+  {
+    // try to reserve space in the queue
+    bool empty;
+    BLJob** dest = (BLJob**)bl_queue_write_prepare(&s_queue, &empty);
+    if (BL_UNLIKELY(!dest)) {
+      bl_mutex_unlock(&s_queue_write_lock);
+      return BL_JOB_STATUS_ERR_FULL;
+    }
+
+    // add the job to the queue
+    if (!reserved) {
+      bl_atomic_increment(&queue->wait_count);
+    }
+    job->queue = queue;
+    *dest = job;
+    bl_queue_write_commit(&s_queue);
+  }
+  bl_mutex_unlock(&s_queue_write_lock);
+
+  // wake the worker threads if any are waiting for work. this doesn't make a
+  // system call unless a worker is actually asleep.
+  bl_event_count_notify_all(&s_queue_not_empty);
+
+  return BL_JOB_STATUS_OK;
+}
+
 //------------------------------------------------------------------------------
 static void job_worker_proc(void* param) {
   unsigned int worker_id = (unsigned int)((uintptr_t)param);
@@ -84,41 +147,27 @@ static void job_worker_proc(void* param) {
 
   for (;;) {
     // pull a job off the queue
-    BLJob* __restrict job = NULL;
-    bl_mutex_lock(&s_queue_read_lock);
-    {
-      BLJob** __restrict job_ptr = (BLJob**)bl_queue_read_fetch(&s_queue);
-      // if the queue is empty, wait until it's full again
-      while (BL_UNLIKELY(job_ptr == NULL && !s_shutdown)) {
-        bl_cond_wait(&s_queue_not_empty_cond, &s_queue_read_lock);
-        job_ptr = (BLJob**)bl_queue_read_fetch(&s_queue);
-      }
-
-      // check for out of work and shutdown request
-      if (BL_UNLIKELY(!job_ptr && s_shutdown)) {
-        // try one more time to get a job
-        job_ptr = (BLJob**)bl_queue_read_fetch(&s_queue);
-        if (!job_ptr) {
-          bl_mutex_unlock(&s_queue_read_lock);
+    BLJob* __restrict job = pop_job();
+    if (BL_UNLIKELY(!job)) {
+      // announce that we're about to sleep and then check the queue once more
+      // to catch a job pushed before the pusher could see us
+      int32_t key = bl_event_count_prepare_wait(&s_queue_not_empty);
+      job = pop_job();
+      if (!job) {
+        // check for out of work and shutdown request
+        if (s_shutdown) {
+          bl_event_count_cancel_wait(&s_queue_not_empty);
           break;
         }
-      }
 
-      job = *job_ptr;
-      bl_queue_read_consume(&s_queue);
+        // if the queue is empty, wait until it's full again
+        bl_event_count_wait(&s_queue_not_empty, key);
+        continue;
+      }
+      bl_event_count_cancel_wait(&s_queue_not_empty);
     }
-    bl_mutex_unlock(&s_queue_read_lock);
-
-    // run the job
-    BLJobQueue* __restrict queue = job->queue;
-    job->func(job);
 
-    // notify completion of the job
-    int32_t new_wait_count = bl_atomic_decrement(&queue->wait_count);
-    if (BL_UNLIKELY(new_wait_count == 0)) {
-      // queue is waiting on the job and this is the last job, wake it up
-      bl_semaphore_post(&queue->wait_sem);
-    }
+    run_job(job);
   }
 }
 
@@ -143,7 +192,7 @@ BLJobStatus bl_job_lib_initialize(BLJobLibInitParams* __restrict params) {
   bl_queue_init(&s_queue, queue_buf, buf_count, sizeof(BLJob*));
   bl_mutex_create(&s_queue_write_lock);
   bl_mutex_create(&s_queue_read_lock);
-  bl_cond_create(&s_queue_not_empty_cond);
+  bl_event_count_create(&s_queue_not_empty);
 
   // create the worker threads
   s_shutdown = false;
@@ -160,11 +209,7 @@ BLJobStatus bl_job_lib_initialize(BLJobLibInitParams* __restrict params) {
 void bl_job_lib_finalize() {
   // kill the workers
   s_shutdown = true;
-  bl_mutex_lock(&s_queue_read_lock);
-  {
-    bl_cond_notify_all(&s_queue_not_empty_cond);
-  }
-  bl_mutex_unlock(&s_queue_read_lock);
+  bl_event_count_notify_all(&s_queue_not_empty);
   for (unsigned int index = 0; index < s_worker_count; ++index) {
     bl_thread_join(s_worker_threads + index);
   }
@@ -177,7 +222,7 @@ void bl_job_lib_finalize() {
   bl_free(s_queue.buf);
   bl_mutex_destroy(&s_queue_write_lock);
   bl_mutex_destroy(&s_queue_read_lock);
-  bl_cond_destroy(&s_queue_not_empty_cond);
+  bl_event_count_destroy(&s_queue_not_empty);
 }
 
 //------------------------------------------------------------------------------
@@ -205,31 +250,27 @@ BLJobStatus bl_job_queue_destroy(BLJobQueue* __restrict queue) {
 BLJobStatus bl_job_queue_push_job(BLJobQueue* __restrict queue, BLJob* __restrict job) {
   CHECK_PTR_AND_ALIGNMENT(queue, 128);
   CHECK_PTR_AND_ALIGNMENT(job, 128);
+  return push_job(queue, job, false);
+}
 
-  bl_mutex_lock(&s_queue_write_lock);
-  {
-    // try to reserve space in the queue
-    bool empty;
-    BLJob** dest = (BLJob**)bl_queue_write_prepare(&s_queue, &empty);
-    if (BL_UNLIKELY(!dest)) {
-      bl_mutex_unlock(&s_queue_write_lock);
-      return BL_JOB_STATUS_ERR_FULL;
-    }
+//------------------------------------------------------------------------------
+BLJobStatus bl_job_queue_reserve(BLJobQueue* __restrict queue) {
+  CHECK_PTR_AND_ALIGNMENT(queue, 128);
+  bl_atomic_increment(&queue->wait_count);
+  return BL_JOB_STATUS_OK;
+}
 
-    // add the job to the queue
-    bl_atomic_increment(&queue->wait_count);
-    job->queue = queue;
-    *dest = job;
-    bl_queue_write_commit(&s_queue);
+//------------------------------------------------------------------------------
+BLJobStatus bl_job_queue_push_reserved_job(BLJobQueue* __restrict queue, BLJob* __restrict job) {
+  CHECK_PTR_AND_ALIGNMENT(queue, 128);
+  CHECK_PTR_AND_ALIGNMENT(job, 128);
 
-    // if the queue was empty, wake the worker threads that there is now work
-    // available
-    if (BL_UNLIKELY(empty)) {
-      bl_cond_notify_all(&s_queue_not_empty_cond);
-    }
+  // the caller may not be able to wait for room so run the job here instead.
+  // the reservation keeps the queue's waiter from returning before it's done.
+  if (BL_UNLIKELY(push_job(queue, job, true) == BL_JOB_STATUS_ERR_FULL)) {
+    job->queue = queue;
+    run_job(job);
   }
-  bl_mutex_unlock(&s_queue_write_lock);
-
   return BL_JOB_STATUS_OK;
 }
 
@@ -29,6 +29,11 @@
 
 #include <blink/base.h>
 
+
+//
+// SWSR
+//
+
 // This SWSR implementation of a bounded queue is simple, but bad on cache-line
 // sharing. The basic issue is that both threads want to access the get and put
 // members causing the cache line to go back and forth between threads. :(
@@ -66,4 +71,562 @@ void* bl_queue_write_prepare(BLQueueSWSR* __restrict queue, bool* __restrict emp
 // successful call to bl_queue_write_prepare().
 void bl_queue_write_commit(BLQueueSWSR* __restrict queue);
 
+// Wraps a BLQueueSWSR so the reader can sleep while the queue is empty and the
+// writer can sleep while it is full. Threads only park on the event counts
+// when they can't make progress, and the other side only makes a system call
+// to wake them when somebody is actually parked, so a queue that never blocks
+// costs no more than a plain BLQueueSWSR.
+struct BLQueueSWSRBlocking {
+  BLQueueSWSR   queue;
+  BLEventCount  not_empty;    // reader waits on this
+  BLEventCount  not_full;     // writer waits on this
+};
+
+// Initializes a blocking queue with a given buffer.
+void bl_queue_blocking_init(BLQueueSWSRBlocking* __restrict queue, void* __restrict buf, size_t capacity, size_t element_size);
+
+// Destroys a blocking queue. The buffer is still owned by the caller.
+void bl_queue_blocking_destroy(BLQueueSWSRBlocking* __restrict queue);
+
+// Fetches an element from the queue, sleeping while the queue is empty.
+// bl_queue_blocking_read_consume() must be called to actually advance the
+// read head.
+void* bl_queue_blocking_read_fetch(BLQueueSWSRBlocking* __restrict queue);
+
+// Consumes an item on the queue and wakes the writer if it is waiting for
+// space.
+void bl_queue_blocking_read_consume(BLQueueSWSRBlocking* __restrict queue);
+
+// Prepares to write an element to the queue, sleeping while the queue is full.
+// bl_queue_blocking_write_commit() must be called to actually advance the
+// write head.
+void* bl_queue_blocking_write_prepare(BLQueueSWSRBlocking* __restrict queue);
+
+// Commits a new element to the queue and wakes the reader if it is waiting.
+void bl_queue_blocking_write_commit(BLQueueSWSRBlocking* __restrict queue);
+
+//
+// typed SWSR
+//
+
+// This SWSR queue stores elements of type T by value and has its capacity fixed
+// at compile time. N must be a power of two so indexing is a mask and a shift
+// instead of the multiply and wrap compare used by BLQueueSWSR. The get and put
+// indices run freely and are only masked when used, so all N slots can hold
+// elements.
+template<typename T, uint32_t N>
+struct BLQueue {
+  BL_STATIC_ASSERT((N > 0) && ((N & (N - 1)) == 0));
+
+  T                 buf[N];
+  char              pad1[128];    // next cache line
+  volatile uint32_t get;          // index of the read head
+  char              pad2[128];    // next cache line
+  volatile uint32_t put;          // index of the write head
+};
+
+// Initializes an empty queue.
+template<typename T, uint32_t N>
+void bl_queue_init(BLQueue<T, N>* __restrict queue);
+
+// Tries to fetch an element from the queue. Returns a pointer to the element if
+// there was data to read; NULL if the queue is empty. bl_queue_read_consume()
+// must be called to actually advance the read head.
+template<typename T, uint32_t N>
+T* bl_queue_read_fetch(BLQueue<T, N>* __restrict queue);
+
+// Consumes an item on the queue. This should only be called after a successful
+// call to bl_queue_read_fetch().
+template<typename T, uint32_t N>
+void bl_queue_read_consume(BLQueue<T, N>* __restrict queue);
+
+// Tries to prepare to write an element to the queue. Returns a pointer to the
+// element that can be written in place; NULL if the queue is full. If empty is
+// given, it is set to whether the queue was empty. bl_queue_write_commit() must
+// be called to actually advance the write head.
+template<typename T, uint32_t N>
+T* bl_queue_write_prepare(BLQueue<T, N>* __restrict queue, bool* __restrict empty = NULL);
+
+// Commits a new element to the queue. This should only be called after a
+// successful call to bl_queue_write_prepare().
+template<typename T, uint32_t N>
+void bl_queue_write_commit(BLQueue<T, N>* __restrict queue);
+
+// Copies an element onto the queue. Returns false if the queue is full.
+template<typename T, uint32_t N>
+bool bl_queue_push(BLQueue<T, N>* __restrict queue, const T& value);
+
+// Copies an element off the queue. Returns false if the queue is empty.
+template<typename T, uint32_t N>
+bool bl_queue_pop(BLQueue<T, N>* __restrict queue, T* __restrict value);
+
+
+//
+// MPSC
+//
+
+// Link embedded in every element pushed onto a BLQueueMPSC. The queue never
+// copies or allocates elements; it only chains these links together.
+struct BLQueueMPSCNode {
+  BLQueueMPSCNode* volatile next;
+};
+
+// This MPSC implementation is an unbounded intrusive linked list (after Dmitry
+// Vyukov's design). Producers only touch the head with a single atomic swap,
+// so they never wait on each other or on the consumer. The consumer owns the
+// tail and can block on the queue while it is empty.
+struct BLQueueMPSC {
+  BLQueueMPSCNode* volatile head;         // most recently pushed node (producers)
+  char                      pad1[128];    // next cache line
+  BLQueueMPSCNode*          tail;         // oldest node (consumer)
+  BLQueueMPSCNode           stub;         // placeholder node so the list is never empty
+  volatile int32_t          wake;         // set by bl_queue_mpsc_wake()
+  char                      pad2[128];    // next cache line
+  BLEventCount              not_empty;    // blocked consumer waits on this
+};
+
+// Initializes an empty queue.
+void bl_queue_mpsc_init(BLQueueMPSC* __restrict queue);
+
+// Destroys a queue. Any nodes still on the queue are simply dropped.
+void bl_queue_mpsc_destroy(BLQueueMPSC* __restrict queue);
+
+// Pushes a node onto the queue. This may be called by any number of threads
+// concurrently. Wakes the consumer if it is blocked in bl_queue_mpsc_wait();
+// if it isn't, no system call is made.
+void bl_queue_mpsc_push(BLQueueMPSC* __restrict queue, BLQueueMPSCNode* __restrict node);
+
+// Pops the oldest node off the queue. Returns NULL if the queue is empty. This
+// can also return NULL for a brief moment while a producer is in the middle of
+// a push. This must only be called by the single consumer thread.
+BLQueueMPSCNode* bl_queue_mpsc_pop(BLQueueMPSC* __restrict queue);
+
+// Blocks the consumer until a node is pushed onto the queue. Returns right away
+// if the queue is not empty. This may return spuriously, so callers should
+// loop around bl_queue_mpsc_pop().
+void bl_queue_mpsc_wait(BLQueueMPSC* __restrict queue);
+
+// Wakes the consumer out of bl_queue_mpsc_wait() even if nothing was pushed.
+// Useful to get the consumer to notice a shutdown request.
+void bl_queue_mpsc_wake(BLQueueMPSC* __restrict queue);
+
+// This MPSC implementation of a bounded queue stores elements by value in a
+// ring of cells, each tagged with a sequence number (after Dmitry Vyukov's
+// bounded MPMC queue). Producers claim a cell with a CAS on put and publish it
+// by bumping its sequence, so a slow producer never corrupts a faster one. The
+// capacity must be a power of two.
+struct BLQueueMPSCRing {
+  void* __restrict  buf;
+  size_t            capacity;     // total number of elements that could be stored in the queue
+  size_t            element_size; // size of each element in the queue
+  size_t            stride;       // size of each cell (sequence number + element)
+  char              pad1[128];    // next cache line
+  volatile int64_t  put;          // index of the next cell to claim (producers)
+  char              pad2[128];    // next cache line
+  int64_t           get;          // index of the read head (consumer)
+  volatile int32_t  wake;         // set by bl_queue_mpsc_ring_wake()
+  char              pad3[128];    // next cache line
+  BLEventCount      not_empty;    // blocked consumer waits on this
+};
+
+// Returns the size of the buffer required to hold capacity elements.
+size_t bl_queue_mpsc_ring_buffer_size(size_t capacity, size_t element_size);
+
+// Initializes a queue with a given buffer which must be at least
+// bl_queue_mpsc_ring_buffer_size() bytes and 8 byte aligned.
+void bl_queue_mpsc_ring_init(BLQueueMPSCRing* __restrict queue, void* __restrict buf, size_t capacity, size_t element_size);
+
+// Destroys a queue. The buffer is still owned by the caller.
+void bl_queue_mpsc_ring_destroy(BLQueueMPSCRing* __restrict queue);
+
+// Tries to fetch an element from the queue. Returns a pointer to the element if
+// there was data to read; NULL if the queue is empty. This call only returns a
+// pointer to the element in the queue, bl_queue_mpsc_ring_read_consume() must
+// be called to actually advance the read head.
+void* bl_queue_mpsc_ring_read_fetch(BLQueueMPSCRing* __restrict queue);
+
+// Consumes an item on the queue. This should only be called after a successful
+// call to bl_queue_mpsc_ring_read_fetch().
+void bl_queue_mpsc_ring_read_consume(BLQueueMPSCRing* __restrict queue);
+
+// Tries to claim an element in the queue. Returns a pointer to the element
+// that can be written; NULL if the queue is full. This may be called by any
+// number of threads concurrently. The element is not visible to the consumer
+// until it is passed to bl_queue_mpsc_ring_write_commit().
+void* bl_queue_mpsc_ring_write_prepare(BLQueueMPSCRing* __restrict queue);
+
+// Publishes an element returned by bl_queue_mpsc_ring_write_prepare(). Wakes
+// the consumer if it is blocked in bl_queue_mpsc_ring_wait().
+void bl_queue_mpsc_ring_write_commit(BLQueueMPSCRing* __restrict queue, void* __restrict element);
+
+// Blocks the consumer until an element is committed to the queue. Returns right
+// away if the queue is not empty. This may return spuriously.
+void bl_queue_mpsc_ring_wait(BLQueueMPSCRing* __restrict queue);
+
+// Wakes the consumer out of bl_queue_mpsc_ring_wait() even if nothing was
+// committed.
+void bl_queue_mpsc_ring_wake(BLQueueMPSCRing* __restrict queue);
+
+//
+// broadcast
+//
+
+// Read position of one consumer of a BLQueueBroadcast. Cursors are padded out to
+// a cache line so consumers don't false-share with each other.
+struct BLQueueBroadcastCursor {
+  volatile int64_t  get;          // index of this consumer's read head
+  char              pad[120];     // rest of the cache line
+};
+
+// This single producer, multiple consumer ring delivers every element to every
+// consumer (in the style of the LMAX Disruptor). Each consumer advances its own
+// cursor and the producer only reuses a slot once the slowest consumer has
+// moved past it, so an event is written once no matter how many consumers
+// there are. The capacity must be a power of two.
+struct BLQueueBroadcast {
+  void* __restrict                    buf;
+  size_t                              capacity;     // total number of elements that could be stored in the queue
+  size_t                              element_size; // size of each element in the queue
+  BLQueueBroadcastCursor* __restrict  cursors;      // one cursor per consumer
+  size_t                              cursor_count; // number of consumers
+  char                                pad1[128];    // next cache line
+  volatile int64_t                    put;          // index of the write head
+  int64_t                             gate;         // (producer) cached position of the slowest consumer
+};
+
+// Initializes a queue with a given buffer and array of consumer cursors.
+void bl_queue_broadcast_init(BLQueueBroadcast* __restrict queue, void* __restrict buf, size_t capacity, size_t element_size, BLQueueBroadcastCursor* __restrict cursors, size_t cursor_count);
+
+// Tries to fetch the next element for the given consumer. Returns a pointer to
+// the element if there was data to read; NULL if the consumer has caught up
+// with the producer. bl_queue_broadcast_read_consume() must be called to
+// actually advance the consumer's read head.
+void* bl_queue_broadcast_read_fetch(BLQueueBroadcast* __restrict queue, size_t consumer);
+
+// Consumes an item for the given consumer. This should only be called after a
+// successful call to bl_queue_broadcast_read_fetch().
+void bl_queue_broadcast_read_consume(BLQueueBroadcast* __restrict queue, size_t consumer);
+
+// Tries to prepare to write an element to the queue. Returns a pointer to the
+// element that can be written; NULL if the slowest consumer is a full lap
+// behind. bl_queue_broadcast_write_commit() must be called to actually
+// advance the write head.
+void* bl_queue_broadcast_write_prepare(BLQueueBroadcast* __restrict queue);
+
+// Commits a new element to the queue, making it visible to all consumers. This
+// should only be called after a successful call to
+// bl_queue_broadcast_write_prepare().
+void bl_queue_broadcast_write_commit(BLQueueBroadcast* __restrict queue);
+
+
+//
+// variable size SWSR
+//
+
+// alignment of every message in a BLQueueMsgSWSR (payloads are 16 byte aligned
+// if the buffer is)
+static const size_t BL_QUEUE_MSG_ALIGNMENT = 16;
+
+// This SWSR queue holds variable size messages packed back to back in a byte
+// ring so each message only takes the space it needs. The producer reserves
+// space, writes the message in place and commits it; the consumer reads it in
+// place. A message never straddles the end of the buffer; if it doesn't fit,
+// the rest of the buffer is skipped with a padding record. Every message
+// carries a small header and is rounded up to BL_QUEUE_MSG_ALIGNMENT bytes.
+// The buffer size must be a power of two.
+struct BLQueueMsgSWSR {
+  uint8_t* __restrict buf;
+  size_t              size;         // total number of bytes in the buffer
+  char                pad1[128];    // next cache line
+  volatile uint64_t   get;          // byte offset of the read head
+  char                pad2[128];    // next cache line
+  volatile uint64_t   put;          // byte offset of the write head
+  uint64_t            reserved;     // (producer) write head once the pending message is committed
+};
+
+// Initializes a queue with a given buffer.
+void bl_queue_msg_init(BLQueueMsgSWSR* __restrict queue, void* __restrict buf, size_t size);
+
+// Returns the largest message that can be written to the queue. Messages up to
+// this size always fit once the consumer has drained the queue, no matter where
+// the write head is (a larger message could need more than the whole buffer
+// once the padding before it is counted).
+size_t bl_queue_msg_max_size(const BLQueueMsgSWSR* __restrict queue);
+
+// Tries to fetch the next message from the queue. Returns a pointer to the
+// message and sets size to its size if there was data to read; NULL if the
+// queue is empty. bl_queue_msg_read_consume() must be called to actually
+// advance the read head.
+void* bl_queue_msg_read_fetch(BLQueueMsgSWSR* __restrict queue, size_t* __restrict size);
+
+// Consumes a message on the queue. This should only be called after a
+// successful call to bl_queue_msg_read_fetch().
+void bl_queue_msg_read_consume(BLQueueMsgSWSR* __restrict queue);
+
+// Tries to reserve size bytes for a new message. Returns a pointer to where the
+// message can be written; NULL if there isn't enough free space.
+// bl_queue_msg_write_commit() must be called to actually publish the message.
+void* bl_queue_msg_write_prepare(BLQueueMsgSWSR* __restrict queue, size_t size);
+
+// Commits a new message to the queue. This should only be called after a
+// successful call to bl_queue_msg_write_prepare().
+void bl_queue_msg_write_commit(BLQueueMsgSWSR* __restrict queue);
+
+
+//
+// priority
+//
+
+// Element of a BLQueuePriority. Lower priority values come out first, so a
+// deadline or an A* cost can be used as the priority directly.
+struct BLQueuePriorityItem {
+  uint64_t  priority;
+  void*     data;
+};
+
+// One of the binary heaps that make up a BLQueuePriority. Each heap sits on its
+// own cache line so threads working on different heaps don't false-share.
+struct BLQueuePriorityHeap {
+  BLQueuePriorityItem* __restrict items;
+  volatile size_t                 count;    // number of items in the heap
+  volatile uint64_t               top;      // priority of the smallest item (stale if empty)
+  volatile int32_t                lock;     // 1 while a thread owns the heap
+  char                            pad[100]; // rest of the cache line
+};
+
+// This concurrent priority queue is a relaxed multi-queue (after Rihani, Sanders
+// and Dementiev). Items are spread over several binary heaps, each guarded by
+// its own try-lock. A push goes to a random heap and a pop takes from the
+// better of two random heaps, so threads almost never wait on each other. In
+// exchange the order is only approximate: a pop returns one of the smallest
+// items in the queue, not necessarily the smallest. A few heaps per thread that
+// uses the queue works well.
+//
+// Heaps are picked with a per-thread random number generator. Every thread
+// keeps its own uint32_t seed (any non-zero value) and passes it to each call.
+struct BLQueuePriority {
+  BLQueuePriorityHeap* __restrict heaps;
+  size_t                          heap_count;     // number of heaps
+  size_t                          heap_capacity;  // max number of items in each heap
+};
+
+// Returns the size of the buffer required for the given number of heaps that
+// can each hold heap_capacity items.
+size_t bl_queue_priority_buffer_size(size_t heap_count, size_t heap_capacity);
+
+// Initializes an empty queue with a given buffer which must be at least
+// bl_queue_priority_buffer_size() bytes. The buffer should be 64 byte aligned.
+void bl_queue_priority_init(BLQueuePriority* __restrict queue, void* __restrict buf, size_t heap_count, size_t heap_capacity);
+
+// Pushes an item onto the queue. Returns false if every heap is full. This may
+// be called by any number of threads concurrently.
+bool bl_queue_priority_push(BLQueuePriority* __restrict queue, uint64_t priority, void* data, uint32_t* __restrict seed);
+
+// Pops one of the smallest items off the queue. Returns false if the queue is
+// empty. This may be called by any number of threads concurrently.
+bool bl_queue_priority_pop(BLQueuePriority* __restrict queue, BLQueuePriorityItem* __restrict item, uint32_t* __restrict seed);
+
+// Pushes a batch of items onto the queue, taking as few heap locks as possible.
+// Returns the number of items pushed, which is only less than count if the
+// queue filled up.
+size_t bl_queue_priority_push_batch(BLQueuePriority* __restrict queue, const BLQueuePriorityItem* __restrict items, size_t count, uint32_t* __restrict seed);
+
+// Pops up to max_count items off a single heap under one lock. The items come
+// out in order of that heap, so they are the best items of one heap rather
+// than the best of the whole queue. Returns the number of items popped; zero
+// if the queue is empty.
+size_t bl_queue_priority_pop_batch(BLQueuePriority* __restrict queue, BLQueuePriorityItem* __restrict items, size_t max_count, uint32_t* __restrict seed);
+
+//
+// shared memory
+//
+
+// These queues live entirely inside one caller-provided region of memory, e.g.
+// a shm_open() object or a file that two processes both mmap(). The header is
+// at the start of the region and the elements follow it. Nothing in the region
+// is a pointer, only sizes and indices with fixed widths, so each process can
+// map the region at a different address and 32 and 64 bit processes can share
+// it. Neither queue can block since the event counts are private to a process;
+// readers poll. The capacity must be a power of two.
+
+// Single writer, single reader queue in shared memory.
+struct BLQueueShmSWSR {
+  uint32_t          magic;        // set once the queue is initialized
+  uint32_t          reserved;
+  uint64_t          capacity;     // total number of elements that could be stored in the queue
+  uint64_t          element_size; // size of each element in the queue
+  char              pad1[104];    // next cache line
+  volatile uint64_t get;          // index of the read head
+  char              pad2[120];    // next cache line
+  volatile uint64_t put;          // index of the write head
+  char              pad3[120];    // elements start on the next cache line
+};
+
+// Multiple writer, single reader queue in shared memory. This is the same
+// sequence-tagged ring as BLQueueMPSCRing, so writers in any number of
+// processes can claim cells concurrently.
+struct BLQueueShmMPSC {
+  uint32_t          magic;        // set once the queue is initialized
+  uint32_t          reserved;
+  uint64_t          capacity;     // total number of elements that could be stored in the queue
+  uint64_t          element_size; // size of each element in the queue
+  uint64_t          stride;       // size of each cell (sequence number + element)
+  char              pad1[96];     // next cache line
+  volatile int64_t  put;          // index of the next cell to claim (writers)
+  char              pad2[120];    // next cache line
+  volatile int64_t  get;          // index of the read head (reader)
+  char              pad3[120];    // cells start on the next cache line
+};
+
+// Returns the size of the region required to hold the queue and capacity
+// elements.
+size_t bl_queue_shm_swsr_size(size_t capacity, size_t element_size);
+
+// Initializes a queue at the start of a region which must be at least
+// bl_queue_shm_swsr_size() bytes and 8 byte aligned. Only one process should
+// do this; the others attach.
+BLQueueShmSWSR* bl_queue_shm_swsr_init(void* __restrict region, size_t capacity, size_t element_size);
+
+// Returns the queue at the start of a region mapped by this process; NULL if
+// it hasn't been initialized yet or doesn't fit in region_size bytes.
+BLQueueShmSWSR* bl_queue_shm_swsr_attach(void* __restrict region, size_t region_size);
+
+// Tries to fetch an element from the queue. Returns a pointer to the element if
+// there was data to read; NULL if the queue is empty.
+// bl_queue_shm_swsr_read_consume() must be called to actually advance the read
+// head.
+void* bl_queue_shm_swsr_read_fetch(BLQueueShmSWSR* __restrict queue);
+
+// Consumes an item on the queue. This should only be called after a successful
+// call to bl_queue_shm_swsr_read_fetch().
+void bl_queue_shm_swsr_read_consume(BLQueueShmSWSR* __restrict queue);
+
+// Tries to prepare to write an element to the queue. Returns a pointer to the
+// element that can be written; NULL if the queue is full.
+// bl_queue_shm_swsr_write_commit() must be called to actually advance the
+// write head.
+void* bl_queue_shm_swsr_write_prepare(BLQueueShmSWSR* __restrict queue);
+
+// Commits a new element to the queue. This should only be called after a
+// successful call to bl_queue_shm_swsr_write_prepare().
+void bl_queue_shm_swsr_write_commit(BLQueueShmSWSR* __restrict queue);
+
+// Returns the size of the region required to hold the queue and capacity
+// elements.
+size_t bl_queue_shm_mpsc_size(size_t capacity, size_t element_size);
+
+// Initializes a queue at the start of a region which must be at least
+// bl_queue_shm_mpsc_size() bytes and 8 byte aligned. Only one process should
+// do this; the others attach.
+BLQueueShmMPSC* bl_queue_shm_mpsc_init(void* __restrict region, size_t capacity, size_t element_size);
+
+// Returns the queue at the start of a region mapped by this process; NULL if
+// it hasn't been initialized yet or doesn't fit in region_size bytes.
+BLQueueShmMPSC* bl_queue_shm_mpsc_attach(void* __restrict region, size_t region_size);
+
+// Tries to fetch an element from the queue. Returns a pointer to the element if
+// there was data to read; NULL if the queue is empty.
+// bl_queue_shm_mpsc_read_consume() must be called to actually advance the read
+// head.
+void* bl_queue_shm_mpsc_read_fetch(BLQueueShmMPSC* __restrict queue);
+
+// Consumes an item on the queue. This should only be called after a successful
+// call to bl_queue_shm_mpsc_read_fetch().
+void bl_queue_shm_mpsc_read_consume(BLQueueShmMPSC* __restrict queue);
+
+// Tries to claim an element in the queue. Returns a pointer to the element
+// that can be written; NULL if the queue is full. This may be called by any
+// number of threads in any number of processes concurrently.
+void* bl_queue_shm_mpsc_write_prepare(BLQueueShmMPSC* __restrict queue);
+
+// Publishes an element returned by bl_queue_shm_mpsc_write_prepare().
+void bl_queue_shm_mpsc_write_commit(BLQueueShmMPSC* __restrict queue, void* __restrict element);
+
+//
+// typed SWSR implementation
+//
+
+//------------------------------------------------------------------------------
+template<typename T, uint32_t N>
+inline void bl_queue_init(BLQueue<T, N>* __restrict queue) {
+  queue->get = 0;
+  queue->put = 0;
+}
+
+//------------------------------------------------------------------------------
+template<typename T, uint32_t N>
+inline T* bl_queue_read_fetch(BLQueue<T, N>* __restrict queue) {
+  uint32_t put = queue->put;
+  bl_atomic_barrier();
+  uint32_t get = queue->get;
+
+  // check empty queue
+  if (get == put) {
+    return NULL;
+  }
+
+  return queue->buf + (get & (N - 1));
+}
+
+//------------------------------------------------------------------------------
+template<typename T, uint32_t N>
+inline void bl_queue_read_consume(BLQueue<T, N>* __restrict queue) {
+  // make sure the element has been read before the slot is handed back
+  bl_atomic_barrier();
+  queue->get = queue->get + 1;
+}
+
+//------------------------------------------------------------------------------
+template<typename T, uint32_t N>
+inline T* bl_queue_write_prepare(BLQueue<T, N>* __restrict queue, bool* __restrict empty) {
+  uint32_t get = queue->get;
+  bl_atomic_barrier();
+  uint32_t put = queue->put;
+
+  // check full queue
+  if (BL_UNLIKELY((put - get) == N)) {
+    if (empty) {
+      *empty = false;
+    }
+    return NULL;
+  }
+
+  if (empty) {
+    *empty = (get == put);
+  }
+  return queue->buf + (put & (N - 1));
+}
+
+//------------------------------------------------------------------------------
+template<typename T, uint32_t N>
+inline void bl_queue_write_commit(BLQueue<T, N>* __restrict queue) {
+  // make sure the element is written before it is published
+  bl_atomic_barrier();
+  queue->put = queue->put + 1;
+}
+
+//------------------------------------------------------------------------------
+template<typename T, uint32_t N>
+inline bool bl_queue_push(BLQueue<T, N>* __restrict queue, const T& value) {
+  T* dest = bl_queue_write_prepare(queue);
+  if (BL_UNLIKELY(!dest)) {
+    return false;
+  }
+  *dest = value;
+  bl_queue_write_commit(queue);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template<typename T, uint32_t N>
+inline bool bl_queue_pop(BLQueue<T, N>* __restrict queue, T* __restrict value) {
+  T* src = bl_queue_read_fetch(queue);
+  if (!src) {
+    return false;
+  }
+  *value = *src;
+  bl_queue_read_consume(queue);
+  return true;
+}
+
 #endif
@@ -90,3 +90,68 @@ void bl_queue_write_commit(BLQueueSWSR* __restrict queue) {
   queue->put = put;
 }
 
+//------------------------------------------------------------------------------
+void bl_queue_blocking_init(BLQueueSWSRBlocking* __restrict queue, void* __restrict buf, size_t capacity, size_t element_size) {
+  bl_queue_init(&queue->queue, buf, capacity, element_size);
+  bl_event_count_create(&queue->not_empty);
+  bl_event_count_create(&queue->not_full);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_blocking_destroy(BLQueueSWSRBlocking* __restrict queue) {
+  bl_event_count_destroy(&queue->not_full);
+  bl_event_count_destroy(&queue->not_empty);
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_blocking_read_fetch(BLQueueSWSRBlocking* __restrict queue) {
+  for (;;) {
+    void* element = bl_queue_read_fetch(&queue->queue);
+    if (BL_LIKELY(element)) {
+      return element;
+    }
+
+    // announce that we're about to sleep and check again to catch a commit
+    // that happened before the writer could see us
+    int32_t key = bl_event_count_prepare_wait(&queue->not_empty);
+    element = bl_queue_read_fetch(&queue->queue);
+    if (element) {
+      bl_event_count_cancel_wait(&queue->not_empty);
+      return element;
+    }
+    bl_event_count_wait(&queue->not_empty, key);
+  }
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_blocking_read_consume(BLQueueSWSRBlocking* __restrict queue) {
+  bl_queue_read_consume(&queue->queue);
+  bl_event_count_notify_all(&queue->not_full);
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_blocking_write_prepare(BLQueueSWSRBlocking* __restrict queue) {
+  bool empty;
+  for (;;) {
+    void* element = bl_queue_write_prepare(&queue->queue, &empty);
+    if (BL_LIKELY(element)) {
+      return element;
+    }
+
+    // announce that we're about to sleep and check again to catch a consume
+    // that happened before the reader could see us
+    int32_t key = bl_event_count_prepare_wait(&queue->not_full);
+    element = bl_queue_write_prepare(&queue->queue, &empty);
+    if (element) {
+      bl_event_count_cancel_wait(&queue->not_full);
+      return element;
+    }
+    bl_event_count_wait(&queue->not_full, key);
+  }
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_blocking_write_commit(BLQueueSWSRBlocking* __restrict queue) {
+  bl_queue_write_commit(&queue->queue);
+  bl_event_count_notify_all(&queue->not_empty);
+}
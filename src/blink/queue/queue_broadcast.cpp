@@ -0,0 +1,122 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "../queue.h"
+
+//
+// local functions
+//
+
+//------------------------------------------------------------------------------
+static void* element_at(const BLQueueBroadcast* __restrict queue, int64_t index) {
+  size_t slot = (size_t)index & (queue->capacity - 1);
+  return (uint8_t*)queue->buf + (queue->element_size * slot);
+}
+
+//------------------------------------------------------------------------------
+static int64_t slowest_cursor(const BLQueueBroadcast* __restrict queue) {
+  int64_t slowest = queue->put;
+  for (size_t index = 0; index < queue->cursor_count; ++index) {
+    int64_t get = queue->cursors[index].get;
+    if (get < slowest) {
+      slowest = get;
+    }
+  }
+  return slowest;
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+void bl_queue_broadcast_init(BLQueueBroadcast* __restrict queue, void* __restrict buf, size_t capacity, size_t element_size, BLQueueBroadcastCursor* __restrict cursors, size_t cursor_count) {
+  BL_ASSERT(buf);
+  BL_ASSERT(cursors || cursor_count == 0);
+  BL_ASSERT_MSG(capacity > 0 && BL_IS_ALIGNED(capacity, capacity), "capacity must be a power of two");
+
+  queue->buf          = buf;
+  queue->capacity     = capacity;
+  queue->element_size = element_size;
+  queue->cursors      = cursors;
+  queue->cursor_count = cursor_count;
+  queue->put          = 0;
+  queue->gate         = 0;
+  for (size_t index = 0; index < cursor_count; ++index) {
+    cursors[index].get = 0;
+  }
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_broadcast_read_fetch(BLQueueBroadcast* __restrict queue, size_t consumer) {
+  BL_ASSERT(consumer < queue->cursor_count);
+  int64_t put = queue->put;
+  bl_atomic_barrier();
+  int64_t get = queue->cursors[consumer].get;
+
+  // check caught up with the producer
+  if (get == put) {
+    return NULL;
+  }
+
+  return element_at(queue, get);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_broadcast_read_consume(BLQueueBroadcast* __restrict queue, size_t consumer) {
+  BL_ASSERT(consumer < queue->cursor_count);
+  BLQueueBroadcastCursor* __restrict cursor = queue->cursors + consumer;
+
+  // make sure the element has been read before the producer can reuse the slot
+  bl_atomic_barrier();
+  cursor->get = cursor->get + 1;
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_broadcast_write_prepare(BLQueueBroadcast* __restrict queue) {
+  int64_t put = queue->put;
+
+  // only scan the consumer cursors when the cached gate says the ring may be
+  // full; most of the time the slowest consumer is well behind a full lap
+  if (BL_UNLIKELY(put - queue->gate >= (int64_t)queue->capacity)) {
+    queue->gate = slowest_cursor(queue);
+    bl_atomic_barrier();
+
+    // check full queue
+    if (put - queue->gate >= (int64_t)queue->capacity) {
+      return NULL;
+    }
+  }
+
+  return element_at(queue, put);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_broadcast_write_commit(BLQueueBroadcast* __restrict queue) {
+  // make sure the element is written before it is published
+  bl_atomic_barrier();
+  queue->put = queue->put + 1;
+}
@@ -0,0 +1,257 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "../queue.h"
+
+//
+// constants
+//
+
+// size of the sequence number stored in front of each ring cell
+static const size_t RING_CELL_HEADER_SIZE = 8;
+
+
+//
+// local functions
+//
+
+//------------------------------------------------------------------------------
+static void mpsc_link(BLQueueMPSC* __restrict queue, BLQueueMPSCNode* __restrict node) {
+  node->next = NULL;
+
+  // swing the head over to the new node and then link the old head to it. the
+  // consumer can't see the node until the link is written.
+  BLQueueMPSCNode* prev = (BLQueueMPSCNode*)bl_atomic_swap((void* volatile*)&queue->head, node);
+  prev->next = node;
+}
+
+//------------------------------------------------------------------------------
+static bool mpsc_is_empty(const BLQueueMPSC* __restrict queue) {
+  return (queue->tail == &queue->stub) && (queue->head == &queue->stub);
+}
+
+//------------------------------------------------------------------------------
+static volatile int64_t* ring_cell_sequence(const BLQueueMPSCRing* __restrict queue, int64_t index) {
+  size_t cell = (size_t)index & (queue->capacity - 1);
+  return (volatile int64_t*)((uint8_t*)queue->buf + (queue->stride * cell));
+}
+
+//------------------------------------------------------------------------------
+static bool ring_is_empty(const BLQueueMPSCRing* __restrict queue) {
+  int64_t get = queue->get;
+  return *ring_cell_sequence(queue, get) != get + 1;
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+void bl_queue_mpsc_init(BLQueueMPSC* __restrict queue) {
+  queue->stub.next  = NULL;
+  queue->head       = &queue->stub;
+  queue->tail       = &queue->stub;
+  queue->wake       = 0;
+  bl_event_count_create(&queue->not_empty);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_mpsc_destroy(BLQueueMPSC* __restrict queue) {
+  bl_event_count_destroy(&queue->not_empty);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_mpsc_push(BLQueueMPSC* __restrict queue, BLQueueMPSCNode* __restrict node) {
+  mpsc_link(queue, node);
+  bl_event_count_notify_all(&queue->not_empty);
+}
+
+//------------------------------------------------------------------------------
+BLQueueMPSCNode* bl_queue_mpsc_pop(BLQueueMPSC* __restrict queue) {
+  BLQueueMPSCNode* tail = queue->tail;
+  BLQueueMPSCNode* next = tail->next;
+  bl_atomic_barrier();
+
+  // skip over the stub
+  if (tail == &queue->stub) {
+    if (!next) {
+      return NULL;
+    }
+    queue->tail = next;
+    tail        = next;
+    next        = next->next;
+    bl_atomic_barrier();
+  }
+
+  // common case: there is a node behind the tail
+  if (next) {
+    queue->tail = next;
+    return tail;
+  }
+
+  // the tail is the last node. if it isn't also the head, a producer has
+  // swapped the head but not yet linked its node; try again later.
+  BLQueueMPSCNode* head = queue->head;
+  if (tail != head) {
+    return NULL;
+  }
+
+  // put the stub back behind the last node so it can be handed out
+  mpsc_link(queue, &queue->stub);
+  next = tail->next;
+  bl_atomic_barrier();
+  if (next) {
+    queue->tail = next;
+    return tail;
+  }
+  return NULL;
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_mpsc_wait(BLQueueMPSC* __restrict queue) {
+  // announce that we're going to sleep and then check the queue one more time
+  // to catch any push that happened before the producer could see us
+  int32_t key = bl_event_count_prepare_wait(&queue->not_empty);
+  if (!mpsc_is_empty(queue) || bl_atomic_swap(&queue->wake, 0)) {
+    bl_event_count_cancel_wait(&queue->not_empty);
+    return;
+  }
+  bl_event_count_wait(&queue->not_empty, key);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_mpsc_wake(BLQueueMPSC* __restrict queue) {
+  queue->wake = 1;
+  bl_event_count_notify_all(&queue->not_empty);
+}
+
+//------------------------------------------------------------------------------
+size_t bl_queue_mpsc_ring_buffer_size(size_t capacity, size_t element_size) {
+  return capacity * BL_ALIGN(RING_CELL_HEADER_SIZE + element_size, RING_CELL_HEADER_SIZE);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_mpsc_ring_init(BLQueueMPSCRing* __restrict queue, void* __restrict buf, size_t capacity, size_t element_size) {
+  BL_ASSERT(buf);
+  BL_ASSERT_MSG(capacity > 0 && BL_IS_ALIGNED(capacity, capacity), "capacity must be a power of two");
+  BL_ASSERT(BL_IS_ALIGNED_PTR(buf, RING_CELL_HEADER_SIZE));
+
+  queue->buf          = buf;
+  queue->capacity     = capacity;
+  queue->element_size = element_size;
+  queue->stride       = BL_ALIGN(RING_CELL_HEADER_SIZE + element_size, RING_CELL_HEADER_SIZE);
+  queue->put          = 0;
+  queue->get          = 0;
+  queue->wake         = 0;
+  bl_event_count_create(&queue->not_empty);
+
+  // each cell starts out free for the producer that claims its index
+  for (size_t index = 0; index < capacity; ++index) {
+    *ring_cell_sequence(queue, (int64_t)index) = (int64_t)index;
+  }
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_mpsc_ring_destroy(BLQueueMPSCRing* __restrict queue) {
+  bl_event_count_destroy(&queue->not_empty);
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_mpsc_ring_read_fetch(BLQueueMPSCRing* __restrict queue) {
+  int64_t get = queue->get;
+  volatile int64_t* sequence = ring_cell_sequence(queue, get);
+
+  // the cell is ready once its producer has committed it
+  if (*sequence != get + 1) {
+    return NULL;
+  }
+  bl_atomic_barrier();
+
+  return (uint8_t*)sequence + RING_CELL_HEADER_SIZE;
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_mpsc_ring_read_consume(BLQueueMPSCRing* __restrict queue) {
+  int64_t get = queue->get;
+  volatile int64_t* sequence = ring_cell_sequence(queue, get);
+
+  // hand the cell back to the producer that will claim it on the next lap
+  bl_atomic_barrier();
+  *sequence   = get + (int64_t)queue->capacity;
+  queue->get  = get + 1;
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_mpsc_ring_write_prepare(BLQueueMPSCRing* __restrict queue) {
+  int64_t put = queue->put;
+  for (;;) {
+    volatile int64_t* sequence = ring_cell_sequence(queue, put);
+    int64_t seq = *sequence;
+    bl_atomic_barrier();
+
+    int64_t diff = seq - put;
+    if (diff == 0) {
+      // the cell is free; try to claim it
+      if (bl_atomic_cas(&queue->put, put, put + 1)) {
+        return (uint8_t*)sequence + RING_CELL_HEADER_SIZE;
+      }
+    }
+    else if (diff < 0) {
+      // the consumer hasn't released this cell from the previous lap yet
+      return NULL;
+    }
+
+    // another producer beat us to this cell
+    put = queue->put;
+  }
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_mpsc_ring_write_commit(BLQueueMPSCRing* __restrict queue, void* __restrict element) {
+  volatile int64_t* sequence = (volatile int64_t*)((uint8_t*)element - RING_CELL_HEADER_SIZE);
+
+  // publish the element
+  bl_atomic_barrier();
+  *sequence = *sequence + 1;
+
+  bl_event_count_notify_all(&queue->not_empty);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_mpsc_ring_wait(BLQueueMPSCRing* __restrict queue) {
+  int32_t key = bl_event_count_prepare_wait(&queue->not_empty);
+  if (!ring_is_empty(queue) || bl_atomic_swap(&queue->wake, 0)) {
+    bl_event_count_cancel_wait(&queue->not_empty);
+    return;
+  }
+  bl_event_count_wait(&queue->not_empty, key);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_mpsc_ring_wake(BLQueueMPSCRing* __restrict queue) {
+  queue->wake = 1;
+  bl_event_count_notify_all(&queue->not_empty);
+}
@@ -0,0 +1,162 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "../queue.h"
+
+//
+// constants
+//
+
+enum MsgFlags {
+  MSG_FLAG_PADDING = 1 << 0,  // record only fills the end of the buffer
+};
+
+
+//
+// local types
+//
+
+struct MsgHeader {
+  uint32_t  size;   // size of the payload
+  uint32_t  flags;  // MsgFlags
+};
+
+// keep payloads aligned
+static const size_t MSG_HEADER_SIZE = BL_QUEUE_MSG_ALIGNMENT;
+BL_STATIC_ASSERT(sizeof(MsgHeader) <= BL_QUEUE_MSG_ALIGNMENT);
+
+
+//
+// local functions
+//
+
+//------------------------------------------------------------------------------
+static MsgHeader* header_at(const BLQueueMsgSWSR* __restrict queue, uint64_t offset) {
+  return (MsgHeader*)(queue->buf + ((size_t)offset & (queue->size - 1)));
+}
+
+//------------------------------------------------------------------------------
+static size_t record_size(size_t payload_size) {
+  return BL_ALIGN(MSG_HEADER_SIZE + payload_size, BL_QUEUE_MSG_ALIGNMENT);
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+void bl_queue_msg_init(BLQueueMsgSWSR* __restrict queue, void* __restrict buf, size_t size) {
+  BL_ASSERT(buf);
+  BL_ASSERT_MSG(size >= 2 * BL_QUEUE_MSG_ALIGNMENT && BL_IS_ALIGNED(size, size), "size must be a power of two");
+
+  queue->buf      = (uint8_t*)buf;
+  queue->size     = size;
+  queue->get      = 0;
+  queue->put      = 0;
+  queue->reserved = 0;
+}
+
+//------------------------------------------------------------------------------
+size_t bl_queue_msg_max_size(const BLQueueMsgSWSR* __restrict queue) {
+  return (queue->size / 2) - MSG_HEADER_SIZE;
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_msg_read_fetch(BLQueueMsgSWSR* __restrict queue, size_t* __restrict size) {
+  uint64_t put = queue->put;
+  bl_atomic_barrier();
+  uint64_t get = queue->get;
+
+  // check empty queue
+  if (get == put) {
+    return NULL;
+  }
+
+  // skip padding at the end of the buffer. a padding record is always committed
+  // along with the message after it, so there is always a message to read.
+  MsgHeader* header = header_at(queue, get);
+  if (header->flags & MSG_FLAG_PADDING) {
+    get += MSG_HEADER_SIZE + header->size;
+    queue->get = get;
+    BL_ASSERT(get != put);
+    header = header_at(queue, get);
+  }
+
+  *size = header->size;
+  return (uint8_t*)header + MSG_HEADER_SIZE;
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_msg_read_consume(BLQueueMsgSWSR* __restrict queue) {
+  uint64_t get = queue->get;
+  MsgHeader* header = header_at(queue, get);
+  BL_ASSERT(!(header->flags & MSG_FLAG_PADDING));
+
+  // make sure the message has been read before the space is handed back
+  bl_atomic_barrier();
+  queue->get = get + record_size(header->size);
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_msg_write_prepare(BLQueueMsgSWSR* __restrict queue, size_t size) {
+  BL_ASSERT(size <= bl_queue_msg_max_size(queue));
+
+  uint64_t get = queue->get;
+  bl_atomic_barrier();
+  uint64_t put = queue->put;
+
+  // if the message doesn't fit before the end of the buffer, pad out the rest
+  // of the buffer and start the message at the beginning
+  size_t needed     = record_size(size);
+  size_t offset     = (size_t)put & (queue->size - 1);
+  size_t contiguous = queue->size - offset;
+  size_t padding    = (needed > contiguous) ? contiguous : 0;
+
+  // check full queue
+  if (BL_UNLIKELY((put + padding + needed) - get > queue->size)) {
+    return NULL;
+  }
+
+  // the headers are beyond the write head so the consumer can't see them yet
+  if (padding) {
+    MsgHeader* pad_header = header_at(queue, put);
+    pad_header->size  = (uint32_t)(padding - MSG_HEADER_SIZE);
+    pad_header->flags = MSG_FLAG_PADDING;
+  }
+  MsgHeader* header = header_at(queue, put + padding);
+  header->size  = (uint32_t)size;
+  header->flags = 0;
+
+  queue->reserved = put + padding + needed;
+  return (uint8_t*)header + MSG_HEADER_SIZE;
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_msg_write_commit(BLQueueMsgSWSR* __restrict queue) {
+  // make sure the message is written before it is published
+  bl_atomic_barrier();
+  queue->put = queue->reserved;
+}
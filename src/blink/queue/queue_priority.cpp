@@ -0,0 +1,256 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "../queue.h"
+
+
+//
+// local functions
+//
+
+//------------------------------------------------------------------------------
+static uint32_t next_random(uint32_t* __restrict seed) {
+  // xorshift32
+  uint32_t x = *seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *seed = x;
+  return x;
+}
+
+//------------------------------------------------------------------------------
+static BLQueuePriorityHeap* random_heap(BLQueuePriority* __restrict queue, uint32_t* __restrict seed) {
+  return queue->heaps + (next_random(seed) % queue->heap_count);
+}
+
+//------------------------------------------------------------------------------
+static bool heap_try_lock(BLQueuePriorityHeap* __restrict heap) {
+  // look before trying the CAS so a busy heap's cache line isn't pulled away
+  // from its owner
+  return (heap->lock == 0) && bl_atomic_cas(&heap->lock, 0, 1);
+}
+
+//------------------------------------------------------------------------------
+static void heap_lock(BLQueuePriorityHeap* __restrict heap) {
+  while (!heap_try_lock(heap)) {
+  }
+}
+
+//------------------------------------------------------------------------------
+static void heap_unlock(BLQueuePriorityHeap* __restrict heap) {
+  // publish the heap before releasing it
+  bl_atomic_barrier();
+  heap->lock = 0;
+}
+
+//------------------------------------------------------------------------------
+static void heap_update_top(BLQueuePriorityHeap* __restrict heap) {
+  // an empty heap keeps its stale top, since readers check the count first
+  if (heap->count) {
+    heap->top = heap->items[0].priority;
+  }
+}
+
+//------------------------------------------------------------------------------
+static void heap_insert(BLQueuePriorityHeap* __restrict heap, const BLQueuePriorityItem& item) {
+  BLQueuePriorityItem* __restrict items = heap->items;
+
+  // sift the new item up from the bottom
+  size_t index = heap->count++;
+  while (index > 0) {
+    size_t parent = (index - 1) >> 1;
+    if (items[parent].priority <= item.priority) {
+      break;
+    }
+    items[index] = items[parent];
+    index = parent;
+  }
+  items[index] = item;
+}
+
+//------------------------------------------------------------------------------
+static BLQueuePriorityItem heap_remove_top(BLQueuePriorityHeap* __restrict heap) {
+  BLQueuePriorityItem* __restrict items = heap->items;
+  BLQueuePriorityItem top = items[0];
+
+  // sift the last item down from the top
+  size_t count = --heap->count;
+  if (count > 0) {
+    BLQueuePriorityItem last = items[count];
+    size_t index = 0;
+    for (;;) {
+      size_t child = (index << 1) + 1;
+      if (child >= count) {
+        break;
+      }
+      if ((child + 1 < count) && (items[child + 1].priority < items[child].priority)) {
+        ++child;
+      }
+      if (last.priority <= items[child].priority) {
+        break;
+      }
+      items[index] = items[child];
+      index = child;
+    }
+    items[index] = last;
+  }
+
+  return top;
+}
+
+//------------------------------------------------------------------------------
+static size_t heap_push_items(BLQueuePriority* __restrict queue, BLQueuePriorityHeap* __restrict heap, const BLQueuePriorityItem* __restrict items, size_t count) {
+  size_t room = queue->heap_capacity - heap->count;
+  size_t pushed = count < room ? count : room;
+  for (size_t index = 0; index < pushed; ++index) {
+    heap_insert(heap, items[index]);
+  }
+  heap_update_top(heap);
+  return pushed;
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+size_t bl_queue_priority_buffer_size(size_t heap_count, size_t heap_capacity) {
+  return (sizeof(BLQueuePriorityHeap) * heap_count) + (sizeof(BLQueuePriorityItem) * heap_count * heap_capacity);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_priority_init(BLQueuePriority* __restrict queue, void* __restrict buf, size_t heap_count, size_t heap_capacity) {
+  BL_ASSERT(heap_count > 0);
+  BL_ASSERT(heap_capacity > 0);
+  BL_ASSERT(BL_IS_ALIGNED_PTR(buf, 8));
+
+  queue->heaps          = (BLQueuePriorityHeap*)buf;
+  queue->heap_count     = heap_count;
+  queue->heap_capacity  = heap_capacity;
+
+  // the items for all heaps follow the heap headers
+  BLQueuePriorityItem* items = (BLQueuePriorityItem*)(queue->heaps + heap_count);
+  for (size_t index = 0; index < heap_count; ++index) {
+    BLQueuePriorityHeap* heap = queue->heaps + index;
+    heap->items = items + (index * heap_capacity);
+    heap->count = 0;
+    heap->top   = 0;
+    heap->lock  = 0;
+  }
+}
+
+//------------------------------------------------------------------------------
+bool bl_queue_priority_push(BLQueuePriority* __restrict queue, uint64_t priority, void* data, uint32_t* __restrict seed) {
+  BLQueuePriorityItem item;
+  item.priority = priority;
+  item.data     = data;
+  return bl_queue_priority_push_batch(queue, &item, 1, seed) == 1;
+}
+
+//------------------------------------------------------------------------------
+bool bl_queue_priority_pop(BLQueuePriority* __restrict queue, BLQueuePriorityItem* __restrict item, uint32_t* __restrict seed) {
+  return bl_queue_priority_pop_batch(queue, item, 1, seed) == 1;
+}
+
+//------------------------------------------------------------------------------
+size_t bl_queue_priority_push_batch(BLQueuePriority* __restrict queue, const BLQueuePriorityItem* __restrict items, size_t count, uint32_t* __restrict seed) {
+  BL_ASSERT(*seed != 0);
+
+  // push into random heaps, skipping any that another thread holds
+  size_t pushed = 0;
+  size_t full_count = 0;
+  while ((pushed < count) && (full_count < queue->heap_count)) {
+    BLQueuePriorityHeap* heap = random_heap(queue, seed);
+    if (!heap_try_lock(heap)) {
+      continue;
+    }
+    size_t heap_pushed = heap_push_items(queue, heap, items + pushed, count - pushed);
+    heap_unlock(heap);
+
+    pushed += heap_pushed;
+    if (heap_pushed == 0) {
+      ++full_count;
+    }
+  }
+
+  // the random heaps keep coming up full, so visit every heap in turn and fill
+  // whatever room is left
+  for (size_t index = 0; (pushed < count) && (index < queue->heap_count); ++index) {
+    BLQueuePriorityHeap* heap = queue->heaps + index;
+    heap_lock(heap);
+    pushed += heap_push_items(queue, heap, items + pushed, count - pushed);
+    heap_unlock(heap);
+  }
+
+  return pushed;
+}
+
+//------------------------------------------------------------------------------
+size_t bl_queue_priority_pop_batch(BLQueuePriority* __restrict queue, BLQueuePriorityItem* __restrict items, size_t max_count, uint32_t* __restrict seed) {
+  BL_ASSERT(*seed != 0);
+
+  for (;;) {
+    // take the better of two random heaps, judging by their published counts
+    // and tops so neither has to be locked to compare them
+    BLQueuePriorityHeap* heap = random_heap(queue, seed);
+    BLQueuePriorityHeap* other = random_heap(queue, seed);
+    if (other->count && (!heap->count || (other->top < heap->top))) {
+      heap = other;
+    }
+
+    // both are empty, so look for any heap with items before calling the queue
+    // empty
+    if (!heap->count) {
+      heap = NULL;
+      for (size_t index = 0; index < queue->heap_count; ++index) {
+        if (queue->heaps[index].count) {
+          heap = queue->heaps + index;
+          break;
+        }
+      }
+      if (!heap) {
+        return 0;
+      }
+    }
+
+    if (!heap_try_lock(heap)) {
+      continue;
+    }
+
+    // the heap may have been drained since its top was read
+    size_t count = heap->count < max_count ? heap->count : max_count;
+    for (size_t index = 0; index < count; ++index) {
+      items[index] = heap_remove_top(heap);
+    }
+    heap_update_top(heap);
+    heap_unlock(heap);
+
+    if (count > 0) {
+      return count;
+    }
+  }
+}
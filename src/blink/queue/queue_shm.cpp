@@ -0,0 +1,241 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "../queue.h"
+
+// marks an initialized queue header ('BLSQ' and 'BLMQ')
+static const uint32_t SWSR_MAGIC = 0x424c5351;
+static const uint32_t MPSC_MAGIC = 0x424c4d51;
+
+// size of the sequence number stored in front of each cell
+static const size_t CELL_HEADER_SIZE = 8;
+
+// the layout of the headers has to be the same in every process
+BL_STATIC_ASSERT(sizeof(BLQueueShmSWSR) == 384);
+BL_STATIC_ASSERT(sizeof(BLQueueShmMPSC) == 384);
+
+
+//
+// local functions
+//
+
+//------------------------------------------------------------------------------
+static uint8_t* swsr_element(BLQueueShmSWSR* __restrict queue, uint64_t index) {
+  uint64_t slot = index & (queue->capacity - 1);
+  return (uint8_t*)(queue + 1) + (queue->element_size * slot);
+}
+
+//------------------------------------------------------------------------------
+static volatile int64_t* mpsc_cell_sequence(BLQueueShmMPSC* __restrict queue, int64_t index) {
+  uint64_t cell = (uint64_t)index & (queue->capacity - 1);
+  return (volatile int64_t*)((uint8_t*)(queue + 1) + (queue->stride * cell));
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+size_t bl_queue_shm_swsr_size(size_t capacity, size_t element_size) {
+  return sizeof(BLQueueShmSWSR) + (capacity * element_size);
+}
+
+//------------------------------------------------------------------------------
+BLQueueShmSWSR* bl_queue_shm_swsr_init(void* __restrict region, size_t capacity, size_t element_size) {
+  BL_ASSERT(region);
+  BL_ASSERT_MSG(capacity > 0 && BL_IS_ALIGNED(capacity, capacity), "capacity must be a power of two");
+  BL_ASSERT(BL_IS_ALIGNED_PTR(region, 8));
+
+  BLQueueShmSWSR* queue = (BLQueueShmSWSR*)region;
+  queue->reserved     = 0;
+  queue->capacity     = capacity;
+  queue->element_size = element_size;
+  queue->get          = 0;
+  queue->put          = 0;
+
+  // publish the header to the other processes last
+  bl_atomic_barrier();
+  queue->magic = SWSR_MAGIC;
+  return queue;
+}
+
+//------------------------------------------------------------------------------
+BLQueueShmSWSR* bl_queue_shm_swsr_attach(void* __restrict region, size_t region_size) {
+  BLQueueShmSWSR* queue = (BLQueueShmSWSR*)region;
+  if ((region_size < sizeof(BLQueueShmSWSR)) || (((volatile BLQueueShmSWSR*)queue)->magic != SWSR_MAGIC)) {
+    return NULL;
+  }
+  bl_atomic_barrier();
+  if (bl_queue_shm_swsr_size(queue->capacity, queue->element_size) > region_size) {
+    return NULL;
+  }
+  return queue;
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_shm_swsr_read_fetch(BLQueueShmSWSR* __restrict queue) {
+  uint64_t put = queue->put;
+  bl_atomic_barrier();
+  uint64_t get = queue->get;
+
+  // check empty queue
+  if (get == put) {
+    return NULL;
+  }
+
+  return swsr_element(queue, get);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_shm_swsr_read_consume(BLQueueShmSWSR* __restrict queue) {
+  // make sure the element has been read before the writer can reuse it
+  bl_atomic_barrier();
+  queue->get = queue->get + 1;
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_shm_swsr_write_prepare(BLQueueShmSWSR* __restrict queue) {
+  uint64_t get = queue->get;
+  bl_atomic_barrier();
+  uint64_t put = queue->put;
+
+  // check full queue
+  if (BL_UNLIKELY(put - get >= queue->capacity)) {
+    return NULL;
+  }
+
+  return swsr_element(queue, put);
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_shm_swsr_write_commit(BLQueueShmSWSR* __restrict queue) {
+  // publish the element before advancing the put index
+  bl_atomic_barrier();
+  queue->put = queue->put + 1;
+}
+
+//------------------------------------------------------------------------------
+size_t bl_queue_shm_mpsc_size(size_t capacity, size_t element_size) {
+  return sizeof(BLQueueShmMPSC) + (capacity * BL_ALIGN(CELL_HEADER_SIZE + element_size, CELL_HEADER_SIZE));
+}
+
+//------------------------------------------------------------------------------
+BLQueueShmMPSC* bl_queue_shm_mpsc_init(void* __restrict region, size_t capacity, size_t element_size) {
+  BL_ASSERT(region);
+  BL_ASSERT_MSG(capacity > 0 && BL_IS_ALIGNED(capacity, capacity), "capacity must be a power of two");
+  BL_ASSERT(BL_IS_ALIGNED_PTR(region, CELL_HEADER_SIZE));
+
+  BLQueueShmMPSC* queue = (BLQueueShmMPSC*)region;
+  queue->reserved     = 0;
+  queue->capacity     = capacity;
+  queue->element_size = element_size;
+  queue->stride       = BL_ALIGN(CELL_HEADER_SIZE + element_size, CELL_HEADER_SIZE);
+  queue->put          = 0;
+  queue->get          = 0;
+
+  // each cell starts out free for the writer that claims its index
+  for (size_t index = 0; index < capacity; ++index) {
+    *mpsc_cell_sequence(queue, (int64_t)index) = (int64_t)index;
+  }
+
+  // publish the header to the other processes last
+  bl_atomic_barrier();
+  queue->magic = MPSC_MAGIC;
+  return queue;
+}
+
+//------------------------------------------------------------------------------
+BLQueueShmMPSC* bl_queue_shm_mpsc_attach(void* __restrict region, size_t region_size) {
+  BLQueueShmMPSC* queue = (BLQueueShmMPSC*)region;
+  if ((region_size < sizeof(BLQueueShmMPSC)) || (((volatile BLQueueShmMPSC*)queue)->magic != MPSC_MAGIC)) {
+    return NULL;
+  }
+  bl_atomic_barrier();
+  if (bl_queue_shm_mpsc_size(queue->capacity, queue->element_size) > region_size) {
+    return NULL;
+  }
+  return queue;
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_shm_mpsc_read_fetch(BLQueueShmMPSC* __restrict queue) {
+  int64_t get = queue->get;
+  volatile int64_t* sequence = mpsc_cell_sequence(queue, get);
+
+  // the cell is ready once its writer has committed it
+  if (*sequence != get + 1) {
+    return NULL;
+  }
+  bl_atomic_barrier();
+
+  return (uint8_t*)sequence + CELL_HEADER_SIZE;
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_shm_mpsc_read_consume(BLQueueShmMPSC* __restrict queue) {
+  int64_t get = queue->get;
+  volatile int64_t* sequence = mpsc_cell_sequence(queue, get);
+
+  // hand the cell back to the writer that will claim it on the next lap
+  bl_atomic_barrier();
+  *sequence   = get + (int64_t)queue->capacity;
+  queue->get  = get + 1;
+}
+
+//------------------------------------------------------------------------------
+void* bl_queue_shm_mpsc_write_prepare(BLQueueShmMPSC* __restrict queue) {
+  int64_t put = queue->put;
+  for (;;) {
+    volatile int64_t* sequence = mpsc_cell_sequence(queue, put);
+    int64_t seq = *sequence;
+    bl_atomic_barrier();
+
+    int64_t diff = seq - put;
+    if (diff == 0) {
+      // the cell is free; try to claim it
+      if (bl_atomic_cas(&queue->put, put, put + 1)) {
+        return (uint8_t*)sequence + CELL_HEADER_SIZE;
+      }
+    }
+    else if (diff < 0) {
+      // the reader hasn't released this cell from the previous lap yet
+      return NULL;
+    }
+
+    // another writer beat us to this cell
+    put = queue->put;
+  }
+}
+
+//------------------------------------------------------------------------------
+void bl_queue_shm_mpsc_write_commit(BLQueueShmMPSC* __restrict queue, void* __restrict element) {
+  volatile int64_t* sequence = (volatile int64_t*)((uint8_t*)element - CELL_HEADER_SIZE);
+  BL_UNUSED(queue);
+
+  // publish the element
+  bl_atomic_barrier();
+  *sequence = *sequence + 1;
+}
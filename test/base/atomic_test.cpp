@@ -79,4 +79,20 @@ SUITE(base) {
     
     CHECK_EQUAL(250 * thread_count, val);
   }
+
+  //-----------------------------------------------------------------------------
+  TEST(atomic_swap) {
+    volatile int32_t val32 = 3;
+    CHECK_EQUAL(3, bl_atomic_swap(&val32, 7));
+    CHECK_EQUAL(7, val32);
+
+    volatile int64_t val64 = 3;
+    CHECK_EQUAL(3, bl_atomic_swap(&val64, 7));
+    CHECK_EQUAL(7, val64);
+
+    int a, b;
+    void* volatile ptr = &a;
+    CHECK_EQUAL((void*)&a, bl_atomic_swap(&ptr, &b));
+    CHECK_EQUAL((void*)&b, ptr);
+  }
 }
@@ -52,6 +52,12 @@ struct SemaphoreTestParam {
   BLSemaphore*  sem1;
 };
 
+struct EventCountTestParam {
+  BLEventCount*     ec;
+  volatile int32_t* flag;
+  bool              done;
+};
+
 struct ThreadSpecificPtrTestParam {
   BLThreadSpecificPtr*  tsp;
   bool                  success;
@@ -114,6 +120,20 @@ static void semaphore_test_func(void* param) {
   bl_semaphore_post(p->sem1);
 }
 
+//------------------------------------------------------------------------------
+static void event_count_test_func(void* param) {
+  EventCountTestParam* p = (EventCountTestParam*)param;
+  while (!*p->flag) {
+    int32_t key = bl_event_count_prepare_wait(p->ec);
+    if (*p->flag) {
+      bl_event_count_cancel_wait(p->ec);
+      break;
+    }
+    bl_event_count_wait(p->ec, key);
+  }
+  p->done = true;
+}
+
 //------------------------------------------------------------------------------
 static void thread_specific_ptr_test_func(void* param) {
   ThreadSpecificPtrTestParam* p = (ThreadSpecificPtrTestParam*)param;
@@ -280,6 +300,48 @@ SUITE(base) {
     bl_semaphore_destroy(&sem1);
   }
 
+  //----------------------------------------------------------------------------
+  TEST(event_count) {
+    BLEventCount ec;
+    bl_event_count_create(&ec);
+
+    // notify with no waiters is harmless
+    bl_event_count_notify_all(&ec);
+
+    // a wait with a stale key returns right away
+    int32_t key = bl_event_count_prepare_wait(&ec);
+    bl_event_count_notify_all(&ec);
+    bl_event_count_wait(&ec, key);
+
+    // a timed wait gives up without a notify
+    key = bl_event_count_prepare_wait(&ec);
+    uint64_t start = bl_time_ns();
+    bl_event_count_wait_timeout(&ec, key, 20);
+    CHECK(bl_time_ns() - start >= 10000000ULL);
+
+    // wake several waiters
+    volatile int32_t flag = 0;
+    const int thread_count = 5;
+    EventCountTestParam params[thread_count];
+    BLThread threads[thread_count];
+    for (int index = 0; index < thread_count; ++index) {
+      params[index].ec = &ec;
+      params[index].flag = &flag;
+      params[index].done = false;
+      bl_thread_create(threads + index, &event_count_test_func, params + index);
+    }
+
+    flag = 1;
+    bl_event_count_notify_all(&ec);
+
+    for (int index = 0; index < thread_count; ++index) {
+      bl_thread_join(threads + index);
+      CHECK(params[index].done);
+    }
+
+    bl_event_count_destroy(&ec);
+  }
+
   //----------------------------------------------------------------------------
   TEST(thread_specific_ptr) {
     BLThreadSpecificPtr tsp;
@@ -0,0 +1,1271 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <unittest++/UnitTest++.h>
+#include <blink/io.h>
+#include <blink/job.h>
+
+static const uint32_t TEST_FILE_SIZE = 64 * 1024;
+
+//------------------------------------------------------------------------------
+static uint8_t test_byte(uint64_t offset) {
+  return (uint8_t)((offset * 7) ^ (offset >> 8));
+}
+
+//------------------------------------------------------------------------------
+// a pattern that compresses well but doesn't repeat exactly
+static uint8_t text_byte(uint64_t offset) {
+  static const char text[] = "the io threads read the blocks and the job workers decompress them. ";
+  return (uint8_t)text[(offset + offset / 1000) % (sizeof(text) - 1)];
+}
+
+//------------------------------------------------------------------------------
+// writes a file with a known byte pattern and starts the io lib with a few
+// threads so ops on the one file can run concurrently. the async queue is
+// kept shallow so bursts of reads back up behind it.
+struct IoFixture {
+  char path[64];
+
+  IoFixture(unsigned int async_queue_depth = 8) {
+    snprintf(path, sizeof(path), "/tmp/blink_io_test_%d", (int)getpid());
+    FILE* fp = fopen(path, "wb");
+    for (uint32_t index = 0; index < TEST_FILE_SIZE; ++index) {
+      fputc(test_byte(index), fp);
+    }
+    fclose(fp);
+
+    BLIoLibInitParams params;
+    params.thread_count       = 4;
+    params.async_queue_depth  = async_queue_depth;
+    params.cache_block_count  = 0;
+    params.decompress_on_jobs = false;
+    bl_io_lib_initialize(&params);
+  }
+
+  ~IoFixture() {
+    bl_io_lib_finalize();
+    unlink(path);
+  }
+};
+
+//------------------------------------------------------------------------------
+// services every read on the io threads
+struct IoThreadFixture : IoFixture {
+  IoThreadFixture() : IoFixture(0) {
+  }
+};
+
+//------------------------------------------------------------------------------
+// a single io thread and no async path so reads are issued one at a time in
+// the order the scheduler picks
+struct IoSchedFixture : IoFixture {
+  IoSchedFixture() {
+    bl_io_lib_finalize();
+    BLIoLibInitParams params;
+    params.thread_count       = 1;
+    params.async_queue_depth  = 0;
+    params.cache_block_count  = 0;
+    params.decompress_on_jobs = false;
+    bl_io_lib_initialize(&params);
+  }
+};
+
+// holds the io thread inside a read callback until released
+struct BlockerContext {
+  BLSemaphore   entered;
+  BLSemaphore   release;
+};
+
+// records the order reads complete in
+struct OrderContext {
+  BLIoOp*           ops[16];
+  volatile int32_t  count;
+};
+
+//------------------------------------------------------------------------------
+static void blocker_callback(BLIoOp*, void* context) {
+  BlockerContext* blocker = (BlockerContext*)context;
+  bl_semaphore_post(&blocker->entered);
+  bl_semaphore_wait(&blocker->release);
+}
+
+//------------------------------------------------------------------------------
+static void order_callback(BLIoOp* op, void* context) {
+  OrderContext* order = (OrderContext*)context;
+  order->ops[bl_atomic_increment(&order->count) - 1] = op;
+}
+
+//------------------------------------------------------------------------------
+// spaces completions out so a waiter would get to run between them
+static void pace_callback(BLIoOp*, void*) {
+  usleep(2000);
+}
+
+//------------------------------------------------------------------------------
+// times the calling thread has gone to sleep, or -1 where it can't be told
+static long sleep_count() {
+#ifdef RUSAGE_THREAD
+  rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  return usage.ru_nvcsw;
+#else
+  return -1;
+#endif
+}
+
+//------------------------------------------------------------------------------
+static bool check_pattern(const uint8_t* buffer, uint64_t offset, uint64_t size) {
+  for (uint64_t index = 0; index < size; ++index) {
+    if (buffer[index] != test_byte(offset + index)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// tallies the reads handed to jobs
+struct ReadJobContext {
+  volatile int32_t  ran;
+  volatile int32_t  good;
+};
+
+//------------------------------------------------------------------------------
+// checks the data the read brought in and deletes the op
+static void read_job(const BLJob* __restrict job) {
+  BLIoOp* op = (BLIoOp*)job->input;
+  ReadJobContext* context = (ReadJobContext*)job->output;
+  if (op->status == BL_IO_STATUS_OK && check_pattern((const uint8_t*)op->buffer, op->offset, op->fulfilled_size)) {
+    bl_atomic_increment(&context->good);
+  }
+  bl_atomic_increment(&context->ran);
+  bl_io_op_delete(op);
+}
+
+//------------------------------------------------------------------------------
+static bool check_text(const uint8_t* buffer, uint64_t offset, uint64_t size) {
+  for (uint64_t index = 0; index < size; ++index) {
+    if (buffer[index] != text_byte(offset + index)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+SUITE(io) {
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, sync_read_should_return_file_contents) {
+    BLIoFile* file;
+    uint64_t file_size = 0;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file, &file_size));
+    CHECK_EQUAL(TEST_FILE_SIZE, file_size);
+
+    uint8_t buffer[1000];
+    bl_io_file_seek_sync(file, 12345);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, buffer, sizeof(buffer)));
+    CHECK(check_pattern(buffer, 12345, sizeof(buffer)));
+    CHECK_EQUAL(12345u + sizeof(buffer), bl_io_file_tell_sync(file));
+
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, read_past_end_should_report_eof) {
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+    uint8_t buffer[256];
+    bl_io_file_seek_sync(file, TEST_FILE_SIZE - 100);
+    BLIoOp* op = bl_io_file_read(file, NULL, buffer, sizeof(buffer));
+    CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait(op));
+    CHECK_EQUAL(100u, op->fulfilled_size);
+    CHECK(check_pattern(buffer, TEST_FILE_SIZE - 100, 100));
+    bl_io_op_delete(op);
+
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, open_missing_file_should_fail) {
+    BLIoFile* file;
+    char missing[80];
+    snprintf(missing, sizeof(missing), "%s_missing", path);
+    CHECK_EQUAL(BL_IO_STATUS_ERROR_NOT_FOUND, bl_io_file_open_sync(missing, NULL, &file));
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, reads_queued_behind_open_should_complete) {
+    // issue the open, every read and the close without waiting in between so
+    // the reads spread across the threads while the open is still in flight
+    const uint32_t read_size = 1024;
+    const uint32_t read_count = TEST_FILE_SIZE / read_size;
+    uint8_t* buffer = (uint8_t*)bl_alloc(TEST_FILE_SIZE, 16);
+    BLIoOp* ops[read_count];
+
+    BLIoFile* file;
+    BLIoOp* open_op = bl_io_file_open(path, NULL, &file);
+    for (uint32_t index = 0; index < read_count; ++index) {
+      // read the blocks back to front to exercise out of order offsets
+      uint32_t block = read_count - 1 - index;
+      bl_io_file_seek_sync(file, block * read_size);
+      ops[index] = bl_io_file_read(file, NULL, buffer + block * read_size, read_size);
+    }
+    BLIoOp* close_op = bl_io_file_close(file, NULL);
+
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(close_op));
+    for (uint32_t index = 0; index < read_count; ++index) {
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(ops[index]));
+      CHECK_EQUAL(read_size, ops[index]->fulfilled_size);
+      bl_io_op_delete(ops[index]);
+    }
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(open_op));
+    CHECK_EQUAL(TEST_FILE_SIZE, open_op->fulfilled_size);
+    CHECK(check_pattern(buffer, 0, TEST_FILE_SIZE));
+
+    bl_io_op_delete(close_op);
+    bl_io_op_delete(open_op);
+    bl_free(buffer);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoThreadFixture, thread_reads_should_return_file_contents) {
+    const uint32_t read_size = 4096;
+    const uint32_t read_count = TEST_FILE_SIZE / read_size;
+    uint8_t* buffer = (uint8_t*)bl_alloc(TEST_FILE_SIZE + 16, 16);
+    BLIoOp* ops[read_count + 1];
+
+    BLIoFile* file;
+    BLIoOp* open_op = bl_io_file_open(path, NULL, &file);
+    for (uint32_t index = 0; index < read_count; ++index) {
+      ops[index] = bl_io_file_read(file, NULL, buffer + index * read_size, read_size);
+    }
+    ops[read_count] = bl_io_file_read(file, NULL, buffer + TEST_FILE_SIZE, 16);
+    BLIoOp* close_op = bl_io_file_close(file, NULL);
+
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(close_op));
+    for (uint32_t index = 0; index < read_count; ++index) {
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(ops[index]));
+      bl_io_op_delete(ops[index]);
+    }
+    CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait(ops[read_count]));
+    CHECK_EQUAL(0u, ops[read_count]->fulfilled_size);
+    bl_io_op_delete(ops[read_count]);
+    CHECK(check_pattern(buffer, 0, TEST_FILE_SIZE));
+
+    bl_io_op_delete(close_op);
+    bl_io_op_delete(open_op);
+    bl_free(buffer);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, readv_should_fill_each_buffer) {
+    // once on the async path and once on the io threads
+    for (uint32_t pass = 0; pass < 2; ++pass) {
+      if (pass == 1) {
+        bl_io_lib_finalize();
+        BLIoLibInitParams params;
+        params.thread_count       = 4;
+        params.async_queue_depth  = 0;
+        params.cache_block_count  = 0;
+        params.decompress_on_jobs = false;
+        bl_io_lib_initialize(&params);
+      }
+
+      BLIoFile* file;
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+      // three stretches of the file, one of them empty, each into its own buffer
+      uint8_t first[100];
+      uint8_t second[3000];
+      BLIoBuffer buffers[] = {
+        { first,  sizeof(first) },
+        { NULL,   0 },
+        { second, sizeof(second) },
+      };
+      bl_io_file_seek_sync(file, 777);
+      BLIoOp* op = bl_io_file_readv(file, NULL, buffers, 3);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(op));
+      CHECK_EQUAL(sizeof(first) + sizeof(second), op->fulfilled_size);
+      CHECK(check_pattern(first, 777, sizeof(first)));
+      CHECK(check_pattern(second, 777 + sizeof(first), sizeof(second)));
+      CHECK_EQUAL(777 + sizeof(first) + sizeof(second), bl_io_file_tell_sync(file));
+      bl_io_op_delete(op);
+
+      // off the end of the file the second buffer is only partly filled
+      memset(second, 0, sizeof(second));
+      bl_io_file_seek_sync(file, TEST_FILE_SIZE - 1000);
+      op = bl_io_file_readv(file, NULL, buffers, 3);
+      CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait(op));
+      CHECK_EQUAL(1000u, op->fulfilled_size);
+      CHECK(check_pattern(first, TEST_FILE_SIZE - 1000, sizeof(first)));
+      CHECK(check_pattern(second, TEST_FILE_SIZE - 900, 900));
+      bl_io_op_delete(op);
+
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, writes_should_land_in_order) {
+    char write_path[80];
+    snprintf(write_path, sizeof(write_path), "%s.write", path);
+
+    // issue everything without waiting so the writes queue behind the open
+    const uint32_t write_size = 4096;
+    const uint32_t write_count = TEST_FILE_SIZE / write_size;
+    uint8_t* src = (uint8_t*)bl_alloc(TEST_FILE_SIZE, 16);
+    for (uint32_t index = 0; index < TEST_FILE_SIZE; ++index) {
+      src[index] = test_byte(index);
+    }
+    BLIoFile* file;
+    BLIoOp* open_op = bl_io_file_open_write(write_path, NULL, 0, &file);
+    BLIoOp* ops[write_count];
+    for (uint32_t index = 0; index < write_count; ++index) {
+      ops[index] = bl_io_file_write(file, NULL, src + index * write_size, write_size);
+    }
+
+    // rewrite one block; it has to land after the first write of it
+    uint8_t zeros[write_size];
+    memset(zeros, 0, sizeof(zeros));
+    bl_io_file_seek_sync(file, 3 * write_size);
+    BLIoOp* rewrite_op = bl_io_file_write(file, NULL, zeros, write_size);
+    BLIoOp* flush_op = bl_io_file_flush(file, NULL);
+
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(flush_op));
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(open_op));
+    for (uint32_t index = 0; index < write_count; ++index) {
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(ops[index]));
+      CHECK_EQUAL(write_size, ops[index]->fulfilled_size);
+      bl_io_op_delete(ops[index]);
+    }
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(rewrite_op));
+    bl_io_op_delete(rewrite_op);
+    bl_io_op_delete(flush_op);
+    bl_io_op_delete(open_op);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+
+    // read it back
+    uint64_t file_size = 0;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(write_path, NULL, &file, &file_size));
+    CHECK_EQUAL(TEST_FILE_SIZE, file_size);
+    uint8_t* dest = (uint8_t*)bl_alloc(TEST_FILE_SIZE, 16);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, dest, TEST_FILE_SIZE));
+    CHECK(check_pattern(dest, 0, 3 * write_size));
+    CHECK(memcmp(dest + 3 * write_size, zeros, write_size) == 0);
+    CHECK(check_pattern(dest + 4 * write_size, 4 * write_size, TEST_FILE_SIZE - 4 * write_size));
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+
+    bl_free(dest);
+    bl_free(src);
+    unlink(write_path);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, small_writes_should_be_gathered) {
+    char write_path[80];
+    snprintf(write_path, sizeof(write_path), "%s.write", path);
+
+    uint8_t* src = (uint8_t*)bl_alloc(TEST_FILE_SIZE, 16);
+    for (uint32_t index = 0; index < TEST_FILE_SIZE; ++index) {
+      src[index] = test_byte(index);
+    }
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_write_sync(write_path, NULL, 1000, &file));
+
+    // odd sized writes that fill the buffer unevenly. each is done on return
+    // and its source could be thrown away.
+    uint64_t offset = 0;
+    for (uint32_t size = 1; offset + size <= 20000; size = (size * 7) % 997 + 1) {
+      BLIoOp* op = bl_io_file_write(file, NULL, src + offset, size);
+      CHECK_EQUAL(BL_IO_STATUS_OK, op->status);
+      CHECK_EQUAL(size, op->fulfilled_size);
+      bl_io_op_delete(op);
+      offset += size;
+    }
+
+    // skip ahead, which sends off what's gathered, then write the rest with a
+    // write too big to gather
+    bl_io_file_seek_sync(file, 30000);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_write_sync(file, NULL, src + 30000, 10));
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_write_sync(file, NULL, src + 30010, TEST_FILE_SIZE - 30010));
+    bl_io_file_seek_sync(file, offset);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_write_sync(file, NULL, src + offset, 30000 - offset));
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_flush_sync(file, NULL));
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+
+    // read it back
+    uint64_t file_size = 0;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(write_path, NULL, &file, &file_size));
+    CHECK_EQUAL(TEST_FILE_SIZE, file_size);
+    uint8_t* dest = (uint8_t*)bl_alloc(TEST_FILE_SIZE, 16);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, dest, TEST_FILE_SIZE));
+    CHECK(check_pattern(dest, 0, TEST_FILE_SIZE));
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+
+    bl_free(dest);
+    bl_free(src);
+    unlink(write_path);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, repeated_reads_should_hit_the_cache) {
+    // once on the async path and once on the io threads, with room for only
+    // two blocks
+    for (uint32_t pass = 0; pass < 2; ++pass) {
+      bl_io_lib_finalize();
+      BLIoLibInitParams params;
+      params.thread_count       = 4;
+      params.async_queue_depth  = (pass == 0) ? 8 : 0;
+      params.cache_block_count  = 2;
+      params.decompress_on_jobs = false;
+      bl_io_lib_initialize(&params);
+
+      BLIoFile* file;
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+      // the first read brings in its block, the rest are served from it
+      uint8_t buffer[200];
+      for (uint32_t index = 0; index < 3; ++index) {
+        memset(buffer, 0, sizeof(buffer));
+        bl_io_file_seek_sync(file, 20000 + index * 100);
+        CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, buffer, sizeof(buffer)));
+        CHECK(check_pattern(buffer, 20000 + index * 100, sizeof(buffer)));
+      }
+      BLIoCacheStats stats;
+      bl_io_cache_get_stats(&stats);
+      CHECK_EQUAL(2u, stats.hits);
+      CHECK_EQUAL(1u, stats.misses);
+
+      // the last block of the file is cached short; reading past it still
+      // goes to the file and reports eof
+      bl_io_file_seek_sync(file, TEST_FILE_SIZE - 100);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, buffer, 100));
+      bl_io_file_seek_sync(file, TEST_FILE_SIZE - 50);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, buffer, 50));
+      CHECK(check_pattern(buffer, TEST_FILE_SIZE - 50, 50));
+      bl_io_file_seek_sync(file, TEST_FILE_SIZE - 50);
+      BLIoOp* op = bl_io_file_read(file, NULL, buffer, 100);
+      CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait(op));
+      CHECK_EQUAL(50u, op->fulfilled_size);
+      bl_io_op_delete(op);
+      bl_io_cache_get_stats(&stats);
+      CHECK_EQUAL(3u, stats.hits);
+      CHECK_EQUAL(3u, stats.misses);
+
+      // a read straddling into a third block pushes one out
+      bl_io_file_seek_sync(file, 2 * BL_IO_CACHE_BLOCK_SIZE - 100);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, buffer, sizeof(buffer)));
+      CHECK(check_pattern(buffer, 2 * BL_IO_CACHE_BLOCK_SIZE - 100, sizeof(buffer)));
+      bl_io_cache_get_stats(&stats);
+      CHECK(stats.evictions > 0);
+
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, unbuffered_reads_should_handle_any_alignment) {
+    // once on the async path and once on the io threads
+    for (uint32_t pass = 0; pass < 2; ++pass) {
+      if (pass == 1) {
+        bl_io_lib_finalize();
+        BLIoLibInitParams params;
+        params.thread_count       = 4;
+        params.async_queue_depth  = 0;
+        params.cache_block_count  = 0;
+        params.decompress_on_jobs = false;
+        bl_io_lib_initialize(&params);
+      }
+
+      BLIoFile* file;
+      uint64_t file_size = 0;
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_unbuffered_sync(path, NULL, &file, &file_size));
+      CHECK_EQUAL(TEST_FILE_SIZE, file_size);
+      uint8_t* buffer = (uint8_t*)bl_alloc(5 * BL_IO_UNBUFFERED_ALIGNMENT, BL_IO_UNBUFFERED_ALIGNMENT);
+
+      // everything aligned
+      bl_io_file_seek_sync(file, BL_IO_UNBUFFERED_ALIGNMENT);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, buffer, 2 * BL_IO_UNBUFFERED_ALIGNMENT));
+      CHECK(check_pattern(buffer, BL_IO_UNBUFFERED_ALIGNMENT, 2 * BL_IO_UNBUFFERED_ALIGNMENT));
+
+      // unaligned offset, size and buffer
+      memset(buffer, 0, 5 * BL_IO_UNBUFFERED_ALIGNMENT);
+      bl_io_file_seek_sync(file, 1000);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, buffer + 1, 10000));
+      CHECK(check_pattern(buffer + 1, 1000, 10000));
+
+      // unaligned ends around an aligned middle that lines up with the buffer
+      bl_io_file_seek_sync(file, 3 * BL_IO_UNBUFFERED_ALIGNMENT - 10);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, buffer + BL_IO_UNBUFFERED_ALIGNMENT - 10, 3 * BL_IO_UNBUFFERED_ALIGNMENT + 20));
+      CHECK(check_pattern(buffer + BL_IO_UNBUFFERED_ALIGNMENT - 10, 3 * BL_IO_UNBUFFERED_ALIGNMENT - 10, 3 * BL_IO_UNBUFFERED_ALIGNMENT + 20));
+
+      // a vectored read with an unaligned piece
+      BLIoBuffer buffers[] = {
+        { buffer,                                   BL_IO_UNBUFFERED_ALIGNMENT },
+        { buffer + 2 * BL_IO_UNBUFFERED_ALIGNMENT + 3, 700 },
+      };
+      bl_io_file_seek_sync(file, 0);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_readv_sync(file, NULL, buffers, 2));
+      CHECK(check_pattern(buffer, 0, BL_IO_UNBUFFERED_ALIGNMENT));
+      CHECK(check_pattern(buffer + 2 * BL_IO_UNBUFFERED_ALIGNMENT + 3, BL_IO_UNBUFFERED_ALIGNMENT, 700));
+
+      // off the end of the file, aligned and not
+      bl_io_file_seek_sync(file, TEST_FILE_SIZE - BL_IO_UNBUFFERED_ALIGNMENT);
+      BLIoOp* op = bl_io_file_read(file, NULL, buffer, 2 * BL_IO_UNBUFFERED_ALIGNMENT);
+      CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait(op));
+      CHECK_EQUAL(BL_IO_UNBUFFERED_ALIGNMENT, op->fulfilled_size);
+      CHECK(check_pattern(buffer, TEST_FILE_SIZE - BL_IO_UNBUFFERED_ALIGNMENT, BL_IO_UNBUFFERED_ALIGNMENT));
+      bl_io_op_delete(op);
+      bl_io_file_seek_sync(file, TEST_FILE_SIZE - 100);
+      op = bl_io_file_read(file, NULL, buffer + 5, 300);
+      CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait(op));
+      CHECK_EQUAL(100u, op->fulfilled_size);
+      CHECK(check_pattern(buffer + 5, TEST_FILE_SIZE - 100, 100));
+      bl_io_op_delete(op);
+
+      bl_free(buffer);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, deleted_ops_should_be_reused) {
+    BLIoFile* file;
+    BLIoOp* op = bl_io_file_open(path, NULL, &file);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait_timeout(op, 5000));
+    bl_io_op_delete(op);
+
+    // the free list hands back the op that was just deleted
+    uint8_t buffer[64];
+    BLIoOp* read_op = bl_io_file_read(file, NULL, buffer, sizeof(buffer));
+    CHECK(read_op == op);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(read_op));
+    CHECK_EQUAL(sizeof(buffer), read_op->fulfilled_size);
+    CHECK(check_pattern(buffer, 0, sizeof(buffer)));
+    bl_io_op_delete(read_op);
+
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, completion_queue_should_collect_finished_ops) {
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+    // issue a read for every 1K of the file, all posting to one queue
+    const uint32_t read_size = 1024;
+    const uint32_t read_count = TEST_FILE_SIZE / read_size;
+    BLIoCompletionQueue* queue = bl_io_completion_queue_create();
+    BLIoOpAttr attr = {};
+    attr.completion_queue = queue;
+    uint8_t* buffer = (uint8_t*)bl_alloc(TEST_FILE_SIZE, 16);
+    for (uint32_t index = 0; index < read_count; ++index) {
+      bl_io_file_read(file, &attr, buffer + index * read_size, read_size);
+    }
+
+    // drain them a few at a time, sleeping whenever none are ready
+    uint32_t drained = 0;
+    uint32_t largest_batch = 0;
+    while (drained < read_count) {
+      BLIoOp* ops[8];
+      uint32_t count = bl_io_completion_queue_drain(queue, ops, 8);
+      if (count == 0) {
+        bl_io_completion_queue_wait(queue);
+        continue;
+      }
+      for (uint32_t index = 0; index < count; ++index) {
+        CHECK_EQUAL(BL_IO_STATUS_OK, ops[index]->status);
+        CHECK_EQUAL(read_size, ops[index]->fulfilled_size);
+        CHECK(check_pattern((const uint8_t*)ops[index]->buffer, ops[index]->offset, read_size));
+        bl_io_op_delete(ops[index]);
+      }
+      drained += count;
+      largest_batch = (count > largest_batch) ? count : largest_batch;
+    }
+    CHECK_EQUAL(read_count, drained);
+    CHECK(largest_batch <= 8);
+    BLIoOp* extra;
+    CHECK_EQUAL(0u, bl_io_completion_queue_drain(queue, &extra, 1));
+
+    bl_free(buffer);
+    bl_io_completion_queue_destroy(queue);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, read_jobs_should_run_once_reads_complete) {
+    BLJobLibInitParams job_params;
+    job_params.worker_thread_count = 2;
+    CHECK_EQUAL(BL_JOB_STATUS_OK, bl_job_lib_initialize(&job_params));
+    BLJobQueue* job_queue = bl_job_queue_create();
+
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+    // issue a read for every 1K of the file, each handing off to its own job
+    const uint32_t read_size = 1024;
+    const uint32_t read_count = TEST_FILE_SIZE / read_size;
+    BLJob* jobs = (BLJob*)bl_alloc(sizeof(BLJob) * read_count, 128);
+    uint8_t* buffer = (uint8_t*)bl_alloc(TEST_FILE_SIZE, 16);
+    ReadJobContext context = { 0, 0 };
+    for (uint32_t index = 0; index < read_count; ++index) {
+      BLJob* job = jobs + index;
+      job->func   = &read_job;
+      job->input  = NULL;
+      job->output = &context;
+      BLIoOpAttr attr = {};
+      attr.job       = job;
+      attr.job_queue = job_queue;
+      bl_io_file_read(file, &attr, buffer + index * read_size, read_size);
+    }
+
+    // waiting on the job queue covers the reads still in flight too
+    CHECK_EQUAL(BL_JOB_STATUS_OK, bl_job_queue_wait(job_queue));
+    CHECK_EQUAL((int32_t)read_count, context.ran);
+    CHECK_EQUAL((int32_t)read_count, context.good);
+
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+    bl_free(buffer);
+    bl_free(jobs);
+    bl_job_queue_destroy(job_queue);
+    bl_job_lib_finalize();
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, stream_should_hand_out_a_range_in_order) {
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+    // a range that doesn't end on a chunk boundary
+    const uint64_t start = 100;
+    const uint64_t size = TEST_FILE_SIZE - 300;
+    BLIoStream* stream = bl_io_stream_create(file, start, size, 4096, 3);
+    uint64_t offset = start;
+    uint32_t chunk_count = 0;
+    for (;;) {
+      const void* data;
+      uint64_t chunk_size;
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_stream_next(stream, &data, &chunk_size));
+      if (chunk_size == 0) {
+        break;
+      }
+      CHECK(chunk_size <= 4096u);
+      CHECK(check_pattern((const uint8_t*)data, offset, chunk_size));
+      offset += chunk_size;
+      ++chunk_count;
+    }
+    CHECK_EQUAL(start + size, offset);
+    CHECK_EQUAL((uint32_t)((size + 4095) / 4096), chunk_count);
+    const void* data;
+    uint64_t chunk_size;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_stream_next(stream, &data, &chunk_size));
+    CHECK_EQUAL(0u, chunk_size);
+    bl_io_stream_destroy(stream);
+
+    // a range running off the end of the file
+    stream = bl_io_stream_create(file, TEST_FILE_SIZE - 1000, 4096, 800, 2);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_stream_next(stream, &data, &chunk_size));
+    CHECK_EQUAL(800u, chunk_size);
+    CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_stream_next(stream, &data, &chunk_size));
+    CHECK_EQUAL(200u, chunk_size);
+    CHECK(check_pattern((const uint8_t*)data, TEST_FILE_SIZE - 200, 200));
+    bl_io_stream_destroy(stream);
+
+    // giving up part way
+    stream = bl_io_stream_create(file, 0, TEST_FILE_SIZE, 1024, 8);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_stream_next(stream, &data, &chunk_size));
+    CHECK(check_pattern((const uint8_t*)data, 0, 1024));
+    bl_io_stream_destroy(stream);
+
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, damaged_packs_should_be_rejected) {
+    char pack_path[80];
+    snprintf(pack_path, sizeof(pack_path), "%s_pack", path);
+    const char* entry_names[]   = { "a.bin", "b.bin" };
+    const char* source_names[]  = { path, path };
+
+    // each pass rebuilds the pack then damages the toc of the copy on disk:
+    // an entry inside the header, an entry whose end wraps past the end of
+    // the file and a header claiming every slot is taken
+    for (uint32_t pass = 0; pass < 3; ++pass) {
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_pack_build(pack_path, entry_names, source_names, 2));
+      FILE* fp = fopen(pack_path, "r+b");
+      uint32_t slot_count;
+      uint64_t toc_offset;
+      fseek(fp, 12, SEEK_SET);
+      fread(&slot_count, sizeof(slot_count), 1, fp);
+      fread(&toc_offset, sizeof(toc_offset), 1, fp);
+
+      // find a used slot; slots are a key, an offset and a size
+      uint64_t slot[3] = { 0, 0, 0 };
+      uint32_t slot_index = 0;
+      for (; slot_index < slot_count; ++slot_index) {
+        fseek(fp, (long)(toc_offset + slot_index * sizeof(slot)), SEEK_SET);
+        fread(slot, sizeof(slot), 1, fp);
+        if (slot[1] != 0) {
+          break;
+        }
+      }
+      if (pass == 0) {
+        slot[1] = 8;
+      }
+      else if (pass == 1) {
+        slot[2] = ~0ULL - 100;
+      }
+      fseek(fp, (long)(toc_offset + slot_index * sizeof(slot)), SEEK_SET);
+      fwrite(slot, sizeof(slot), 1, fp);
+      if (pass == 2) {
+        fseek(fp, 8, SEEK_SET);
+        fwrite(&slot_count, sizeof(slot_count), 1, fp);
+      }
+      fclose(fp);
+
+      BLIoPack* pack;
+      CHECK_EQUAL(BL_IO_STATUS_ERROR_BAD_FORMAT, bl_io_pack_open_sync(pack_path, &pack));
+    }
+
+    unlink(pack_path);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, map_should_expose_file_contents) {
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+    // the whole file
+    BLIoMapping mapping;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_map(file, 0, 0, BL_IO_MAP_ADVICE_SEQUENTIAL | BL_IO_MAP_ADVICE_WILLNEED, &mapping));
+    CHECK_EQUAL(TEST_FILE_SIZE, mapping.size);
+    CHECK(check_pattern((const uint8_t*)mapping.data, 0, TEST_FILE_SIZE));
+    bl_io_file_unmap(&mapping);
+
+    // a range that doesn't start on a page boundary
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_map(file, 5000, 3000, BL_IO_MAP_ADVICE_HUGEPAGE, &mapping));
+    CHECK_EQUAL(3000u, mapping.size);
+    CHECK(check_pattern((const uint8_t*)mapping.data, 5000, 3000));
+
+    // the view outlives the file
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+    CHECK(check_pattern((const uint8_t*)mapping.data, 5000, 3000));
+    bl_io_file_unmap(&mapping);
+    CHECK(mapping.data == NULL);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, map_past_end_should_report_eof) {
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+    BLIoMapping mapping;
+    CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_file_map(file, TEST_FILE_SIZE - 10, 20, 0, &mapping));
+    CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_file_map(file, TEST_FILE_SIZE + 1, 0, 0, &mapping));
+
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, pack_entries_should_read_like_files) {
+    // the test file whole, and a small second file with the pattern's tail
+    char small_path[80];
+    char pack_path[80];
+    snprintf(small_path, sizeof(small_path), "%s_small", path);
+    snprintf(pack_path, sizeof(pack_path), "%s_pack", path);
+    FILE* fp = fopen(small_path, "wb");
+    for (uint32_t index = 0; index < 100; ++index) {
+      fputc(test_byte(TEST_FILE_SIZE - 100 + index), fp);
+    }
+    fclose(fp);
+
+    const char* entry_names[]   = { "data/small.bin", "data/big.bin" };
+    const char* source_names[]  = { small_path, path };
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_pack_build(pack_path, entry_names, source_names, 2));
+    const char* duplicate_names[] = { "a", "a" };
+    CHECK_EQUAL(BL_IO_STATUS_ERROR_DUPLICATE_ENTRY, bl_io_pack_build(pack_path, duplicate_names, source_names, 2));
+
+    // a file that isn't a pack
+    BLIoPack* pack;
+    CHECK_EQUAL(BL_IO_STATUS_ERROR_BAD_FORMAT, bl_io_pack_open_sync(small_path, &pack));
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_pack_build(pack_path, entry_names, source_names, 2));
+
+    // once on the async path and once on the io threads
+    for (uint32_t pass = 0; pass < 2; ++pass) {
+      if (pass == 1) {
+        bl_io_lib_finalize();
+        BLIoLibInitParams params;
+        params.thread_count       = 4;
+        params.async_queue_depth  = 0;
+        params.cache_block_count  = 0;
+        params.decompress_on_jobs = false;
+        bl_io_lib_initialize(&params);
+      }
+
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_pack_open_sync(pack_path, &pack));
+      BLIoFile* file;
+      CHECK_EQUAL(BL_IO_STATUS_ERROR_NOT_FOUND, bl_io_pack_entry_open(pack, "data/missing.bin", &file));
+
+      BLIoFile* small;
+      BLIoFile* big;
+      uint64_t size = 0;
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_pack_entry_open(pack, "data/small.bin", &small, &size));
+      CHECK_EQUAL(100u, size);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_pack_entry_open(pack, "data/big.bin", &big, &size));
+      CHECK_EQUAL(TEST_FILE_SIZE, size);
+
+      uint8_t* buffer = (uint8_t*)bl_alloc(TEST_FILE_SIZE, 16);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(big, NULL, buffer, TEST_FILE_SIZE));
+      CHECK(check_pattern(buffer, 0, TEST_FILE_SIZE));
+
+      // reads stop at the end of the entry, not the pack
+      BLIoOp* op = bl_io_file_read(small, NULL, buffer, 300);
+      CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait(op));
+      CHECK_EQUAL(100u, op->fulfilled_size);
+      CHECK(check_pattern(buffer, TEST_FILE_SIZE - 100, 100));
+      bl_io_op_delete(op);
+      op = bl_io_file_read(small, NULL, buffer, 10);
+      CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait(op));
+      CHECK_EQUAL(0u, op->fulfilled_size);
+      bl_io_op_delete(op);
+
+      // vectored reads and views are relative to the entry too
+      uint8_t first[10];
+      uint8_t second[20];
+      BLIoBuffer buffers[] = {
+        { first,  sizeof(first) },
+        { second, sizeof(second) },
+      };
+      bl_io_file_seek_sync(big, 5000);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_readv_sync(big, NULL, buffers, 2));
+      CHECK(check_pattern(first, 5000, sizeof(first)));
+      CHECK(check_pattern(second, 5000 + sizeof(first), sizeof(second)));
+
+      BLIoMapping mapping;
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_map(small, 0, 0, 0, &mapping));
+      CHECK_EQUAL(100u, mapping.size);
+      CHECK(check_pattern((const uint8_t*)mapping.data, TEST_FILE_SIZE - 100, 100));
+      bl_io_file_unmap(&mapping);
+
+      bl_free(buffer);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(small, NULL));
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(big, NULL));
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_pack_close_sync(pack));
+    }
+
+    unlink(small_path);
+    unlink(pack_path);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoFixture, compressed_reads_should_return_the_original_data) {
+    // text that ends part way through a block, and the test file whose
+    // blocks don't shrink and are stored as they are
+    const uint32_t text_size = 100000;
+    char text_path[80];
+    char compressed_path[80];
+    char stored_path[80];
+    snprintf(text_path, sizeof(text_path), "%s_text", path);
+    snprintf(compressed_path, sizeof(compressed_path), "%s_text.z", path);
+    snprintf(stored_path, sizeof(stored_path), "%s.z", path);
+    FILE* fp = fopen(text_path, "wb");
+    for (uint32_t index = 0; index < text_size; ++index) {
+      fputc(text_byte(index), fp);
+    }
+    fclose(fp);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_compress_file(text_path, compressed_path, 16 * 1024));
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_compress_file(path, stored_path, 4096));
+
+    BLIoFile* file;
+    uint64_t size = 0;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(compressed_path, NULL, &file, &size));
+    CHECK(size < text_size / 4);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+    CHECK_EQUAL(BL_IO_STATUS_ERROR_BAD_FORMAT, bl_io_file_open_compressed_sync(path, NULL, &file));
+
+    // once on the async path decompressing on the job workers and once on
+    // the io threads decompressing there
+    for (uint32_t pass = 0; pass < 2; ++pass) {
+      bl_io_lib_finalize();
+      if (pass == 1) {
+        bl_job_lib_finalize();
+      }
+      BLIoLibInitParams params;
+      params.thread_count       = 4;
+      params.async_queue_depth  = (pass == 0) ? 8 : 0;
+      params.cache_block_count  = 0;
+      params.decompress_on_jobs = (pass == 0);
+      if (pass == 0) {
+        BLJobLibInitParams job_params;
+        job_params.worker_thread_count = 2;
+        CHECK_EQUAL(BL_JOB_STATUS_OK, bl_job_lib_initialize(&job_params));
+      }
+      bl_io_lib_initialize(&params);
+
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_compressed_sync(compressed_path, NULL, &file, &size));
+      CHECK_EQUAL(text_size, size);
+      uint8_t* buffer = (uint8_t*)bl_alloc(text_size + 16, 16);
+
+      // the whole file, then a part that starts and ends inside blocks
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, buffer, text_size));
+      CHECK(check_text(buffer, 0, text_size));
+      memset(buffer, 0, text_size);
+      bl_io_file_seek_sync(file, 16000);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, buffer + 3, 40000));
+      CHECK(check_text(buffer + 3, 16000, 40000));
+
+      // a vectored read split across a block boundary
+      uint8_t first[1000];
+      uint8_t second[3000];
+      BLIoBuffer buffers[] = {
+        { first,  sizeof(first) },
+        { second, sizeof(second) },
+      };
+      bl_io_file_seek_sync(file, 32 * 1024 - 1500);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_readv_sync(file, NULL, buffers, 2));
+      CHECK(check_text(first, 32 * 1024 - 1500, sizeof(first)));
+      CHECK(check_text(second, 32 * 1024 - 500, sizeof(second)));
+
+      // many reads in flight at once
+      const uint32_t read_size = 5000;
+      const uint32_t read_count = text_size / read_size;
+      BLIoOp* ops[read_count];
+      memset(buffer, 0, text_size);
+      for (uint32_t index = 0; index < read_count; ++index) {
+        uint32_t slot = (index * 7) % read_count;
+        bl_io_file_seek_sync(file, slot * read_size);
+        ops[index] = bl_io_file_read(file, NULL, buffer + slot * read_size, read_size);
+      }
+      for (uint32_t index = 0; index < read_count; ++index) {
+        CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(ops[index]));
+        bl_io_op_delete(ops[index]);
+      }
+      CHECK(check_text(buffer, 0, text_size));
+
+      // off the end of the file
+      bl_io_file_seek_sync(file, text_size - 100);
+      BLIoOp* op = bl_io_file_read(file, NULL, buffer, 300);
+      CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait(op));
+      CHECK_EQUAL(100u, op->fulfilled_size);
+      CHECK(check_text(buffer, text_size - 100, 100));
+      bl_io_op_delete(op);
+      op = bl_io_file_read(file, NULL, buffer, 10);
+      CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait(op));
+      CHECK_EQUAL(0u, op->fulfilled_size);
+      bl_io_op_delete(op);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+
+      // stored blocks read back as they were
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_compressed_sync(stored_path, NULL, &file, &size));
+      CHECK_EQUAL(TEST_FILE_SIZE, size);
+      bl_io_file_seek_sync(file, 1000);
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_read_sync(file, NULL, buffer, 10000));
+      CHECK(check_pattern(buffer, 1000, 10000));
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+
+      bl_free(buffer);
+    }
+
+    unlink(text_path);
+    unlink(compressed_path);
+    unlink(stored_path);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST_FIXTURE(IoSchedFixture, reads_should_be_issued_by_deadline_priority_and_offset) {
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+    // park the io thread in a callback so the reads below pile up
+    BlockerContext blocker;
+    bl_semaphore_create(&blocker.entered, 0);
+    bl_semaphore_create(&blocker.release, 0);
+    BLIoOpAttr blocker_attr = {};
+    blocker_attr.callback = &blocker_callback;
+    blocker_attr.context  = &blocker;
+    uint8_t blocker_buffer[64];
+    BLIoOp* blocker_op = bl_io_file_read(file, &blocker_attr, blocker_buffer, sizeof(blocker_buffer));
+    bl_semaphore_wait(&blocker.entered);
+
+    // reads at descending offsets, one urgent one at the end of the file and
+    // one with a deadline that will have passed by the time the thread is free
+    OrderContext order;
+    order.count = 0;
+    const uint32_t read_size = 1024;
+    uint8_t* buffer = (uint8_t*)bl_alloc(read_size * 8, 16);
+    BLIoOp* ops[8];
+    BLIoOpAttr attr = {};
+    attr.callback = &order_callback;
+    attr.context  = &order;
+    for (uint32_t index = 0; index < 6; ++index) {
+      bl_io_file_seek_sync(file, (8 - index) * read_size);
+      ops[index] = bl_io_file_read(file, &attr, buffer + index * read_size, read_size);
+    }
+    BLIoOpAttr urgent_attr = {};
+    urgent_attr.callback = &order_callback;
+    urgent_attr.context  = &order;
+    urgent_attr.priority = 1;
+    bl_io_file_seek_sync(file, 40 * read_size);
+    ops[6] = bl_io_file_read(file, &urgent_attr, buffer + 6 * read_size, read_size);
+    BLIoOpAttr deadline_attr = {};
+    deadline_attr.callback    = &order_callback;
+    deadline_attr.context     = &order;
+    deadline_attr.deadline_ms = 1;
+    bl_io_file_seek_sync(file, 50 * read_size);
+    ops[7] = bl_io_file_read(file, &deadline_attr, buffer + 7 * read_size, read_size);
+
+    uint64_t start = bl_time_ns();
+    while (bl_time_ns() - start < 5000000ULL) {
+      bl_thread_yield();
+    }
+    bl_semaphore_post(&blocker.release);
+    for (uint32_t index = 0; index < 8; ++index) {
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(ops[index]));
+    }
+
+    // overdue first, then by priority, then sweeping up from the blocker read
+    CHECK_EQUAL(8, order.count);
+    CHECK(order.ops[0] == ops[7]);
+    CHECK(order.ops[1] == ops[6]);
+    for (uint32_t index = 0; index < 6; ++index) {
+      CHECK(order.ops[2 + index] == ops[5 - index]);
+    }
+
+    for (uint32_t index = 0; index < 8; ++index) {
+      bl_io_op_delete(ops[index]);
+    }
+    bl_io_op_delete(blocker_op);
+    bl_free(buffer);
+    bl_semaphore_destroy(&blocker.release);
+    bl_semaphore_destroy(&blocker.entered);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+  }
+
+  //--------------------------------------------------------------------------
+  TEST_FIXTURE(IoSchedFixture, wait_any_and_all_should_cover_a_batch) {
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+    // park the io thread in a callback so nothing in the batch can complete
+    BlockerContext blocker;
+    bl_semaphore_create(&blocker.entered, 0);
+    bl_semaphore_create(&blocker.release, 0);
+    BLIoOpAttr blocker_attr = {};
+    blocker_attr.callback = &blocker_callback;
+    blocker_attr.context  = &blocker;
+    uint8_t blocker_buffer[64];
+    BLIoOp* blocker_op = bl_io_file_read(file, &blocker_attr, blocker_buffer, sizeof(blocker_buffer));
+    bl_semaphore_wait(&blocker.entered);
+
+    // a few reads spread over the file, the last running off its end
+    const uint32_t read_size = 1024;
+    const uint32_t read_count = 5;
+    uint8_t* buffer = (uint8_t*)bl_alloc(read_count * read_size, 16);
+    BLIoOp* ops[read_count];
+    for (uint32_t index = 0; index < read_count; ++index) {
+      uint64_t offset = (index < read_count - 1) ? index * 8 * read_size : TEST_FILE_SIZE - 100;
+      bl_io_file_seek_sync(file, offset);
+      ops[index] = bl_io_file_read(file, NULL, buffer + index * read_size, read_size);
+    }
+    CHECK_EQUAL(read_count, bl_io_op_wait_any_timeout(ops, read_count, 10));
+    CHECK_EQUAL(BL_IO_STATUS_PENDING, bl_io_op_wait_all_timeout(ops, read_count, 10));
+    bl_semaphore_post(&blocker.release);
+
+    // any one of them, then the ones that read in full, then all of them
+    uint32_t first = bl_io_op_wait_any(ops, read_count);
+    CHECK(first < read_count);
+    CHECK(ops[first]->status != BL_IO_STATUS_PENDING);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait_all(ops, read_count - 1));
+    for (uint32_t index = 0; index < read_count - 1; ++index) {
+      CHECK(check_pattern(buffer + index * read_size, index * 8 * read_size, read_size));
+    }
+    CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait_all_timeout(ops, read_count, 5000));
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait_all(ops, 0));
+
+    for (uint32_t index = 0; index < read_count; ++index) {
+      bl_io_op_delete(ops[index]);
+    }
+    bl_io_op_delete(blocker_op);
+    bl_free(buffer);
+    bl_semaphore_destroy(&blocker.release);
+    bl_semaphore_destroy(&blocker.entered);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+  }
+
+  //--------------------------------------------------------------------------
+  TEST_FIXTURE(IoSchedFixture, wait_all_should_not_wake_the_caller_per_completion) {
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+    // slow reads, every other one waited on so other completions come in
+    // between
+    const uint32_t read_size = 1024;
+    const uint32_t read_count = 16;
+    uint8_t* buffer = (uint8_t*)bl_alloc(read_count * read_size, 16);
+    BLIoOp* ops[read_count];
+    BLIoOp* waited_ops[read_count / 2];
+    BLIoOpAttr attr = {};
+    attr.callback = &pace_callback;
+    for (uint32_t index = 0; index < read_count; ++index) {
+      bl_io_file_seek_sync(file, index * 2 * read_size);
+      ops[index] = bl_io_file_read(file, &attr, buffer + index * read_size, read_size);
+      if (!(index & 1)) {
+        waited_ops[index / 2] = ops[index];
+      }
+    }
+
+    // the caller should sleep through the batch rather than wake for every
+    // completion
+    long sleeps = sleep_count();
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait_all(waited_ops, read_count / 2));
+    if (sleeps >= 0) {
+      CHECK(sleep_count() - sleeps < (long)read_count / 4);
+    }
+    for (uint32_t index = 0; index < read_count / 2; ++index) {
+      CHECK(check_pattern(buffer + index * 2 * read_size, index * 4 * read_size, read_size));
+    }
+
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait_all(ops, read_count));
+    for (uint32_t index = 0; index < read_count; ++index) {
+      bl_io_op_delete(ops[index]);
+    }
+    bl_free(buffer);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+  }
+
+  //--------------------------------------------------------------------------
+  TEST_FIXTURE(IoSchedFixture, waiting_reads_should_be_cancelled_and_reprioritized) {
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+    // park the io thread in a callback so the reads below wait
+    BlockerContext blocker;
+    bl_semaphore_create(&blocker.entered, 0);
+    bl_semaphore_create(&blocker.release, 0);
+    BLIoOpAttr blocker_attr = {};
+    blocker_attr.callback = &blocker_callback;
+    blocker_attr.context  = &blocker;
+    uint8_t blocker_buffer[64];
+    BLIoOp* blocker_op = bl_io_file_read(file, &blocker_attr, blocker_buffer, sizeof(blocker_buffer));
+    bl_semaphore_wait(&blocker.entered);
+    CHECK(!bl_io_op_cancel(blocker_op));
+    CHECK(!bl_io_op_set_priority(blocker_op, 1));
+
+    // reads far enough apart not to be merged
+    OrderContext order;
+    order.count = 0;
+    BLIoOpAttr attr = {};
+    attr.callback = &order_callback;
+    attr.context  = &order;
+    const uint32_t read_size = 1024;
+    uint8_t* buffer = (uint8_t*)bl_alloc(4 * read_size, 16);
+    BLIoOp* ops[4];
+    for (uint32_t index = 0; index < 4; ++index) {
+      bl_io_file_seek_sync(file, (1 + index * 8) * read_size);
+      ops[index] = bl_io_file_read(file, &attr, buffer + index * read_size, read_size);
+    }
+
+    // the cancelled read completes at once; the raised one goes first
+    CHECK(bl_io_op_cancel(ops[1]));
+    CHECK_EQUAL(BL_IO_STATUS_CANCELLED, bl_io_op_wait(ops[1]));
+    CHECK_EQUAL(0u, ops[1]->fulfilled_size);
+    CHECK(!bl_io_op_cancel(ops[1]));
+    CHECK(bl_io_op_set_priority(ops[3], 5));
+    bl_semaphore_post(&blocker.release);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(ops[0]));
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(ops[2]));
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(ops[3]));
+    CHECK(check_pattern(buffer + 3 * read_size, 25 * read_size, read_size));
+
+    CHECK_EQUAL(4, order.count);
+    CHECK(order.ops[0] == ops[1]);
+    CHECK(order.ops[1] == ops[3]);
+    CHECK(order.ops[2] == ops[0]);
+    CHECK(order.ops[3] == ops[2]);
+    CHECK(!bl_io_op_cancel(ops[0]));
+    CHECK(!bl_io_op_set_priority(ops[0], 1));
+
+    for (uint32_t index = 0; index < 4; ++index) {
+      bl_io_op_delete(ops[index]);
+    }
+    bl_io_op_delete(blocker_op);
+    bl_free(buffer);
+    bl_semaphore_destroy(&blocker.release);
+    bl_semaphore_destroy(&blocker.entered);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+  }
+
+  //--------------------------------------------------------------------------
+  TEST_FIXTURE(IoSchedFixture, nearby_reads_should_be_merged_and_split_back) {
+    BLIoFile* file;
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_open_sync(path, NULL, &file));
+
+    // park the io thread in a callback so the reads below pile up
+    BlockerContext blocker;
+    bl_semaphore_create(&blocker.entered, 0);
+    bl_semaphore_create(&blocker.release, 0);
+    BLIoOpAttr blocker_attr = {};
+    blocker_attr.callback = &blocker_callback;
+    blocker_attr.context  = &blocker;
+    uint8_t blocker_buffer[64];
+    BLIoOp* blocker_op = bl_io_file_read(file, &blocker_attr, blocker_buffer, sizeof(blocker_buffer));
+    bl_semaphore_wait(&blocker.entered);
+
+    // touching reads, reads with small gaps, one too far away to merge and a
+    // run that runs off the end of the file
+    const uint64_t offsets[]  = { 1000, 1500, 1600, 2300, 20000, TEST_FILE_SIZE - 600, TEST_FILE_SIZE - 200 };
+    const uint64_t sizes[]    = {  500,  100,  700,  300,   100,                  300,                  400 };
+    const uint32_t read_count = sizeof(offsets) / sizeof(offsets[0]);
+    uint8_t* buffer = (uint8_t*)bl_alloc(read_count * 1024, 16);
+    BLIoOp* ops[read_count];
+    for (uint32_t index = 0; index < read_count; ++index) {
+      bl_io_file_seek_sync(file, offsets[index]);
+      ops[index] = bl_io_file_read(file, NULL, buffer + index * 1024, sizes[index]);
+    }
+    bl_semaphore_post(&blocker.release);
+
+    for (uint32_t index = 0; index < read_count - 1; ++index) {
+      CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_op_wait(ops[index]));
+      CHECK_EQUAL(sizes[index], ops[index]->fulfilled_size);
+      CHECK(check_pattern(buffer + index * 1024, offsets[index], sizes[index]));
+    }
+    BLIoOp* last = ops[read_count - 1];
+    CHECK_EQUAL(BL_IO_STATUS_ERROR_EOF, bl_io_op_wait(last));
+    CHECK_EQUAL(200u, last->fulfilled_size);
+    CHECK(check_pattern(buffer + (read_count - 1) * 1024, TEST_FILE_SIZE - 200, 200));
+
+    for (uint32_t index = 0; index < read_count; ++index) {
+      bl_io_op_delete(ops[index]);
+    }
+    bl_io_op_delete(blocker_op);
+    bl_free(buffer);
+    bl_semaphore_destroy(&blocker.release);
+    bl_semaphore_destroy(&blocker.entered);
+    CHECK_EQUAL(BL_IO_STATUS_OK, bl_io_file_close_sync(file, NULL));
+  }
+}
@@ -23,6 +23,7 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <unistd.h>
 #include <unittest++/UnitTest++.h>
 #include <blink/job.h>
 
@@ -30,12 +31,28 @@ struct UserData {
   volatile int32_t * completed_count;
 };
 
+struct PusherParams {
+  BLJobQueue* queue;
+  BLJob*      jobs;
+  int         job_count;
+};
+
 //------------------------------------------------------------------------------
 static void job_func(const BLJob* __restrict job) {
   UserData* __restrict ud = (UserData*)job->user_data;
   bl_atomic_increment(ud->completed_count);
 }
 
+//------------------------------------------------------------------------------
+// pushes reserved jobs after a short sleep
+static void push_reserved_proc(void* param) {
+  PusherParams* params = (PusherParams*)param;
+  usleep(10 * 1000);
+  for (int index = 0; index < params->job_count; ++index) {
+    bl_job_queue_push_reserved_job(params->queue, params->jobs + index);
+  }
+}
+
 SUITE(job) {
   //----------------------------------------------------------------------------
   TEST(sync_should_wait_for_all_jobs) {
@@ -93,4 +110,37 @@ SUITE(job) {
 
     bl_job_lib_finalize();
   }
+
+  //----------------------------------------------------------------------------
+  TEST(wait_should_cover_reserved_jobs) {
+    BLJobLibInitParams param;
+    param.worker_thread_count = 2;
+    CHECK_EQUAL(BL_JOB_STATUS_OK, bl_job_lib_initialize(&param));
+    BLJobQueue* queue = bl_job_queue_create();
+
+    volatile int32_t completed_count = 0;
+    const int job_count = 3;
+    BLJob* jobs = (BLJob*)bl_alloc(sizeof(BLJob) * job_count, 128);
+    for (int index = 0; index < job_count; ++index) {
+      BLJob* job = jobs + index;
+      job->func       = &job_func;
+      job->input      = NULL;
+      job->output     = NULL;
+      UserData * ud = (UserData*)job->user_data;
+      ud->completed_count = &completed_count;
+      CHECK_EQUAL(BL_JOB_STATUS_OK, bl_job_queue_reserve(queue));
+    }
+
+    // push the jobs from another thread some time after the wait starts
+    PusherParams params = { queue, jobs, job_count };
+    BLThread pusher;
+    bl_thread_create(&pusher, &push_reserved_proc, &params);
+    CHECK_EQUAL(BL_JOB_STATUS_OK, bl_job_queue_wait(queue));
+    CHECK_EQUAL(job_count, completed_count);
+    bl_thread_join(&pusher);
+
+    bl_free(jobs);
+    CHECK_EQUAL(BL_JOB_STATUS_OK, bl_job_queue_destroy(queue));
+    bl_job_lib_finalize();
+  }
 }
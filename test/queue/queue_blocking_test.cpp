@@ -0,0 +1,63 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <unittest++/UnitTest++.h>
+#include <blink/queue.h>
+
+//------------------------------------------------------------------------------
+static void blocking_producer_func(void* param) {
+  BLQueueSWSRBlocking* q = (BLQueueSWSRBlocking*)param;
+  for (int index = 0; index < 100000; ++index) {
+    int* p = (int*)bl_queue_blocking_write_prepare(q);
+    *p = index;
+    bl_queue_blocking_write_commit(q);
+  }
+}
+
+SUITE(queue) {
+  //----------------------------------------------------------------------------
+  TEST(queue_blocking_producer_consumer) {
+    const int queue_capacity = 16;
+    int buf[queue_capacity];
+    BLQueueSWSRBlocking q;
+    bl_queue_blocking_init(&q, buf, queue_capacity, sizeof(int));
+
+    BLThread thread;
+    bl_thread_create(&thread, &blocking_producer_func, &q);
+
+    // both sides block in turn as the queue runs empty and full
+    bool in_order = true;
+    for (int index = 0; index < 100000; ++index) {
+      int* p = (int*)bl_queue_blocking_read_fetch(&q);
+      in_order = in_order && (*p == index);
+      bl_queue_blocking_read_consume(&q);
+    }
+    CHECK(in_order);
+    CHECK(!bl_queue_read_fetch(&q.queue));
+
+    bl_thread_join(&thread);
+    bl_queue_blocking_destroy(&q);
+  }
+}
@@ -0,0 +1,157 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <unittest++/UnitTest++.h>
+#include <blink/queue.h>
+
+struct BroadcastTestParam {
+  BLQueueBroadcast* queue;
+  size_t            consumer;
+  int               count;
+  bool              in_order;
+};
+
+//------------------------------------------------------------------------------
+static void broadcast_consumer_func(void* param) {
+  BroadcastTestParam* p = (BroadcastTestParam*)param;
+  p->in_order = true;
+  for (int index = 0; index < p->count; ++index) {
+    int* value;
+    while (!(value = (int*)bl_queue_broadcast_read_fetch(p->queue, p->consumer))) {
+      // caught up; spin until the producer writes more
+    }
+    p->in_order = p->in_order && (*value == index);
+    bl_queue_broadcast_read_consume(p->queue, p->consumer);
+  }
+}
+
+SUITE(queue) {
+  //----------------------------------------------------------------------------
+  TEST(queue_broadcast_every_consumer_sees_every_element) {
+    const size_t capacity = 4;
+    int buf[capacity];
+    BLQueueBroadcastCursor cursors[2];
+    BLQueueBroadcast q;
+    bl_queue_broadcast_init(&q, buf, capacity, sizeof(int), cursors, 2);
+
+    CHECK(!bl_queue_broadcast_read_fetch(&q, 0));
+    CHECK(!bl_queue_broadcast_read_fetch(&q, 1));
+
+    for (int index = 0; index < 2; ++index) {
+      int* p = (int*)bl_queue_broadcast_write_prepare(&q);
+      CHECK(p);
+      *p = index;
+      bl_queue_broadcast_write_commit(&q);
+    }
+
+    for (size_t consumer = 0; consumer < 2; ++consumer) {
+      for (int index = 0; index < 2; ++index) {
+        int* p = (int*)bl_queue_broadcast_read_fetch(&q, consumer);
+        CHECK(p);
+        CHECK_EQUAL(index, *p);
+        bl_queue_broadcast_read_consume(&q, consumer);
+      }
+      CHECK(!bl_queue_broadcast_read_fetch(&q, consumer));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_broadcast_write_gates_on_slowest_consumer) {
+    const size_t capacity = 4;
+    int buf[capacity];
+    BLQueueBroadcastCursor cursors[2];
+    BLQueueBroadcast q;
+    bl_queue_broadcast_init(&q, buf, capacity, sizeof(int), cursors, 2);
+
+    // fill every slot
+    for (int index = 0; index < (int)capacity; ++index) {
+      int* p = (int*)bl_queue_broadcast_write_prepare(&q);
+      CHECK(p);
+      *p = index;
+      bl_queue_broadcast_write_commit(&q);
+    }
+
+    // fail: full
+    CHECK(!bl_queue_broadcast_write_prepare(&q));
+
+    // a fast consumer alone doesn't free up space
+    for (size_t index = 0; index < capacity; ++index) {
+      CHECK(bl_queue_broadcast_read_fetch(&q, 0));
+      bl_queue_broadcast_read_consume(&q, 0);
+    }
+    CHECK(!bl_queue_broadcast_write_prepare(&q));
+
+    // once the slow consumer moves, its slot can be reused
+    CHECK(bl_queue_broadcast_read_fetch(&q, 1));
+    bl_queue_broadcast_read_consume(&q, 1);
+    int* p = (int*)bl_queue_broadcast_write_prepare(&q);
+    CHECK(p);
+    *p = 4;
+    bl_queue_broadcast_write_commit(&q);
+    CHECK(!bl_queue_broadcast_write_prepare(&q));
+
+    p = (int*)bl_queue_broadcast_read_fetch(&q, 0);
+    CHECK(p);
+    CHECK_EQUAL(4, *p);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_broadcast_many_consumers) {
+    const size_t capacity = 64;
+    const size_t consumer_count = 3;
+    const int element_count = 50000;
+
+    int* buf = (int*)bl_alloc(capacity * sizeof(int), 128);
+    BLQueueBroadcastCursor* cursors = (BLQueueBroadcastCursor*)bl_alloc(consumer_count * sizeof(BLQueueBroadcastCursor), 128);
+    BLQueueBroadcast q;
+    bl_queue_broadcast_init(&q, buf, capacity, sizeof(int), cursors, consumer_count);
+
+    BroadcastTestParam params[consumer_count];
+    BLThread threads[consumer_count];
+    for (size_t index = 0; index < consumer_count; ++index) {
+      params[index].queue = &q;
+      params[index].consumer = index;
+      params[index].count = element_count;
+      bl_thread_create(threads + index, &broadcast_consumer_func, params + index);
+    }
+
+    for (int index = 0; index < element_count; ++index) {
+      int* p;
+      while (!(p = (int*)bl_queue_broadcast_write_prepare(&q))) {
+        // full; spin until the slowest consumer catches up
+      }
+      *p = index;
+      bl_queue_broadcast_write_commit(&q);
+    }
+
+    for (size_t index = 0; index < consumer_count; ++index) {
+      bl_thread_join(threads + index);
+      CHECK(params[index].in_order);
+    }
+
+    bl_free(cursors);
+    bl_free(buf);
+  }
+}
@@ -0,0 +1,234 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <unittest++/UnitTest++.h>
+#include <blink/queue.h>
+
+struct MPSCTestNode : public BLQueueMPSCNode {
+  int producer;
+  int value;
+};
+
+struct MPSCTestParam {
+  BLQueueMPSC*      queue;
+  MPSCTestNode*     nodes;
+  int               producer;
+  int               count;
+};
+
+struct MPSCRingTestParam {
+  BLQueueMPSCRing*  queue;
+  int               producer;
+  int               count;
+};
+
+//------------------------------------------------------------------------------
+static void mpsc_producer_func(void* param) {
+  MPSCTestParam* p = (MPSCTestParam*)param;
+  for (int index = 0; index < p->count; ++index) {
+    MPSCTestNode* node = p->nodes + index;
+    node->producer = p->producer;
+    node->value = index;
+    bl_queue_mpsc_push(p->queue, node);
+  }
+}
+
+//------------------------------------------------------------------------------
+static void mpsc_ring_producer_func(void* param) {
+  MPSCRingTestParam* p = (MPSCRingTestParam*)param;
+  for (int index = 0; index < p->count; ++index) {
+    int* dest;
+    while (!(dest = (int*)bl_queue_mpsc_ring_write_prepare(p->queue))) {
+      // full; spin until the consumer catches up
+    }
+    dest[0] = p->producer;
+    dest[1] = index;
+    bl_queue_mpsc_ring_write_commit(p->queue, dest);
+  }
+}
+
+SUITE(queue) {
+  //----------------------------------------------------------------------------
+  TEST(queue_mpsc_pops_in_push_order) {
+    BLQueueMPSC q;
+    bl_queue_mpsc_init(&q);
+
+    CHECK(!bl_queue_mpsc_pop(&q));
+
+    MPSCTestNode nodes[3];
+    for (int index = 0; index < 3; ++index) {
+      nodes[index].value = index;
+      bl_queue_mpsc_push(&q, nodes + index);
+    }
+
+    for (int index = 0; index < 3; ++index) {
+      MPSCTestNode* node = (MPSCTestNode*)bl_queue_mpsc_pop(&q);
+      CHECK(node);
+      CHECK_EQUAL(index, node->value);
+    }
+    CHECK(!bl_queue_mpsc_pop(&q));
+
+    // the queue can be refilled after it was drained
+    bl_queue_mpsc_push(&q, nodes + 1);
+    CHECK_EQUAL(nodes + 1, (MPSCTestNode*)bl_queue_mpsc_pop(&q));
+    CHECK(!bl_queue_mpsc_pop(&q));
+
+    bl_queue_mpsc_destroy(&q);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_mpsc_many_producers) {
+    BLQueueMPSC q;
+    bl_queue_mpsc_init(&q);
+
+    const int producer_count = 4;
+    const int node_count = 10000;
+    MPSCTestNode* nodes = (MPSCTestNode*)bl_alloc(sizeof(MPSCTestNode) * producer_count * node_count, 16);
+
+    MPSCTestParam params[producer_count];
+    BLThread threads[producer_count];
+    for (int index = 0; index < producer_count; ++index) {
+      params[index].queue = &q;
+      params[index].nodes = nodes + (index * node_count);
+      params[index].producer = index;
+      params[index].count = node_count;
+      bl_thread_create(threads + index, &mpsc_producer_func, params + index);
+    }
+
+    // every node must arrive exactly once and in order for its producer
+    int next_value[producer_count] = {0};
+    bool in_order = true;
+    for (int received = 0; received < producer_count * node_count; ) {
+      MPSCTestNode* node = (MPSCTestNode*)bl_queue_mpsc_pop(&q);
+      if (!node) {
+        bl_queue_mpsc_wait(&q);
+        continue;
+      }
+      in_order = in_order && (node->value == next_value[node->producer]);
+      ++next_value[node->producer];
+      ++received;
+    }
+    CHECK(in_order);
+    for (int index = 0; index < producer_count; ++index) {
+      CHECK_EQUAL(node_count, next_value[index]);
+    }
+
+    for (int index = 0; index < producer_count; ++index) {
+      bl_thread_join(threads + index);
+    }
+    CHECK(!bl_queue_mpsc_pop(&q));
+
+    bl_free(nodes);
+    bl_queue_mpsc_destroy(&q);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_mpsc_ring_read_on_empty_and_write_on_full_should_fail) {
+    const size_t capacity = 4;
+    uint64_t buf[capacity * 2];
+    CHECK(sizeof(buf) >= bl_queue_mpsc_ring_buffer_size(capacity, sizeof(int)));
+
+    BLQueueMPSCRing q;
+    bl_queue_mpsc_ring_init(&q, buf, capacity, sizeof(int));
+
+    CHECK(!bl_queue_mpsc_ring_read_fetch(&q));
+
+    // all slots can be used
+    for (size_t index = 0; index < capacity; ++index) {
+      int* p = (int*)bl_queue_mpsc_ring_write_prepare(&q);
+      CHECK(p);
+      *p = (int)index;
+      bl_queue_mpsc_ring_write_commit(&q, p);
+    }
+
+    // fail: full
+    CHECK(!bl_queue_mpsc_ring_write_prepare(&q));
+
+    // free up one slot and wrap around
+    int* p = (int*)bl_queue_mpsc_ring_read_fetch(&q);
+    CHECK(p);
+    CHECK_EQUAL(0, *p);
+    bl_queue_mpsc_ring_read_consume(&q);
+
+    p = (int*)bl_queue_mpsc_ring_write_prepare(&q);
+    CHECK(p);
+    *p = 4;
+    bl_queue_mpsc_ring_write_commit(&q, p);
+
+    for (int index = 1; index <= 4; ++index) {
+      p = (int*)bl_queue_mpsc_ring_read_fetch(&q);
+      CHECK(p);
+      CHECK_EQUAL(index, *p);
+      bl_queue_mpsc_ring_read_consume(&q);
+    }
+    CHECK(!bl_queue_mpsc_ring_read_fetch(&q));
+
+    bl_queue_mpsc_ring_destroy(&q);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_mpsc_ring_many_producers) {
+    const size_t capacity = 64;
+    void* buf = bl_alloc(bl_queue_mpsc_ring_buffer_size(capacity, 2 * sizeof(int)), 128);
+    BLQueueMPSCRing q;
+    bl_queue_mpsc_ring_init(&q, buf, capacity, 2 * sizeof(int));
+
+    const int producer_count = 4;
+    const int element_count = 10000;
+    MPSCRingTestParam params[producer_count];
+    BLThread threads[producer_count];
+    for (int index = 0; index < producer_count; ++index) {
+      params[index].queue = &q;
+      params[index].producer = index;
+      params[index].count = element_count;
+      bl_thread_create(threads + index, &mpsc_ring_producer_func, params + index);
+    }
+
+    int next_value[producer_count] = {0};
+    bool in_order = true;
+    for (int received = 0; received < producer_count * element_count; ) {
+      int* p = (int*)bl_queue_mpsc_ring_read_fetch(&q);
+      if (!p) {
+        bl_queue_mpsc_ring_wait(&q);
+        continue;
+      }
+      in_order = in_order && (p[1] == next_value[p[0]]);
+      ++next_value[p[0]];
+      ++received;
+      bl_queue_mpsc_ring_read_consume(&q);
+    }
+    CHECK(in_order);
+    for (int index = 0; index < producer_count; ++index) {
+      CHECK_EQUAL(element_count, next_value[index]);
+    }
+
+    for (int index = 0; index < producer_count; ++index) {
+      bl_thread_join(threads + index);
+    }
+
+    bl_queue_mpsc_ring_destroy(&q);
+    bl_free(buf);
+  }
+}
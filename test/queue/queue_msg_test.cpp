@@ -0,0 +1,170 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <unittest++/UnitTest++.h>
+#include <blink/queue.h>
+
+struct MsgTestParam {
+  BLQueueMsgSWSR* queue;
+  int             count;
+};
+
+//------------------------------------------------------------------------------
+static size_t msg_test_size(int index) {
+  return 1 + ((size_t)index * 37) % 200;
+}
+
+//------------------------------------------------------------------------------
+static void msg_producer_func(void* param) {
+  MsgTestParam* p = (MsgTestParam*)param;
+  for (int index = 0; index < p->count; ++index) {
+    size_t size = msg_test_size(index);
+    uint8_t* dest;
+    while (!(dest = (uint8_t*)bl_queue_msg_write_prepare(p->queue, size))) {
+      // full; spin until the consumer catches up
+    }
+    for (size_t offset = 0; offset < size; ++offset) {
+      dest[offset] = (uint8_t)(index + offset);
+    }
+    bl_queue_msg_write_commit(p->queue);
+  }
+}
+
+SUITE(queue) {
+  //----------------------------------------------------------------------------
+  TEST(queue_msg_can_put_and_get_variable_sizes) {
+    uint64_t buf[32];
+    BLQueueMsgSWSR q;
+    bl_queue_msg_init(&q, buf, sizeof(buf));
+
+    size_t size;
+    CHECK(!bl_queue_msg_read_fetch(&q, &size));
+
+    const char* msgs[] = { "a", "hello", "a much longer message" };
+    for (int index = 0; index < 3; ++index) {
+      size_t len = bl_strlen(msgs[index], 64) + 1;
+      char* p = (char*)bl_queue_msg_write_prepare(&q, len);
+      CHECK(p);
+      CHECK(BL_IS_ALIGNED_PTR(p, BL_QUEUE_MSG_ALIGNMENT));
+      bl_strcpy(p, msgs[index], len);
+      bl_queue_msg_write_commit(&q);
+    }
+
+    for (int index = 0; index < 3; ++index) {
+      char* p = (char*)bl_queue_msg_read_fetch(&q, &size);
+      CHECK(p);
+      CHECK_EQUAL(bl_strlen(msgs[index], 64) + 1, size);
+      CHECK_EQUAL(0, bl_strcmp(msgs[index], p, 64));
+      bl_queue_msg_read_consume(&q);
+    }
+    CHECK(!bl_queue_msg_read_fetch(&q, &size));
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_msg_wraps_with_padding) {
+    uint64_t buf[16];
+    BLQueueMsgSWSR q;
+    bl_queue_msg_init(&q, buf, sizeof(buf));
+
+    // two 48 byte records leave 32 bytes at the end of the 128 byte buffer
+    uint8_t* p;
+    size_t size;
+    for (int index = 0; index < 2; ++index) {
+      p = (uint8_t*)bl_queue_msg_write_prepare(&q, 20);
+      CHECK(p);
+      p[0] = (uint8_t)index;
+      bl_queue_msg_write_commit(&q);
+    }
+
+    // fail: a 48 byte record won't fit until the first message is consumed
+    CHECK(!bl_queue_msg_write_prepare(&q, 20));
+    p = (uint8_t*)bl_queue_msg_read_fetch(&q, &size);
+    CHECK(p);
+    CHECK_EQUAL(0, p[0]);
+    bl_queue_msg_read_consume(&q);
+
+    // this message gets written at the start of the buffer after padding
+    p = (uint8_t*)bl_queue_msg_write_prepare(&q, 20);
+    CHECK(p);
+    CHECK_EQUAL((uint8_t*)buf + BL_QUEUE_MSG_ALIGNMENT, p);
+    p[0] = 2;
+    bl_queue_msg_write_commit(&q);
+
+    for (int index = 1; index < 3; ++index) {
+      p = (uint8_t*)bl_queue_msg_read_fetch(&q, &size);
+      CHECK(p);
+      CHECK_EQUAL(20u, size);
+      CHECK_EQUAL(index, p[0]);
+      bl_queue_msg_read_consume(&q);
+    }
+    CHECK(!bl_queue_msg_read_fetch(&q, &size));
+
+    // the largest message fits wherever the write head is once drained
+    for (int index = 0; index < 4; ++index) {
+      p = (uint8_t*)bl_queue_msg_write_prepare(&q, bl_queue_msg_max_size(&q));
+      CHECK(p);
+      bl_queue_msg_write_commit(&q);
+      CHECK(bl_queue_msg_read_fetch(&q, &size));
+      CHECK_EQUAL(bl_queue_msg_max_size(&q), size);
+      bl_queue_msg_read_consume(&q);
+      CHECK(bl_queue_msg_write_prepare(&q, 8));
+      bl_queue_msg_write_commit(&q);
+      CHECK(bl_queue_msg_read_fetch(&q, &size));
+      bl_queue_msg_read_consume(&q);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_msg_producer_consumer) {
+    const size_t buf_size = 4096;
+    void* buf = bl_alloc(buf_size, 128);
+    BLQueueMsgSWSR q;
+    bl_queue_msg_init(&q, buf, buf_size);
+
+    MsgTestParam param;
+    param.queue = &q;
+    param.count = 50000;
+    BLThread thread;
+    bl_thread_create(&thread, &msg_producer_func, &param);
+
+    bool intact = true;
+    for (int index = 0; index < param.count; ++index) {
+      size_t size;
+      uint8_t* p;
+      while (!(p = (uint8_t*)bl_queue_msg_read_fetch(&q, &size))) {
+        // empty; spin until the producer catches up
+      }
+      intact = intact && (size == msg_test_size(index));
+      for (size_t offset = 0; offset < size; ++offset) {
+        intact = intact && (p[offset] == (uint8_t)(index + offset));
+      }
+      bl_queue_msg_read_consume(&q);
+    }
+    CHECK(intact);
+
+    bl_thread_join(&thread);
+    bl_free(buf);
+  }
+}
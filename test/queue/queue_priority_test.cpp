@@ -0,0 +1,191 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <unittest++/UnitTest++.h>
+#include <blink/queue.h>
+
+struct PriorityTestParam {
+  BLQueuePriority*  queue;
+  uint32_t          seed;
+  int               first;        // first priority this thread pushes
+  int               count;        // number of items this thread pushes
+  int               popped;       // number of items this thread popped
+  int64_t           popped_sum;   // sum of the priorities this thread popped
+};
+
+//------------------------------------------------------------------------------
+static void priority_test_func(void* param) {
+  PriorityTestParam* p = (PriorityTestParam*)param;
+  p->popped = 0;
+  p->popped_sum = 0;
+
+  // push everything while popping every other step
+  BLQueuePriorityItem item;
+  for (int index = 0; index < p->count; ++index) {
+    while (!bl_queue_priority_push(p->queue, p->first + index, NULL, &p->seed)) {
+    }
+    if ((index & 1) && bl_queue_priority_pop(p->queue, &item, &p->seed)) {
+      ++p->popped;
+      p->popped_sum += item.priority;
+    }
+  }
+}
+
+SUITE(queue) {
+  //----------------------------------------------------------------------------
+  TEST(queue_priority_single_heap_is_exact) {
+    const size_t heap_capacity = 64;
+    uint8_t buf[2048];
+    CHECK(bl_queue_priority_buffer_size(1, heap_capacity) <= sizeof(buf));
+    BLQueuePriority q;
+    bl_queue_priority_init(&q, buf, 1, heap_capacity);
+    uint32_t seed = 1;
+
+    // with one heap the queue is a plain min-heap
+    BLQueuePriorityItem item;
+    CHECK(!bl_queue_priority_pop(&q, &item, &seed));
+    for (int index = 0; index < 64; ++index) {
+      uint64_t priority = (index * 37) % 64;
+      CHECK(bl_queue_priority_push(&q, priority, (void*)(uintptr_t)priority, &seed));
+    }
+    CHECK(!bl_queue_priority_push(&q, 0, NULL, &seed));
+
+    for (int index = 0; index < 64; ++index) {
+      CHECK(bl_queue_priority_pop(&q, &item, &seed));
+      CHECK_EQUAL((uint64_t)index, item.priority);
+      CHECK_EQUAL((uintptr_t)index, (uintptr_t)item.data);
+    }
+    CHECK(!bl_queue_priority_pop(&q, &item, &seed));
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_priority_full_range) {
+    uint8_t buf[2048];
+    CHECK(bl_queue_priority_buffer_size(4, 16) <= sizeof(buf));
+    BLQueuePriority q;
+    bl_queue_priority_init(&q, buf, 4, 16);
+    uint32_t seed = 1;
+
+    // every priority is usable, including the largest
+    const uint64_t max = 0xffffffffffffffffull;
+    CHECK(bl_queue_priority_push(&q, max, NULL, &seed));
+    CHECK(bl_queue_priority_push(&q, max, NULL, &seed));
+    CHECK(bl_queue_priority_push(&q, 0, NULL, &seed));
+
+    BLQueuePriorityItem item;
+    int max_popped = 0;
+    for (int index = 0; index < 3; ++index) {
+      CHECK(bl_queue_priority_pop(&q, &item, &seed));
+      max_popped += (item.priority == max) ? 1 : 0;
+    }
+    CHECK_EQUAL(2, max_popped);
+    CHECK(!bl_queue_priority_pop(&q, &item, &seed));
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_priority_batch) {
+    const size_t heap_count = 4;
+    const size_t heap_capacity = 16;
+    uint8_t buf[2048];
+    CHECK(bl_queue_priority_buffer_size(heap_count, heap_capacity) <= sizeof(buf));
+    BLQueuePriority q;
+    bl_queue_priority_init(&q, buf, heap_count, heap_capacity);
+    uint32_t seed = 12345;
+
+    // a batch bigger than the queue only pushes what fits
+    BLQueuePriorityItem items[80];
+    for (int index = 0; index < 80; ++index) {
+      items[index].priority = 79 - index;
+      items[index].data = NULL;
+    }
+    CHECK_EQUAL(64u, bl_queue_priority_push_batch(&q, items, 80, &seed));
+    CHECK_EQUAL(0u, bl_queue_priority_push_batch(&q, items, 1, &seed));
+
+    // every item comes out exactly once and each batch is sorted
+    bool seen[80] = { false };
+    size_t total = 0;
+    bool sorted = true;
+    for (;;) {
+      size_t count = bl_queue_priority_pop_batch(&q, items, 10, &seed);
+      if (count == 0) {
+        break;
+      }
+      for (size_t index = 0; index < count; ++index) {
+        CHECK(!seen[items[index].priority]);
+        seen[items[index].priority] = true;
+        sorted = sorted && ((index == 0) || (items[index - 1].priority <= items[index].priority));
+      }
+      total += count;
+    }
+    CHECK_EQUAL(64u, total);
+    CHECK(sorted);
+    for (int index = 16; index < 80; ++index) {
+      CHECK(seen[index]);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_priority_multiple_threads) {
+    const size_t heap_count = 16;
+    const size_t heap_capacity = 4096;
+    size_t buf_size = bl_queue_priority_buffer_size(heap_count, heap_capacity);
+    void* buf = bl_alloc(buf_size, 64);
+    BLQueuePriority q;
+    bl_queue_priority_init(&q, buf, heap_count, heap_capacity);
+
+    const int thread_count = 4;
+    const int items_per_thread = 10000;
+    PriorityTestParam params[thread_count];
+    BLThread threads[thread_count];
+    for (int index = 0; index < thread_count; ++index) {
+      params[index].queue = &q;
+      params[index].seed = index + 1;
+      params[index].first = index * items_per_thread;
+      params[index].count = items_per_thread;
+      bl_thread_create(threads + index, &priority_test_func, params + index);
+    }
+
+    int popped = 0;
+    int64_t popped_sum = 0;
+    for (int index = 0; index < thread_count; ++index) {
+      bl_thread_join(threads + index);
+      popped += params[index].popped;
+      popped_sum += params[index].popped_sum;
+    }
+
+    // drain the rest; nothing is lost or duplicated
+    uint32_t seed = 99;
+    BLQueuePriorityItem item;
+    while (bl_queue_priority_pop(&q, &item, &seed)) {
+      ++popped;
+      popped_sum += item.priority;
+    }
+    const int64_t total = thread_count * items_per_thread;
+    CHECK_EQUAL(total, (int64_t)popped);
+    CHECK_EQUAL(total * (total - 1) / 2, popped_sum);
+
+    bl_free(buf);
+  }
+}
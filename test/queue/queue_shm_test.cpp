@@ -0,0 +1,176 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unittest++/UnitTest++.h>
+#include <blink/queue.h>
+
+//------------------------------------------------------------------------------
+static void* map_shared_anon(size_t size) {
+  void* region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
+  return region == MAP_FAILED ? NULL : region;
+}
+
+//------------------------------------------------------------------------------
+static bool wait_child(pid_t pid) {
+  int status;
+  return (waitpid(pid, &status, 0) == pid) && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+SUITE(queue) {
+  //----------------------------------------------------------------------------
+  TEST(queue_shm_swsr_mapped_twice) {
+    // map the same shared memory object at two addresses in this process
+    char name[64];
+    snprintf(name, sizeof(name), "/blink_queue_shm_test_%d", (int)getpid());
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    CHECK(fd >= 0);
+    shm_unlink(name);
+
+    size_t size = bl_queue_shm_swsr_size(16, sizeof(int));
+    CHECK_EQUAL(0, ftruncate(fd, size));
+    void* region_a = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void* region_b = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    CHECK(region_a != MAP_FAILED);
+    CHECK(region_b != MAP_FAILED);
+    CHECK(region_a != region_b);
+
+    // nothing to attach to until the queue is initialized
+    CHECK(!bl_queue_shm_swsr_attach(region_b, size));
+    BLQueueShmSWSR* writer = bl_queue_shm_swsr_init(region_a, 16, sizeof(int));
+    BLQueueShmSWSR* reader = bl_queue_shm_swsr_attach(region_b, size);
+    CHECK(reader);
+    CHECK(!bl_queue_shm_swsr_attach(region_b, size - 1));
+
+    // fill the queue through one mapping and drain it through the other
+    for (int index = 0; index < 16; ++index) {
+      int* p = (int*)bl_queue_shm_swsr_write_prepare(writer);
+      CHECK(p);
+      *p = index;
+      bl_queue_shm_swsr_write_commit(writer);
+    }
+    CHECK(!bl_queue_shm_swsr_write_prepare(writer));
+    for (int index = 0; index < 16; ++index) {
+      int* p = (int*)bl_queue_shm_swsr_read_fetch(reader);
+      CHECK(p);
+      CHECK_EQUAL(index, *p);
+      bl_queue_shm_swsr_read_consume(reader);
+    }
+    CHECK(!bl_queue_shm_swsr_read_fetch(reader));
+
+    munmap(region_a, size);
+    munmap(region_b, size);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_shm_swsr_two_processes) {
+    const int message_count = 100000;
+    size_t size = bl_queue_shm_swsr_size(64, sizeof(int));
+    void* region = map_shared_anon(size);
+    CHECK(region);
+    BLQueueShmSWSR* q = bl_queue_shm_swsr_init(region, 64, sizeof(int));
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      // child: the writer
+      BLQueueShmSWSR* writer = bl_queue_shm_swsr_attach(region, size);
+      for (int index = 0; writer && (index < message_count); ++index) {
+        int* p;
+        while (!(p = (int*)bl_queue_shm_swsr_write_prepare(writer))) {
+        }
+        *p = index;
+        bl_queue_shm_swsr_write_commit(writer);
+      }
+      _exit(writer ? 0 : 1);
+    }
+    CHECK(pid > 0);
+
+    bool in_order = true;
+    for (int index = 0; index < message_count; ++index) {
+      int* p;
+      while (!(p = (int*)bl_queue_shm_swsr_read_fetch(q))) {
+      }
+      in_order = in_order && (*p == index);
+      bl_queue_shm_swsr_read_consume(q);
+    }
+    CHECK(in_order);
+    CHECK(wait_child(pid));
+
+    munmap(region, size);
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_shm_mpsc_multiple_processes) {
+    const int process_count = 3;
+    const int message_count = 20000;
+    size_t size = bl_queue_shm_mpsc_size(256, sizeof(int));
+    void* region = map_shared_anon(size);
+    CHECK(region);
+    BLQueueShmMPSC* q = bl_queue_shm_mpsc_init(region, 256, sizeof(int));
+
+    pid_t pids[process_count];
+    for (int process = 0; process < process_count; ++process) {
+      pids[process] = fork();
+      if (pids[process] == 0) {
+        // child: one of the writers
+        BLQueueShmMPSC* writer = bl_queue_shm_mpsc_attach(region, size);
+        for (int index = 0; writer && (index < message_count); ++index) {
+          int* p;
+          while (!(p = (int*)bl_queue_shm_mpsc_write_prepare(writer))) {
+          }
+          *p = (process << 24) | index;
+          bl_queue_shm_mpsc_write_commit(writer, p);
+        }
+        _exit(writer ? 0 : 1);
+      }
+      CHECK(pids[process] > 0);
+    }
+
+    // every writer's messages arrive in the order it wrote them
+    int next[process_count] = { 0 };
+    bool in_order = true;
+    for (int index = 0; index < process_count * message_count; ++index) {
+      int* p;
+      while (!(p = (int*)bl_queue_shm_mpsc_read_fetch(q))) {
+      }
+      int process = *p >> 24;
+      in_order = in_order && (process < process_count) && ((*p & 0xffffff) == next[process]++);
+      bl_queue_shm_mpsc_read_consume(q);
+    }
+    CHECK(in_order);
+    CHECK(!bl_queue_shm_mpsc_read_fetch(q));
+
+    for (int process = 0; process < process_count; ++process) {
+      CHECK(wait_child(pids[process]));
+    }
+
+    munmap(region, size);
+  }
+}
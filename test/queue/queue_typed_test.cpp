@@ -0,0 +1,123 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <unittest++/UnitTest++.h>
+#include <blink/queue.h>
+
+struct TypedTestElement {
+  uint32_t  a;
+  float     b;
+};
+
+typedef BLQueue<uint32_t, 64> TypedTestQueue;
+
+//------------------------------------------------------------------------------
+static void typed_producer_func(void* param) {
+  TypedTestQueue* q = (TypedTestQueue*)param;
+  for (uint32_t index = 0; index < 100000; ++index) {
+    while (!bl_queue_push(q, index)) {
+      // full; spin until the consumer catches up
+    }
+  }
+}
+
+SUITE(queue) {
+  //----------------------------------------------------------------------------
+  TEST(queue_typed_can_put_and_get) {
+    BLQueue<TypedTestElement, 4> q;
+    bl_queue_init(&q);
+
+    CHECK(!bl_queue_read_fetch(&q));
+
+    // write an item to the queue in place
+    bool empty;
+    TypedTestElement* p = bl_queue_write_prepare(&q, &empty);
+    CHECK(empty);
+    CHECK(p);
+    p->a = 5;
+    p->b = 2.0f;
+    bl_queue_write_commit(&q);
+
+    // read the item off the queue
+    p = bl_queue_read_fetch(&q);
+    CHECK(p);
+    CHECK_EQUAL(5u, p->a);
+    CHECK_EQUAL(2.0f, p->b);
+    bl_queue_read_consume(&q);
+
+    CHECK(!bl_queue_read_fetch(&q));
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_typed_uses_every_slot) {
+    BLQueue<int, 4> q;
+    bl_queue_init(&q);
+
+    // fill the queue twice over to exercise the wrap
+    for (int lap = 0; lap < 2; ++lap) {
+      for (int index = 0; index < 4; ++index) {
+        CHECK(bl_queue_push(&q, index));
+      }
+
+      // fail: full
+      bool empty;
+      CHECK(!bl_queue_write_prepare(&q, &empty));
+      CHECK(!empty);
+      CHECK(!bl_queue_push(&q, 4));
+
+      for (int index = 0; index < 4; ++index) {
+        int value = -1;
+        CHECK(bl_queue_pop(&q, &value));
+        CHECK_EQUAL(index, value);
+      }
+
+      // fail: empty
+      int value;
+      CHECK(!bl_queue_pop(&q, &value));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  TEST(queue_typed_producer_consumer) {
+    TypedTestQueue* q = (TypedTestQueue*)bl_alloc(sizeof(TypedTestQueue), 128);
+    bl_queue_init(q);
+
+    BLThread thread;
+    bl_thread_create(&thread, &typed_producer_func, q);
+
+    bool in_order = true;
+    for (uint32_t index = 0; index < 100000; ++index) {
+      uint32_t value;
+      while (!bl_queue_pop(q, &value)) {
+        // empty; spin until the producer catches up
+      }
+      in_order = in_order && (value == index);
+    }
+    CHECK(in_order);
+
+    bl_thread_join(&thread);
+    bl_free(q);
+  }
+}
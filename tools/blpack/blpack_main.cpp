@@ -0,0 +1,107 @@
+// Copyright (c) 2011, Ben Scott.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//   * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <blink/io.h>
+
+
+//
+// local functions
+//
+
+//------------------------------------------------------------------------------
+static void print_usage(const char* exe) {
+  printf("usage: %s [options] pack file...\n", exe);
+  printf("  pack                          pack to write\n");
+  printf("  file                          file to store; its entry name is the path as given\n");
+  printf("  --align bytes                 start each entry at a multiple of bytes (default %u)\n", BL_IO_PACK_DEFAULT_ALIGNMENT);
+  printf("  --strip prefix                drop prefix from the front of entry names\n");
+}
+
+//------------------------------------------------------------------------------
+static const char* status_name(BLIoStatus status) {
+  switch (status) {
+  case BL_IO_STATUS_ERROR_NOT_FOUND:             return "file not found";
+  case BL_IO_STATUS_ERROR_DUPLICATE_ENTRY:       return "duplicate entry name";
+  case BL_IO_STATUS_ERROR_TOO_MANY_OPEN_FILES:   return "too many open files";
+  default:                                       return "io error";
+  }
+}
+
+
+//
+// exported functions
+//
+
+//------------------------------------------------------------------------------
+int main(int argc, char** argv) {
+  uint32_t alignment = BL_IO_PACK_DEFAULT_ALIGNMENT;
+  const char* strip = "";
+  int arg = 1;
+  for (; (arg < argc) && (argv[arg][0] == '-'); ++arg) {
+    if (!strcmp(argv[arg], "--align") && (arg + 1 < argc)) {
+      alignment = (uint32_t)strtoul(argv[++arg], NULL, 0);
+      if (alignment == 0) {
+        print_usage(argv[0]);
+        return 1;
+      }
+    }
+    else if (!strcmp(argv[arg], "--strip") && (arg + 1 < argc)) {
+      strip = argv[++arg];
+    }
+    else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (argc - arg < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  const char* pack_name = argv[arg++];
+  uint32_t entry_count = (uint32_t)(argc - arg);
+  const char** source_names = (const char**)(argv + arg);
+  const char** entry_names = (const char**)malloc(sizeof(const char*) * entry_count);
+  size_t strip_length = strlen(strip);
+  for (uint32_t index = 0; index < entry_count; ++index) {
+    const char* name = source_names[index];
+    entry_names[index] = strncmp(name, strip, strip_length) ? name : name + strip_length;
+  }
+
+  bl_io_lib_initialize();
+  BLIoStatus status = bl_io_pack_build(pack_name, entry_names, source_names, entry_count, alignment);
+  bl_io_lib_finalize();
+  free(entry_names);
+
+  if (status != BL_IO_STATUS_OK) {
+    fprintf(stderr, "%s: failed to build %s: %s\n", argv[0], pack_name, status_name(status));
+    return 1;
+  }
+  printf("%s: %u entries\n", pack_name, entry_count);
+  return 0;
+}